@@ -0,0 +1,418 @@
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "main_6502.hpp"
+#include "blockcache_6502.hpp"
+#include "batch_6502.hpp"
+
+/*
+* Throughput benchmarks.
+*
+* Every workload is a small program that loops forever, most through a
+* JSR back to their start. Each is run for a fixed number of emulated
+* cycles with the plain interpreter and with the block cache, with and
+* without instruction fusion, and reported
+* as emulated MHz, host ns per instruction and bytes allocated while running.
+*
+* Every workload is also forked into BATCH_LANES machines that share the
+* program pages and run in a CPUBatch (batch_lockstep) or one after the
+* other on CPU (interpreter_lanes), to compare the two on the same work.
+*
+* Usage: M6502Bench [--cycles N] [--out file.json]
+* Results are written as JSON to stdout, or to the --out file.
+* */
+using namespace m6502;
+
+static std::atomic<u64> BytesAllocated{ 0 };
+
+void* operator new(size_t Size)
+{
+    BytesAllocated.fetch_add(Size, std::memory_order_relaxed);
+    if (void* Memory = malloc(Size ? Size : 1))
+    {
+        return Memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* Memory) noexcept
+{
+    free(Memory);
+}
+
+void operator delete(void* Memory, size_t) noexcept
+{
+    free(Memory);
+}
+
+namespace
+{
+    // Programs start here, the stack is reset to the top of page 1 between chunks
+    constexpr Word PROGRAM_START = 0x8000;
+    constexpr Word STACK_START = 0x01FF;
+    // The closing JSR pushes a return address every pass, it wraps within page 1 so it never reaches the program
+    constexpr s32 CHUNK_CYCLES = 8192;
+    constexpr u32 BATCH_LANES = 64;
+
+    struct Workload
+    {
+        const char* Name;
+        void (*Load)(CPU& cpu, Mem& memory);
+    };
+
+    // Emits instructions at PROGRAM_START and closes the loop with a JSR
+    struct Assembler
+    {
+        Mem& memory;
+        Word Address = PROGRAM_START;
+
+        void Emit(Byte Opcode)
+        {
+            memory[Address++] = Opcode;
+        }
+
+        void Emit(Byte Opcode, Byte Operand)
+        {
+            Emit(Opcode);
+            memory[Address++] = Operand;
+        }
+
+        void Emit(Byte Opcode, Word Operand)
+        {
+            Emit(Opcode);
+            memory[Address++] = Byte(Operand);
+            memory[Address++] = Byte(Operand >> 8);
+        }
+
+        void Loop()
+        {
+            Emit(CPU::INS_JSR, PROGRAM_START);
+        }
+    };
+
+    void LoadStoreLoop(CPU&, Mem& memory)
+    {
+        Assembler Asm{ memory };
+        for (int Repeat = 0; Repeat < 16; Repeat++)
+        {
+            Asm.Emit(CPU::INS_LDA_ZP, Byte(0x10 + Repeat));
+            Asm.Emit(CPU::INS_STA_ZP, Byte(0x40 + Repeat));
+        }
+        Asm.Loop();
+    }
+
+    void AddressingModes(CPU& cpu, Mem& memory)
+    {
+        cpu.X = 0x04;
+        cpu.Y = 0x08;
+        memory[0x0020] = 0x00; // ($1C,X) -> $3000
+        memory[0x0021] = 0x30;
+        memory[0x0030] = 0x00; // ($30),Y -> $3008
+        memory[0x0031] = 0x30;
+
+        Assembler Asm{ memory };
+        Asm.Emit(CPU::INS_LDA_IM, Byte(0x42));
+        Asm.Emit(CPU::INS_LDA_ZP, Byte(0x10));
+        Asm.Emit(CPU::INS_LDA_ZPX, Byte(0x10));
+        Asm.Emit(CPU::INS_LDA_ABS, Word(0x3000));
+        Asm.Emit(CPU::INS_LDA_ABSX, Word(0x3000));
+        Asm.Emit(CPU::INS_LDA_ABSY, Word(0x3000));
+        Asm.Emit(CPU::INS_LDA_INDX, Byte(0x1C));
+        Asm.Emit(CPU::INS_LDA_INDY, Byte(0x30));
+        Asm.Emit(CPU::INS_LDY_ZPX, Byte(0x10));
+        Asm.Emit(CPU::INS_LDY_ABSX, Word(0x3000));
+        Asm.Emit(CPU::INS_LDY_IM, Byte(0x08));
+        Asm.Emit(CPU::INS_LDX_ZPY, Byte(0x10));
+        Asm.Emit(CPU::INS_LDX_ABSY, Word(0x3000));
+        Asm.Emit(CPU::INS_LDX_IM, Byte(0x04));
+        Asm.Emit(CPU::INS_STA_ZP, Byte(0x50));
+        Asm.Emit(CPU::INS_STA_ZPX, Byte(0x50));
+        Asm.Emit(CPU::INS_STA_ABS, Word(0x3100));
+        Asm.Emit(CPU::INS_STA_ABSX, Word(0x3100));
+        Asm.Emit(CPU::INS_STA_ABSY, Word(0x3100));
+        Asm.Emit(CPU::INS_STA_INDX, Byte(0x1C));
+        Asm.Emit(CPU::INS_STA_INDY, Byte(0x30));
+        Asm.Emit(CPU::INS_STX_ZP, Byte(0x58));
+        Asm.Emit(CPU::INS_STX_ABS, Word(0x3110));
+        Asm.Emit(CPU::INS_STY_ZP, Byte(0x59));
+        Asm.Emit(CPU::INS_STY_ZPX, Byte(0x59));
+        Asm.Emit(CPU::INS_STY_ABS, Word(0x3111));
+        Asm.Loop();
+    }
+
+    void PageCrossingLoads(CPU& cpu, Mem& memory)
+    {
+        cpu.X = 0xFF;
+        cpu.Y = 0xFF;
+        memory[0x0030] = 0x80; // ($30),Y -> $3180
+        memory[0x0031] = 0x30;
+
+        Assembler Asm{ memory };
+        for (int Repeat = 0; Repeat < 8; Repeat++)
+        {
+            Asm.Emit(CPU::INS_LDA_ABSX, Word(0x3081 + Repeat));
+            Asm.Emit(CPU::INS_LDA_ABSY, Word(0x30F0 + Repeat));
+            Asm.Emit(CPU::INS_LDA_INDY, Byte(0x30));
+        }
+        Asm.Loop();
+    }
+
+    void SubroutineCalls(CPU&, Mem& memory)
+    {
+        // A chain of JSRs, each one to the next
+        Assembler Asm{ memory };
+        for (int Call = 1; Call < 32; Call++)
+        {
+            Asm.Emit(CPU::INS_JSR, Word(PROGRAM_START + Call * 3));
+        }
+        Asm.Loop();
+    }
+
+    void MixedProgram(CPU& cpu, Mem& memory)
+    {
+        // An unrolled block copy with a table lookup, as a typical inner loop
+        cpu.X = 0;
+        cpu.Y = 0;
+        for (Word Offset = 0; Offset < 0x100; Offset++)
+        {
+            memory[Word(0x2000 + Offset)] = Byte(Offset * 13);
+        }
+        memory[0x0040] = 0x00;
+        memory[0x0041] = 0x20;
+
+        Assembler Asm{ memory };
+        for (int Repeat = 0; Repeat < 4; Repeat++)
+        {
+            Asm.Emit(CPU::INS_LDY_IM, Byte(Repeat * 16));
+            Asm.Emit(CPU::INS_LDA_INDY, Byte(0x40));
+            Asm.Emit(CPU::INS_STA_ABSY, Word(0x2400));
+            Asm.Emit(CPU::INS_LDX_ABSY, Word(0x2000));
+            Asm.Emit(CPU::INS_LDA_ABSX, Word(0x2000));
+            Asm.Emit(CPU::INS_STA_ZPX, Byte(0x00));
+            Asm.Emit(CPU::INS_LDY_ZP, Byte(0x41));
+            Asm.Emit(CPU::INS_STY_ABS, Word(0x2500));
+            Asm.Emit(CPU::INS_STX_ZP, Byte(0x60));
+        }
+        Asm.Emit(CPU::INS_JSR, Word(PROGRAM_START + 0x200));
+        Asm.Address = PROGRAM_START + 0x200;
+        Asm.Emit(CPU::INS_LDA_IM, Byte(0x01));
+        Asm.Emit(CPU::INS_STA_ABS, Word(0x2600));
+        Asm.Loop();
+    }
+
+    void IdlePolling(CPU&, Mem& memory)
+    {
+        // Waits on a zero page flag nothing sets, the block cache skips it
+        Assembler Asm{ memory };
+        Asm.Emit(CPU::INS_LDA_ZP, Byte(0x10));
+        Asm.Emit(CPU::INS_JMP_ABS, PROGRAM_START);
+    }
+
+    const Workload Workloads[] = {
+        { "load_store_loop", &LoadStoreLoop },
+        { "addressing_modes", &AddressingModes },
+        { "page_crossing_loads", &PageCrossingLoads },
+        { "subroutine_calls", &SubroutineCalls },
+        { "mixed_program", &MixedProgram },
+        { "idle_polling", &IdlePolling },
+    };
+
+    struct Result
+    {
+        const char* Workload;
+        const char* Engine;
+        s64 Cycles;
+        s64 Instructions;
+        double Seconds;
+        u64 Bytes;
+    };
+
+    void Setup(const Workload& Work, CPU& cpu, Mem& memory)
+    {
+        cpu.Reset(memory);
+        Work.Load(cpu, memory);
+        cpu.PC = PROGRAM_START;
+        cpu.SP = STACK_START;
+    }
+
+    // Instructions per cycle of a workload, counted one instruction at a time
+    double InstructionsPerCycle(const Workload& Work)
+    {
+        CPU cpu;
+        Mem memory;
+        Setup(Work, cpu, memory);
+        s64 Cycles = 0;
+        s64 Instructions = 0;
+        for (; Instructions < 100000; Instructions++)
+        {
+            if ((Instructions & 0x3FF) == 0)
+            {
+                cpu.SP = STACK_START;
+            }
+            Cycles += cpu.Execute(1, memory);
+        }
+        return double(Instructions) / double(Cycles);
+    }
+
+    template <typename RunChunk>
+    Result Measure(const Workload& Work, const char* Engine, s64 TotalCycles, double InsPerCycle, RunChunk Run)
+    {
+        CPU cpu;
+        Mem memory;
+        Setup(Work, cpu, memory);
+        Run(cpu, memory, CHUNK_CYCLES); // Warm up
+
+        const u64 BytesBefore = BytesAllocated.load();
+        const auto Start = std::chrono::steady_clock::now();
+        s64 Cycles = 0;
+        while (Cycles < TotalCycles)
+        {
+            cpu.SP = STACK_START;
+            Cycles += Run(cpu, memory, CHUNK_CYCLES);
+        }
+        const auto End = std::chrono::steady_clock::now();
+
+        Result Res;
+        Res.Workload = Work.Name;
+        Res.Engine = Engine;
+        Res.Cycles = Cycles;
+        Res.Instructions = s64(double(Cycles) * InsPerCycle);
+        Res.Seconds = std::chrono::duration<double>(End - Start).count();
+        Res.Bytes = BytesAllocated.load() - BytesBefore;
+        return Res;
+    }
+
+    // BATCH_LANES forks of the workload, run for TotalCycles between them
+    Result MeasureLanes(const Workload& Work, bool Batched, s64 TotalCycles, double InsPerCycle)
+    {
+        CPU Boot;
+        Mem Image;
+        Setup(Work, Boot, Image);
+        std::vector<CPU> CPUs(BATCH_LANES, Boot);
+        std::vector<Mem> Memories(BATCH_LANES, Image);
+        CPUBatch Batch(BATCH_LANES);
+        for (u32 Lane = 0; Lane < BATCH_LANES; Lane++)
+        {
+            Batch.SetLane(Lane, CPUs[Lane], Memories[Lane]);
+        }
+
+        auto RunChunk = [&]()
+        {
+            s64 Used = 0;
+            for (u32 Lane = 0; Lane < BATCH_LANES; Lane++)
+            {
+                if (Batched)
+                {
+                    Batch.SP[Lane] = STACK_START;
+                }
+                else
+                {
+                    CPUs[Lane].SP = STACK_START;
+                }
+            }
+            if (Batched)
+            {
+                Batch.Execute(CHUNK_CYCLES);
+            }
+            for (u32 Lane = 0; Lane < BATCH_LANES; Lane++)
+            {
+                Used += Batched ? Batch.CyclesUsed(Lane) : CPUs[Lane].Execute(CHUNK_CYCLES, Memories[Lane]);
+            }
+            return Used;
+        };
+        RunChunk(); // Warm up
+
+        const u64 BytesBefore = BytesAllocated.load();
+        const auto Start = std::chrono::steady_clock::now();
+        s64 Cycles = 0;
+        while (Cycles < TotalCycles)
+        {
+            Cycles += RunChunk();
+        }
+        const auto End = std::chrono::steady_clock::now();
+
+        Result Res;
+        Res.Workload = Work.Name;
+        Res.Engine = Batched ? "batch_lockstep" : "interpreter_lanes";
+        Res.Cycles = Cycles;
+        Res.Instructions = s64(double(Cycles) * InsPerCycle);
+        Res.Seconds = std::chrono::duration<double>(End - Start).count();
+        Res.Bytes = BytesAllocated.load() - BytesBefore;
+        return Res;
+    }
+
+    void WriteJSON(FILE* Out, const std::vector<Result>& Results, s64 TotalCycles)
+    {
+        fprintf(Out, "{\n  \"cycles_per_run\": %lld,\n  \"threaded_dispatch\": %s,\n  \"results\": [\n",
+            (long long)TotalCycles, M6502_USE_THREADED_DISPATCH ? "true" : "false");
+        for (size_t Index = 0; Index < Results.size(); Index++)
+        {
+            const Result& Res = Results[Index];
+            fprintf(Out,
+                "    { \"workload\": \"%s\", \"engine\": \"%s\", \"cycles\": %lld, \"instructions\": %lld, "
+                "\"seconds\": %.6f, \"emulated_mhz\": %.3f, \"ns_per_instruction\": %.3f, \"bytes_allocated\": %llu }%s\n",
+                Res.Workload, Res.Engine, (long long)Res.Cycles, (long long)Res.Instructions, Res.Seconds,
+                double(Res.Cycles) / Res.Seconds / 1e6, Res.Seconds * 1e9 / double(Res.Instructions),
+                (unsigned long long)Res.Bytes, Index + 1 < Results.size() ? "," : "");
+        }
+        fprintf(Out, "  ]\n}\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    s64 TotalCycles = 50000000;
+    const char* OutPath = nullptr;
+    for (int Arg = 1; Arg < argc; Arg++)
+    {
+        if (strcmp(argv[Arg], "--cycles") == 0 && Arg + 1 < argc)
+        {
+            TotalCycles = atoll(argv[++Arg]);
+        }
+        else if (strcmp(argv[Arg], "--out") == 0 && Arg + 1 < argc)
+        {
+            OutPath = argv[++Arg];
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [--cycles N] [--out file.json]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<Result> Results;
+    for (const Workload& Work : Workloads)
+    {
+        const double InsPerCycle = InstructionsPerCycle(Work);
+        Results.push_back(Measure(Work, "interpreter", TotalCycles, InsPerCycle,
+            [](CPU& cpu, Mem& memory, s32 Cycles) { return cpu.Execute(Cycles, memory); }));
+
+        BlockCache cache;
+        Results.push_back(Measure(Work, "block_cache", TotalCycles, InsPerCycle,
+            [&cache](CPU& cpu, Mem& memory, s32 Cycles) { return cpu.Execute(Cycles, memory, cache); }));
+
+        BlockCache Unfused(false);
+        Results.push_back(Measure(Work, "block_cache_unfused", TotalCycles, InsPerCycle,
+            [&Unfused](CPU& cpu, Mem& memory, s32 Cycles) { return cpu.Execute(Cycles, memory, Unfused); }));
+
+        Results.push_back(MeasureLanes(Work, false, TotalCycles, InsPerCycle));
+        Results.push_back(MeasureLanes(Work, true, TotalCycles, InsPerCycle));
+    }
+
+    FILE* Out = OutPath ? fopen(OutPath, "w") : stdout;
+    if (Out == nullptr)
+    {
+        fprintf(stderr, "Can't open %s\n", OutPath);
+        return 1;
+    }
+    WriteJSON(Out, Results, TotalCycles);
+    if (Out != stdout)
+    {
+        fclose(Out);
+    }
+    return 0;
+}
@@ -0,0 +1,453 @@
+#pragma once
+
+#include <algorithm>
+#include <type_traits>
+#include <vector>
+#include <instructions_6502.hpp>
+
+/*
+* Lockstep batch engine.
+*
+* Keeps the registers and flags of many independent CPUs in struct of
+* arrays form, each lane with its own Mem. Every step marks the running
+* lanes in Active, then:
+*  - Lockstep: every running lane is on the same PC with the same
+*    instruction bytes, as lanes forked from one machine are (they share
+*    the code pages, see StepLockstep). The instruction is fetched and
+*    decoded once and its kernel updates all lanes through Active. PC and
+*    cycles, flag changes and jumps are loops the compiler vectorizes,
+*    load results and binary ADC/SBC are committed with SSE2/AVX2. Memory
+*    accesses stay lane by lane, every lane has its own memory.
+*  - Divergent: every running lane fetches its own opcode and each opcode
+*    present runs once for the lanes that have it.
+* Opcodes without a batch kernel run the CPU handler lane by lane, which
+* copies the lane out and back.
+*
+* bench_6502.cpp compares a batch (batch_lockstep) with the same lanes
+* run one after the other (interpreter_lanes).
+* */
+namespace m6502
+{
+	struct CPUBatch;
+
+	// Runs one opcode for the given lanes, which are all positioned on it
+	using BatchKernel = void (*)(CPUBatch& batch, Byte Opcode, const std::vector<u32>& Lanes);
+	// Runs one opcode for every Active lane, all on the same instruction with the same Operand
+	using LockstepKernel = void (*)(CPUBatch& batch, Byte Opcode, Word Operand);
+
+	/*
+	* Commits loaded values to a register and the Z/N flags for every lane
+	* with a 0xFF Mask byte. Uses AVX2 or SSE2 when available.
+	* */
+	void CommitLoad(Byte* Register, Byte* Z, Byte* N, const Byte* Values, const Byte* Mask, u32 Count);
+
+	// Binary ADC (SBC with Subtract) of Values into A and C, Z, V and N, lanes as CommitLoad. Uses SSE2 when available
+	void CommitArithmetic(Byte* A, Byte* C, Byte* Z, Byte* V, Byte* N, const Byte* Values, const Byte* Mask, bool Subtract, u32 Count);
+}
+
+struct m6502::CPUBatch
+{
+	explicit CPUBatch(u32 NumLanes);
+
+	u32 Lanes() const
+	{
+		return u32(PC.size());
+	}
+
+	// Copies the registers of cpu into the lane, which will run in memory
+	void SetLane(u32 Lane, const CPU& cpu, Mem& memory);
+	void GetLane(u32 Lane, CPU& cpu) const;
+
+	// Runs every lane for at least Cycles, stopping each one like CPU::Execute
+	void Execute(s32 Cycles);
+
+	s32 CyclesUsed(u32 Lane) const
+	{
+		return CyclesRequested - Cycles[Lane];
+	}
+
+	// Lane stopped on an opcode it cannot run
+	bool IsHalted(u32 Lane) const
+	{
+		return Halted[Lane] != 0;
+	}
+
+	// Moves every Active lane past an instruction
+	void Advance(Byte Bytes, Byte BaseCycles);
+
+	// The Active lanes as a list, for the lane by lane kernels
+	const std::vector<u32>& ActiveLanes();
+	// The Active lanes with a non zero Select byte as a list, they are no longer Active
+	const std::vector<u32>& SplitLanes(const std::vector<Byte>& Select);
+
+	template <Byte CPU::*Register>
+	std::vector<Byte>& LaneRegister()
+	{
+		if constexpr (Register == &CPU::A)
+		{
+			return A;
+		}
+		else if constexpr (Register == &CPU::X)
+		{
+			return X;
+		}
+		else
+		{
+			return Y;
+		}
+	}
+
+	template <Byte Flag>
+	std::vector<Byte>& LaneFlag()
+	{
+		static_assert(Flag == CPU::C_FLAG || Flag == CPU::D_FLAG, "Only C and D have flag instructions");
+		if constexpr (Flag == CPU::C_FLAG)
+		{
+			return C;
+		}
+		else
+		{
+			return D;
+		}
+	}
+
+	/* Lane state */
+	std::vector<Word> PC, SP;
+	std::vector<Byte> A, X, Y;
+	std::vector<Byte> C, Z, I, D, B, V, N; // Status flags, one byte per lane
+	std::vector<s32> Cycles; // Cycles left in the current Execute
+	std::vector<Byte> Halted;
+	std::vector<Mem*> Memory;
+
+	/* Per step scratch */
+	std::vector<Byte> Values; // Value loaded by each lane
+	std::vector<Byte> Mask; // 0xFF for the lanes running the current opcode
+	std::vector<Byte> Active; // 0xFF for the lanes still running
+	u32 Leader = 0; // First Active lane, in lockstep the others run the same bytes
+
+private:
+	bool Step();
+	// False, with nothing run, unless every Active lane is on the same instruction
+	bool StepLockstep();
+	void StepDivergent();
+
+	s32 CyclesRequested = 0;
+	std::vector<u32> OpcodeLanes[256];
+	std::vector<Byte> Present; // Opcodes fetched this step
+	std::vector<u32> LaneList;
+};
+
+namespace m6502
+{
+	/*
+	* Default kernel: runs the opcode's CPU handler lane by lane, so every
+	* instruction works in a batch with the exact semantics of CPU.
+	* */
+	template <typename Operation>
+	struct BatchOp
+	{
+		static void Run(CPUBatch& batch, Byte Opcode, const std::vector<u32>& Lanes)
+		{
+			const Instruction& Ins = OpcodeTable[Opcode];
+			for (u32 Lane : Lanes)
+			{
+				CPU cpu;
+				batch.GetLane(Lane, cpu);
+				cpu.PC++;
+				s32& Cycles = batch.Cycles[Lane];
+				Cycles -= Ins.Cycles;
+				Ins.Execute(cpu, Cycles, *batch.Memory[Lane]);
+				if (cpu.PendingStop != StopReason::CyclesExhausted)
+				{
+					Cycles = cpu.StopCycles;
+					batch.Halted[Lane] = 1;
+				}
+				batch.SetLane(Lane, cpu, *batch.Memory[Lane]);
+			}
+		}
+	};
+
+	/*
+	* Loads gather their value lane by lane, each lane has its own memory,
+	* then commit the register and flags for all lanes at once.
+	* */
+	template <Byte CPU::*Register, typename Mode>
+	struct BatchOp<Load<Register, Mode>>
+	{
+		static void Run(CPUBatch& batch, Byte Opcode, const std::vector<u32>& Lanes)
+		{
+			const Instruction& Ins = OpcodeTable[Opcode];
+			CPU Index{}; // Resolve only looks at X and Y
+			for (u32 Lane : Lanes)
+			{
+				const Mem& memory = *batch.Memory[Lane];
+				Index.X = batch.X[Lane];
+				Index.Y = batch.Y[Lane];
+				const Word Operand = Mode::Operand(memory, Word(batch.PC[Lane] + 1));
+				batch.PC[Lane] += Ins.Bytes;
+				batch.Cycles[Lane] -= Ins.Cycles;
+				const Word Address = Mode::template Resolve<true>(Index, Operand, batch.Cycles[Lane], memory);
+				batch.Values[Lane] = memory[Address];
+				batch.Mask[Lane] = 0xFF;
+			}
+
+			CommitLoad(batch.LaneRegister<Register>().data(), batch.Z.data(), batch.N.data(),
+				batch.Values.data(), batch.Mask.data(), batch.Lanes());
+
+			for (u32 Lane : Lanes)
+			{
+				batch.Mask[Lane] = 0;
+			}
+		}
+	};
+
+	template <Byte CPU::*Register, typename Mode>
+	struct BatchOp<Store<Register, Mode>>
+	{
+		static void Run(CPUBatch& batch, Byte Opcode, const std::vector<u32>& Lanes)
+		{
+			const Instruction& Ins = OpcodeTable[Opcode];
+			std::vector<Byte>& Source = batch.LaneRegister<Register>();
+			CPU Index{};
+			for (u32 Lane : Lanes)
+			{
+				Mem& memory = *batch.Memory[Lane];
+				Index.X = batch.X[Lane];
+				Index.Y = batch.Y[Lane];
+				const Word Operand = Mode::Operand(memory, Word(batch.PC[Lane] + 1));
+				batch.PC[Lane] += Ins.Bytes;
+				batch.Cycles[Lane] -= Ins.Cycles;
+				const Word Address = Mode::template Resolve<false>(Index, Operand, batch.Cycles[Lane], memory);
+				memory.WriteByte(Address, Source[Lane]);
+			}
+		}
+	};
+
+	void HaltLanes(CPUBatch& batch, Byte Opcode, const std::vector<u32>& Lanes);
+
+	constexpr std::array<BatchKernel, 256> MakeBatchTable()
+	{
+		std::array<BatchKernel, 256> Table{};
+		for (BatchKernel& Entry : Table)
+		{
+			Entry = &HaltLanes;
+		}
+
+		using Variant = NMOS6502;
+#define M6502_BATCH_ENTRY(Opcode, Cycles, ...) Table[CPU::Opcode] = &BatchOp<__VA_ARGS__>::Run;
+		M6502_OPCODES(M6502_BATCH_ENTRY)
+		M6502_NMOS_OPCODES(M6502_BATCH_ENTRY)
+#undef M6502_BATCH_ENTRY
+
+		return Table;
+	}
+
+	inline constexpr std::array<BatchKernel, 256> BatchTable = MakeBatchTable();
+
+	// Runs the opcode's BatchTable kernel for the Active lanes
+	void LockstepLanes(CPUBatch& batch, Byte Opcode, Word Operand);
+
+	/*
+	* Lockstep kernels. The default hands the Active lanes to the opcode's
+	* BatchTable kernel, which fetches the operand lane by lane again.
+	* */
+	template <typename Operation>
+	struct LockstepOp
+	{
+		static void Run(CPUBatch& batch, Byte Opcode, Word Operand)
+		{
+			LockstepLanes(batch, Opcode, Operand);
+		}
+	};
+
+	// Reads the value every Active lane's instruction works on into Values
+	template <typename Mode>
+	void GatherValues(CPUBatch& batch, Word Operand)
+	{
+		if constexpr (std::is_same_v<Mode, Addr::Immediate>)
+		{
+			// The bytes are the same in every lane
+			std::fill(batch.Values.begin(), batch.Values.end(), batch.Memory[batch.Leader]->Read(Operand));
+		}
+		else
+		{
+			// Byte stores may alias anything, so the arrays are held in locals rather than reloaded
+			const Byte* Running = batch.Active.data();
+			const Byte* X = batch.X.data();
+			const Byte* Y = batch.Y.data();
+			Mem* const* Memory = batch.Memory.data();
+			s32* Cycles = batch.Cycles.data();
+			Byte* Values = batch.Values.data();
+			const u32 Count = batch.Lanes();
+			CPU Index{};
+			for (u32 Lane = 0; Lane < Count; Lane++)
+			{
+				if (!Running[Lane])
+				{
+					continue;
+				}
+				const Mem& memory = *Memory[Lane];
+				Index.X = X[Lane];
+				Index.Y = Y[Lane];
+				const Word Address = Mode::template Resolve<true>(Index, Operand, Cycles[Lane], memory);
+				Values[Lane] = memory[Address];
+			}
+		}
+	}
+
+	template <Byte CPU::*Register, typename Mode>
+	struct LockstepOp<Load<Register, Mode>>
+	{
+		static void Run(CPUBatch& batch, Byte Opcode, Word Operand)
+		{
+			const Instruction& Ins = OpcodeTable[Opcode];
+			batch.Advance(Ins.Bytes, Ins.Cycles);
+			GatherValues<Mode>(batch, Operand);
+			CommitLoad(batch.LaneRegister<Register>().data(), batch.Z.data(), batch.N.data(),
+				batch.Values.data(), batch.Active.data(), batch.Lanes());
+		}
+	};
+
+	template <Byte CPU::*Register, typename Mode>
+	struct LockstepOp<Store<Register, Mode>>
+	{
+		static void Run(CPUBatch& batch, Byte Opcode, Word Operand)
+		{
+			const Instruction& Ins = OpcodeTable[Opcode];
+			batch.Advance(Ins.Bytes, Ins.Cycles);
+			const Byte* Source = batch.LaneRegister<Register>().data();
+			const Byte* Running = batch.Active.data();
+			const Byte* X = batch.X.data();
+			const Byte* Y = batch.Y.data();
+			Mem* const* Memory = batch.Memory.data();
+			s32* Cycles = batch.Cycles.data();
+			const u32 Count = batch.Lanes();
+			CPU Index{};
+			for (u32 Lane = 0; Lane < Count; Lane++)
+			{
+				if (!Running[Lane])
+				{
+					continue;
+				}
+				Mem& memory = *Memory[Lane];
+				Index.X = X[Lane];
+				Index.Y = Y[Lane];
+				const Word Address = Mode::template Resolve<false>(Index, Operand, Cycles[Lane], memory);
+				memory.WriteByte(Address, Source[Lane]);
+			}
+		}
+	};
+
+	/* Decimal mode lanes take the table lookup lane by lane, binary lanes are vectorized */
+	template <typename Variant, bool Subtract, typename Mode>
+	struct LockstepOp<Arithmetic<Variant, Subtract, Mode>>
+	{
+		static void Run(CPUBatch& batch, Byte Opcode, Word Operand)
+		{
+			if constexpr (Variant::DecimalMode)
+			{
+				const std::vector<u32>& Decimal = batch.SplitLanes(batch.D);
+				if (!Decimal.empty())
+				{
+					BatchTable[Opcode](batch, Opcode, Decimal);
+				}
+			}
+			const Instruction& Ins = OpcodeTable[Opcode];
+			batch.Advance(Ins.Bytes, Ins.Cycles);
+			GatherValues<Mode>(batch, Operand);
+			CommitArithmetic(batch.A.data(), batch.C.data(), batch.Z.data(), batch.V.data(), batch.N.data(),
+				batch.Values.data(), batch.Active.data(), Subtract, batch.Lanes());
+		}
+	};
+
+	template <Byte Flag, bool Value>
+	struct LockstepOp<ChangeFlag<Flag, Value>>
+	{
+		static void Run(CPUBatch& batch, Byte Opcode, Word)
+		{
+			const Instruction& Ins = OpcodeTable[Opcode];
+			batch.Advance(Ins.Bytes, Ins.Cycles);
+			Byte* Lanes = batch.LaneFlag<Flag>().data();
+			const Byte* Select = batch.Active.data();
+			const u32 Count = batch.Lanes();
+			for (u32 Lane = 0; Lane < Count; Lane++)
+			{
+				Lanes[Lane] = Byte(((Value ? 1 : 0) & Select[Lane]) | (Lanes[Lane] & ~Select[Lane]));
+			}
+		}
+	};
+
+	template <>
+	struct LockstepOp<Jump>
+	{
+		static void Run(CPUBatch& batch, Byte Opcode, Word Operand)
+		{
+			const Instruction& Ins = OpcodeTable[Opcode];
+			batch.Advance(0, Ins.Cycles);
+			Word* Next = batch.PC.data();
+			const Byte* Select = batch.Active.data();
+			for (u32 Lane = 0; Lane < batch.Lanes(); Lane++)
+			{
+				Next[Lane] = Select[Lane] ? Operand : Next[Lane];
+			}
+		}
+	};
+
+	/* Same stack layout as CPU::PushWord and CPU::PopWord */
+	template <>
+	struct LockstepOp<JumpToSubroutine>
+	{
+		static void Run(CPUBatch& batch, Byte Opcode, Word Operand)
+		{
+			const Instruction& Ins = OpcodeTable[Opcode];
+			for (u32 Lane = 0; Lane < batch.Lanes(); Lane++)
+			{
+				if (!batch.Active[Lane])
+				{
+					continue;
+				}
+				// The return address is the last byte of the JSR, as in JumpToSubroutine::Execute
+				CPU::PushWord(batch.SP[Lane], Word(batch.PC[Lane] + Ins.Bytes - 1), *batch.Memory[Lane]);
+				batch.PC[Lane] = Operand;
+				batch.Cycles[Lane] -= Ins.Cycles;
+			}
+		}
+	};
+
+	template <>
+	struct LockstepOp<ReturnFromSubroutine>
+	{
+		static void Run(CPUBatch& batch, Byte Opcode, Word)
+		{
+			const Instruction& Ins = OpcodeTable[Opcode];
+			for (u32 Lane = 0; Lane < batch.Lanes(); Lane++)
+			{
+				if (!batch.Active[Lane])
+				{
+					continue;
+				}
+				batch.PC[Lane] = Word(CPU::PopWord(batch.SP[Lane], *batch.Memory[Lane]) + 1);
+				batch.Cycles[Lane] -= Ins.Cycles;
+			}
+		}
+	};
+
+	constexpr std::array<LockstepKernel, 256> MakeLockstepTable()
+	{
+		std::array<LockstepKernel, 256> Table{};
+		for (LockstepKernel& Entry : Table)
+		{
+			Entry = &LockstepLanes;
+		}
+
+		using Variant = NMOS6502;
+#define M6502_LOCKSTEP_ENTRY(Opcode, Cycles, ...) Table[CPU::Opcode] = &LockstepOp<__VA_ARGS__>::Run;
+		M6502_OPCODES(M6502_LOCKSTEP_ENTRY)
+		M6502_NMOS_OPCODES(M6502_LOCKSTEP_ENTRY)
+#undef M6502_LOCKSTEP_ENTRY
+
+		return Table;
+	}
+
+	inline constexpr std::array<LockstepKernel, 256> LockstepTable = MakeLockstepTable();
+}
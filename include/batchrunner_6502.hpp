@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <loader_6502.hpp>
+#include <pool_6502.hpp>
+
+/*
+* Multi-core runner for many independent programs.
+*
+* Every job is a program image loaded into a freshly reset machine, run
+* until it stops (JAM, illegal opcode) or its cycle budget is used. The
+* result holds the final registers, the stop reason and a digest of the
+* whole 64KB of RAM, so runs can be compared without keeping memory.
+*
+* Jobs are split into one contiguous range per worker. A worker takes jobs
+* from the front of its own range, and once it is empty steals the back
+* half of the fullest other range. The range is a single atomic word, so
+* owner and thieves only meet in a compare exchange on it and the hot
+* path touches nothing shared: every worker has its own MachinePool and
+* writes only the results of the jobs it took.
+* */
+namespace m6502
+{
+	struct BatchJob
+	{
+		const Byte* Image;
+		u32 Size;
+		Word LoadAddress;
+		Word StartPC;
+		s64 Cycles; // Budget, the program stops earlier on JAM or an illegal opcode
+		const ProgramImage* Program = nullptr; // Loaded instead of Image when set, LoadAddress is unused
+	};
+
+	struct BatchJobResult
+	{
+		StopReason Reason;
+		Byte Opcode; // For IllegalOpcode and Halt
+		Word PC;
+		Word SP;
+		Byte A, X, Y;
+		Byte Status;
+		s64 CyclesUsed;
+		u64 MemoryDigest;
+	};
+
+	// Digest of the RAM behind every page of memory, equal RAM gives equal digests
+	u64 MemoryDigest(const Mem& memory);
+
+	struct BatchRunner;
+}
+
+struct m6502::BatchRunner
+{
+	// One worker per hardware thread when NumWorkers is 0
+	explicit BatchRunner(u32 NumWorkers = 0);
+	~BatchRunner();
+
+	BatchRunner(const BatchRunner&) = delete;
+	BatchRunner& operator=(const BatchRunner&) = delete;
+
+	// Runs every job, Results[i] belongs to Jobs[i]. Workers keep their machines between calls.
+	void Run(const std::vector<BatchJob>& Jobs, std::vector<BatchJobResult>& Results);
+
+	u32 Workers() const
+	{
+		return u32(WorkerStates.size());
+	}
+
+	// Jobs each worker ran in the last Run, including stolen ones
+	std::vector<u64> JobsPerWorker() const;
+
+	// Runs a single job on machine, what every worker does per job
+	static BatchJobResult RunJob(const BatchJob& Job, Machine& machine);
+
+private:
+	// Cache line aligned, workers never write each other's lines on the hot path
+	struct alignas(64) Worker
+	{
+		std::atomic<u64> Range{ 0 }; // Begin in the low, end in the high 32 bits
+		MachinePool Pool{ 1 };
+		u64 JobsRun = 0;
+	};
+
+	void WorkerLoop(u32 Index, const std::vector<BatchJob>& Jobs, std::vector<BatchJobResult>& Results);
+	bool TakeJob(Worker& Self, u32& Job);
+	bool Steal(u32 Thief);
+
+	std::vector<std::unique_ptr<Worker>> WorkerStates;
+};
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <instructions_6502.hpp>
+
+/*
+* Decoded basic block cache.
+*
+* A block is a run of instructions up to and including the next one that
+* changes PC (jump, branch, ...). Each instruction is stored with its
+* handler, its operand and its base cycles, so running a cached block
+* never goes through the fetch/decode path.
+*
+* Blocks are keyed by their start PC. Writes to memory set the page's bit
+* in Mem::CodeWrites, and blocks on a written page are dropped before the
+* next lookup, so self modifying code is picked up. The cache clears
+* CodeWrites as it drops blocks and leaves Mem::DirtyPages to the others.
+* The cache is tied to one Mem, call Flush before using it with another.
+*
+* Idle loops: a block that jumps back to its own start and never writes
+* memory can only be waiting, e.g. JMP * or polling a location. When one
+* pass over such a block touches no I/O and leaves the CPU exactly as it
+* found it, every further pass is identical, so Run skips whole passes
+* up to the end of its cycle budget (the next event the host has to run)
+* and interprets only the last one. The final state and cycle count are
+* the same as interpreting every pass.
+*
+* Fusion: decoding replaces hot instruction pairs with one op running both
+* (see fusion_6502.hpp). It can be turned off, e.g. to benchmark with and
+* without it, the results are the same either way.
+* */
+namespace m6502
+{
+	struct Block
+	{
+		Word StartPC;
+		s32 Cycles; // Sum of the base cycles of all ops
+		bool IdleCandidate; // Jumps to StartPC and writes no memory
+		std::vector<DecodedOp> Ops;
+	};
+}
+
+struct m6502::BlockCache
+{
+	static constexpr u32 MAX_BLOCK_OPS = 32;
+
+	explicit BlockCache(bool Fusion = true);
+
+	// Block starting at PC, decoded on first use. Empty if PC holds an illegal opcode.
+	const Block& Lookup(Word PC, Mem& memory);
+
+	// True if a page holding cached code has been written
+	bool CodeModified(const Mem& memory) const
+	{
+		u64 Hits = 0;
+		for (u32 i = 0; i < Mem::NUM_PAGES / 64; i++)
+		{
+			Hits |= memory.CodeWrites[i] & CodePages[i];
+		}
+		return Hits != 0;
+	}
+
+	void Flush();
+
+	// Turns instruction fusion on or off, drops the blocks decoded the other way
+	void SetFusion(bool Enabled);
+	bool FusionEnabled() const
+	{
+		return Fusion;
+	}
+
+private:
+	void Invalidate(Mem& memory);
+	const Block& Decode(Word PC, const Mem& memory);
+	static void Fuse(std::vector<DecodedOp>& Ops);
+
+	std::vector<std::unique_ptr<Block>> Blocks; // Indexed by start PC
+	std::vector<Word> PageBlocks[Mem::NUM_PAGES]; // Start PC of every block touching the page
+	u64 CodePages[Mem::NUM_PAGES / 64]; // Pages with cached code
+	bool Fusion;
+};
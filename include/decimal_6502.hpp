@@ -0,0 +1,157 @@
+#pragma once
+
+#include <array>
+#include <main_6502.hpp>
+
+/*
+* ADC and SBC arithmetic.
+*
+* Binary mode is a plain add, SBC adds the inverted operand. Decimal mode
+* results come from tables indexed by carry, A and the operand, filled at
+* static initialisation in decimal_6502.cpp from the reference algorithms
+* below, so decimal mode costs one lookup instead of the nibble fixups.
+* Don't run the CPU from another static initialiser.
+*
+* Decimal mode flags differ between the parts (see Bruce Clark's "Decimal
+* Mode" tutorial, which the reference follows):
+*  - NMOS ADC: C from the decimal result, Z from the binary sum, N and V
+*    from the sum after the low nibble fixup.
+*  - NMOS SBC: every flag is the binary one.
+*  - 65C02: N and Z are valid for the decimal result, C and V as on NMOS.
+*    SBC also fixes up invalid BCD differently.
+* */
+namespace m6502
+{
+	// The result of an ADC or SBC, Flags holds N, V, Z and C in their status positions
+	struct ArithmeticResult
+	{
+		Byte Result;
+		Byte Flags;
+	};
+
+	constexpr u32 DECIMAL_TABLE_SIZE = 2 * 256 * 256;
+
+	constexpr u32 DecimalIndex(Byte A, Byte Operand, Byte Carry)
+	{
+		return (u32(Carry) << 16) | (u32(A) << 8) | Operand;
+	}
+
+	constexpr Byte ArithmeticFlags(bool Carry, bool Overflow, bool Negative, bool Zero)
+	{
+		return Byte((Carry ? CPU::C_FLAG : 0) | (Zero ? CPU::Z_FLAG : 0) |
+			(Overflow ? CPU::V_FLAG : 0) | (Negative ? CPU::N_FLAG : 0));
+	}
+
+	// Sign extends the high nibble of Value, low nibble clear
+	constexpr s32 SignedHighNibble(Byte Value)
+	{
+		return s32((Value & 0xF0) ^ 0x80) - 0x80;
+	}
+
+	// Binary ADC, Carry is 0 or 1
+	constexpr ArithmeticResult BinaryAdd(Byte A, Byte Operand, Byte Carry)
+	{
+		const u32 Sum = u32(A) + Operand + Carry;
+		const Byte Result = Byte(Sum);
+		const bool Overflow = (~(A ^ Operand) & (A ^ Sum) & 0x80) != 0;
+		return { Result, ArithmeticFlags(Sum > 0xFF, Overflow, Result & 0x80, Result == 0) };
+	}
+
+	// Binary SBC, borrows when Carry is 0
+	constexpr ArithmeticResult BinarySubtract(Byte A, Byte Operand, Byte Carry)
+	{
+		return BinaryAdd(A, Byte(~Operand), Carry);
+	}
+
+	// Reference decimal ADC
+	constexpr ArithmeticResult DecimalAdd(bool CMOS, Byte A, Byte Operand, Byte Carry)
+	{
+		s32 Low = (A & 0x0F) + (Operand & 0x0F) + Carry;
+		if (Low >= 0x0A)
+		{
+			Low = ((Low + 0x06) & 0x0F) + 0x10;
+		}
+		// N and V see the sum before the high nibble fixup, as a signed value
+		const s32 Signed = SignedHighNibble(A) + SignedHighNibble(Operand) + Low;
+		s32 Sum = (A & 0xF0) + (Operand & 0xF0) + Low;
+		if (Sum >= 0xA0)
+		{
+			Sum += 0x60;
+		}
+
+		const Byte Result = Byte(Sum);
+		const bool Overflow = Signed < -128 || Signed > 127;
+		if (CMOS)
+		{
+			return { Result, ArithmeticFlags(Sum >= 0x100, Overflow, Result & 0x80, Result == 0) };
+		}
+		const bool Zero = BinaryAdd(A, Operand, Carry).Result == 0;
+		return { Result, ArithmeticFlags(Sum >= 0x100, Overflow, Signed & 0x80, Zero) };
+	}
+
+	// Reference decimal SBC
+	constexpr ArithmeticResult DecimalSubtract(bool CMOS, Byte A, Byte Operand, Byte Carry)
+	{
+		const ArithmeticResult Binary = BinarySubtract(A, Operand, Carry);
+		const s32 Low = (A & 0x0F) - (Operand & 0x0F) + Carry - 1;
+		if (CMOS)
+		{
+			s32 Difference = s32(A) - Operand + Carry - 1;
+			if (Difference < 0)
+			{
+				Difference -= 0x60;
+			}
+			if (Low < 0)
+			{
+				Difference -= 0x06;
+			}
+			const Byte Result = Byte(Difference);
+			const Byte Flags = Byte((Binary.Flags & (CPU::C_FLAG | CPU::V_FLAG)) |
+				(Result == 0 ? CPU::Z_FLAG : 0) | (Result & CPU::N_FLAG));
+			return { Result, Flags };
+		}
+
+		s32 FixedLow = Low;
+		if (FixedLow < 0)
+		{
+			FixedLow = ((FixedLow - 0x06) & 0x0F) - 0x10;
+		}
+		s32 Difference = (A & 0xF0) - (Operand & 0xF0) + FixedLow;
+		if (Difference < 0)
+		{
+			Difference -= 0x60;
+		}
+		return { Byte(Difference), Binary.Flags };
+	}
+
+	extern const std::array<ArithmeticResult, DECIMAL_TABLE_SIZE> NMOSDecimalAdd;
+	extern const std::array<ArithmeticResult, DECIMAL_TABLE_SIZE> NMOSDecimalSubtract;
+	extern const std::array<ArithmeticResult, DECIMAL_TABLE_SIZE> CMOSDecimalAdd;
+	extern const std::array<ArithmeticResult, DECIMAL_TABLE_SIZE> CMOSDecimalSubtract;
+
+	template <typename Variant>
+	const std::array<ArithmeticResult, DECIMAL_TABLE_SIZE>& DecimalAddTable()
+	{
+		if constexpr (Variant::CMOS)
+		{
+			return CMOSDecimalAdd;
+		}
+		else
+		{
+			return NMOSDecimalAdd;
+		}
+	}
+
+	template <typename Variant>
+	const std::array<ArithmeticResult, DECIMAL_TABLE_SIZE>& DecimalSubtractTable()
+	{
+		if constexpr (Variant::CMOS)
+		{
+			return CMOSDecimalSubtract;
+		}
+		else
+		{
+			return NMOSDecimalSubtract;
+		}
+	}
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <instructions_6502.hpp>
+
+/*
+* Superinstructions.
+*
+* When the block cache decodes a block it replaces pairs of instructions
+* that often run back to back with one op running both, saving a dispatch
+* and the checks between them. Pairs are matched once at decode time,
+* running a block never looks at opcodes.
+*
+* A fused pair behaves exactly like the two instructions: PC and cycles
+* are updated per instruction and the second one only starts if the first
+* left cycles in the budget, so a run that ends or is stopped (interrupt,
+* host request) between them still stops with PC on the second one. The
+* first instruction of a pair never writes memory, so it can't rewrite
+* the second one under its feet.
+*
+* The pairs come from counting adjacent opcodes over the M6502Bench
+* workloads, and each one stays only while fusing it measures faster than
+* running it unfused (see M6502_FUSED_PAIRS). A pair is only a line in
+* M6502_FUSED_PAIRS, as long as both opcodes are in the instruction lists.
+* */
+namespace m6502
+{
+	/* Runs First with Op.Operand, then Second with Op.NextOperand */
+	template <typename Variant, Byte First, Byte Second>
+	void RunFused(CPU& cpu, s32& Cycles, Mem& memory, const DecodedOp& Op) noexcept
+	{
+		constexpr const Instruction& FirstIns = VariantOpcodeTable<Variant>[First];
+		constexpr const Instruction& SecondIns = VariantOpcodeTable<Variant>[Second];
+		static_assert(VariantOpcodeSlots<Variant>[First] != 0 && VariantOpcodeSlots<Variant>[Second] != 0,
+			"Fused opcodes must exist on the variant");
+		static_assert(!FirstIns.EndsBlock && !FirstIns.WritesMemory,
+			"The first instruction of a pair can't end the block or write memory");
+
+		cpu.PC += FirstIns.Bytes;
+		Cycles -= FirstIns.Cycles;
+		OperationOf<Variant, First>::Type::Execute(cpu, Cycles, memory, Op.Operand);
+		// Where the run loop would have stopped between the two
+		if (Cycles <= 0)
+		{
+			return;
+		}
+		cpu.PC += SecondIns.Bytes;
+		Cycles -= SecondIns.Cycles;
+		OperationOf<Variant, Second>::Type::Execute(cpu, Cycles, memory, Op.NextOperand);
+	}
+
+	struct FusedPair
+	{
+		Byte First;
+		Byte Second;
+		DecodedHandler Execute;
+	};
+
+/*
+* PAIR(FirstOpcode, SecondOpcode), every opcode listed in M6502_OPCODES
+* so the pairs exist on all variants.
+*
+* Share is the pair's part of the instructions run by the workload it
+* comes from. Speedup is fused over unfused on a block of 16 copies of
+* the pair, median of 61 interleaved runs, Release build:
+*
+*   pair                  workload             share  speedup
+*   LDA zp     STA zp     load_store_loop      48.5%  1.03
+*   LDA zp     JMP abs    idle_polling         50.0%  1.10
+*   LDA #      STA abs    mixed_program         2.5%  1.03
+*   LDA (zp),Y STA abs,Y  mixed_program        10.0%  1.09
+*   LDY zp     STY abs    mixed_program        10.0%  1.05
+*   LDA abs,X  STA zp,X   mixed_program        10.0%  1.08
+*   LDA abs,X  LDA abs,Y  page_crossing_loads  32.0%  1.15
+*   LDA abs,Y  LDA (zp),Y page_crossing_loads  32.0%  1.19
+*   LDA (zp),Y LDA abs,X  page_crossing_loads  28.0%  1.17
+*
+* The whole workloads, same method: page_crossing_loads 1.19,
+* mixed_program 1.05, the others within 1% of unfused. Pairs no workload
+* runs (CLC/ADC, SEC/SBC, LDA abs/STA abs and the like) are left out,
+* they never fire there and only lengthen the search at decode time.
+* Pairing is greedy from the start of a block, so of two overlapping
+* pairs only the first in the code fires: LDY #/LDA (zp),Y and
+* LDX abs,Y/LDA abs,X would take over from the mixed_program load/store
+* pairs above for no measured gain, so they're left out too.
+* */
+#define M6502_FUSED_PAIRS(PAIR) \
+	PAIR(INS_LDA_ZP, INS_STA_ZP) \
+	PAIR(INS_LDA_ZP, INS_JMP_ABS) \
+	PAIR(INS_LDA_IM, INS_STA_ABS) \
+	PAIR(INS_LDA_INDY, INS_STA_ABSY) \
+	PAIR(INS_LDY_ZP, INS_STY_ABS) \
+	PAIR(INS_LDA_ABSX, INS_STA_ZPX) \
+	PAIR(INS_LDA_ABSX, INS_LDA_ABSY) \
+	PAIR(INS_LDA_ABSY, INS_LDA_INDY) \
+	PAIR(INS_LDA_INDY, INS_LDA_ABSX)
+
+#define M6502_FUSED_ENTRY(First, Second) { CPU::First, CPU::Second, &RunFused<Variant, CPU::First, CPU::Second> },
+	template <typename Variant>
+	inline constexpr FusedPair FusedPairs[] = { M6502_FUSED_PAIRS(M6502_FUSED_ENTRY) };
+#undef M6502_FUSED_ENTRY
+
+	// Handler running First and Second as one op, nullptr if the pair isn't fused
+	template <typename Variant>
+	DecodedHandler FindFusedPair(Byte First, Byte Second)
+	{
+		for (const FusedPair& Pair : FusedPairs<Variant>)
+		{
+			if (Pair.First == First && Pair.Second == Second)
+			{
+				return Pair.Execute;
+			}
+		}
+		return nullptr;
+	}
+}
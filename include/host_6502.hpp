@@ -0,0 +1,194 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <pacer_6502.hpp>
+#include <ring_6502.hpp>
+
+/*
+* Threaded host mode.
+*
+* EmulationThread owns a machine and runs it in short time slices on its
+* own thread. The host only talks to it through bounded SPSC rings
+* (ring_6502.hpp) of HostEvents stamped with emulated cycles, so events
+* pass between the threads without a lock:
+*  - Input: the host posts events in cycle order, each one is applied as
+*    a memory write (RAM or a mapped device) once emulation reaches its
+*    cycle. A slice never runs past the next pending event, so an event
+*    lands within one instruction of its cycle, and an event for cycle 0
+*    ("now") waits one slice at most.
+*  - Video and Audio: writes the program makes to the pages mapped to an
+*    output become events stamped with the cycle of the writing
+*    instruction, popped by the UI or encoder thread.
+*
+* Backpressure, what the emulation thread does with an event for a full
+* output ring:
+*  - Drop: counts and discards it, emulation never waits.
+*  - Block: the writing instruction waits until the consumer makes room.
+*  - Stretch: keeps it and ends the slice after the instruction. The next
+*    slice starts once the ring has room, so emulated time stretches
+*    instead of losing output, and input keeps being taken meanwhile.
+*
+* The one lock, WakeLock, is off the data path. When the emulation
+* thread has nothing to do (the program stopped, a slice is stretched or
+* a Block write waits for room) it yields a few times, then sleeps on
+* Wake under WakeLock for growing timeouts. Stop takes the lock to set
+* Stopping, so the sleep can't miss it and ends at once. Pushing and
+* popping events never touch it.
+*
+* With RealTime set, slices come from a Pacer (pacer_6502.hpp) and the
+* machine runs at the Pacing clock instead of as fast as it can.
+* */
+namespace m6502
+{
+	struct HostEvent
+	{
+		u64 Cycle;
+		Word Address;
+		Byte Value;
+	};
+
+	enum class Backpressure : Byte
+	{
+		Drop,
+		Block,
+		Stretch
+	};
+
+	struct HostOutput;
+	struct EmulationThread;
+}
+
+struct m6502::HostOutput
+{
+	HostOutput(u32 Capacity, Backpressure Policy)
+		: Policy(Policy)
+		, Ring(Capacity)
+	{
+	}
+
+	// Consumer side, any one thread
+	bool TryPop(HostEvent& Event)
+	{
+		return Ring.TryPop(Event);
+	}
+
+	// Events thrown away by the Drop policy
+	u64 Dropped() const
+	{
+		return DroppedEvents.load(std::memory_order_relaxed);
+	}
+
+	const Backpressure Policy;
+
+private:
+	friend struct EmulationThread;
+
+	SPSCRing<HostEvent> Ring;
+	std::vector<HostEvent> Overflow; // Held back by Stretch, emulation thread only
+	std::atomic<u64> DroppedEvents{ 0 };
+	EmulationThread* Owner = nullptr;
+};
+
+struct m6502::EmulationThread
+{
+	struct Config
+	{
+		s32 SliceCycles = 1000;
+		u32 InputCapacity = 256;
+		u32 VideoCapacity = 1 << 16;
+		u32 AudioCapacity = 1 << 14;
+		Backpressure VideoPolicy = Backpressure::Drop;
+		Backpressure AudioPolicy = Backpressure::Stretch;
+		bool RealTime = false;
+		PacerConfig Pacing;
+	};
+
+	EmulationThread()
+		: EmulationThread(Config{})
+	{
+	}
+	explicit EmulationThread(const Config& Settings);
+	~EmulationThread();
+
+	EmulationThread(const EmulationThread&) = delete;
+	EmulationThread& operator=(const EmulationThread&) = delete;
+
+	// The machine, only touch it while the thread isn't running
+	CPU cpu;
+	Mem mem;
+
+	HostOutput Video;
+	HostOutput Audio;
+
+	// Routes writes to the pages into the output, call while stopped
+	void MapVideo(Byte FirstPage, u32 NumPages);
+	void MapAudio(Byte FirstPage, u32 NumPages);
+
+	// Emulated time starts again at cycle 0, input not applied yet is dropped
+	void Start();
+	// Stops after the current slice, also releases a Block wait
+	void Stop();
+
+	bool IsRunning() const
+	{
+		return Thread.joinable();
+	}
+
+	// Host side, false when the input ring is full
+	bool PostInput(const HostEvent& Event)
+	{
+		return Input.TryPush(Event);
+	}
+
+	// Emulated cycles since Start, published after every slice
+	u64 Cycle() const
+	{
+		return PublishedCycle.load(std::memory_order_acquire);
+	}
+
+	// Why the program stopped (JAM, illegal opcode), CyclesExhausted while it runs
+	StopReason ProgramStop() const
+	{
+		return ProgramStopped.load(std::memory_order_acquire);
+	}
+
+	// Pacing since the last Start, read it while the thread isn't running
+	PacerMetrics PacingMetrics() const
+	{
+		return Pace.Metrics();
+	}
+
+private:
+	static Byte ReadOutput(void* Context, Word Address);
+	static void WriteOutput(void* Context, Word Address, Byte Value);
+
+	void MapOutput(HostOutput& Output, Byte FirstPage, u32 NumPages);
+	void Emit(HostOutput& Output, const HostEvent& Event);
+	bool FlushOverflow(HostOutput& Output);
+	// Takes posted input and applies what is due, returns the cycle of the next pending event
+	u64 ApplyInput();
+	// Waits longer the more Rounds in a row had nothing to do, Stop cuts it short
+	void Idle(u32& Rounds);
+	void Loop();
+
+	const s32 SliceCycles;
+	const bool RealTime;
+	SPSCRing<HostEvent> Input;
+	std::thread Thread;
+	std::atomic<bool> Stopping{ false };
+	std::mutex WakeLock;
+	std::condition_variable Wake;
+	std::atomic<u64> PublishedCycle{ 0 };
+	std::atomic<StopReason> ProgramStopped{ StopReason::CyclesExhausted };
+
+	/* Emulation thread only */
+	std::vector<HostEvent> Pending; // Posted input not due yet, in cycle order
+	size_t PendingHead = 0;
+	u64 Now = 0; // Cycle the current slice started at
+	s32 SliceRequested = 0;
+	Pacer Pace;
+};
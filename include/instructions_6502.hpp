@@ -0,0 +1,648 @@
+#pragma once
+
+#include <array>
+#include <decimal_6502.hpp>
+#include <main_6502.hpp>
+
+/*
+* Threaded dispatch (labels as values) is only available on GCC and Clang,
+* other compilers always use the portable loop.
+* */
+#if defined(M6502_THREADED_DISPATCH) && (defined(__GNUC__) || defined(__clang__))
+#define M6502_USE_THREADED_DISPATCH 1
+#else
+#define M6502_USE_THREADED_DISPATCH 0
+#endif
+
+/*
+* Opcode dispatch table.
+*
+* Every opcode is an operation (Load, Store, ...) combined with an
+* addressing mode and, where it applies, the register it works on.
+* The operations are templates so each table entry is a fully specialised
+* handler, e.g. Load<&CPU::A, Addr::AbsoluteX>.
+* */
+namespace m6502
+{
+	struct DecodedOp;
+
+	// Fetches its own operand from PC
+	using Handler = void (*)(CPU& cpu, s32& Cycles, Mem& memory) noexcept;
+	// Runs an instruction decoded ahead of time, advances PC and takes the base cycles itself
+	using DecodedHandler = void (*)(CPU& cpu, s32& Cycles, Mem& memory, const DecodedOp& Op) noexcept;
+	// Reads the operand of the instruction stored at Address
+	using OperandDecoder = Word (*)(const Mem& memory, Word Address);
+
+	struct Instruction
+	{
+		Handler Execute;
+		DecodedHandler ExecuteDecoded;
+		OperandDecoder DecodeOperand;
+		Byte Cycles; // Base cycle count, handlers add page crossing and decimal mode cycles
+		Byte Bytes; // Opcode and operand
+		bool EndsBlock; // Changes PC, decoding has to stop after it
+		bool WritesMemory;
+	};
+
+	/*
+	* An instruction as the block cache stores it. A fused op runs this
+	* instruction and the next one in one dispatch (see fusion_6502.hpp),
+	* Bytes and Cycles then cover both and NextOperand is the second one's.
+	* */
+	struct DecodedOp
+	{
+		DecodedHandler Execute;
+		Word Operand;
+		Word NextOperand;
+		Byte Opcode; // Of the first instruction
+		Byte Bytes;
+		Byte Cycles;
+		bool WritesMemory;
+	};
+
+	// True when Base and Effective are on different pages
+	constexpr bool PageCrossed(Word Base, Word Effective)
+	{
+		return (Base ^ Effective) & 0xFF00;
+	}
+
+	/*
+	* Addressing modes are split in two steps so the operand can be decoded
+	* once and resolved every time the instruction runs:
+	*  - Operand reads the raw operand bytes stored at Address.
+	*  - Resolve turns it into the effective address with the current
+	*    registers. PageCrossCycle selects whether crossing a page costs an
+	*    extra cycle, which is the case for reads but not for writes.
+	* */
+	namespace Addr
+	{
+		struct Implied
+		{
+			static constexpr Byte Bytes = 0;
+
+			static Word Operand(const Mem&, Word)
+			{
+				return 0;
+			}
+
+			template <bool PageCrossCycle>
+			static Word Resolve(const CPU&, Word, s32&, const Mem&)
+			{
+				return 0;
+			}
+		};
+
+		struct Immediate
+		{
+			static constexpr Byte Bytes = 1;
+
+			static Word Operand(const Mem&, Word Address)
+			{
+				return Address;
+			}
+
+			template <bool PageCrossCycle>
+			static Word Resolve(const CPU&, Word Operand, s32&, const Mem&)
+			{
+				return Operand;
+			}
+		};
+
+		struct ZeroPage
+		{
+			static constexpr Byte Bytes = 1;
+
+			static Word Operand(const Mem& memory, Word Address)
+			{
+				return memory[Address];
+			}
+
+			template <bool PageCrossCycle>
+			static Word Resolve(const CPU&, Word Operand, s32&, const Mem&)
+			{
+				return Operand;
+			}
+		};
+
+		template <Byte CPU::*Index>
+		struct ZeroPageIndexed : ZeroPage
+		{
+			template <bool PageCrossCycle>
+			static Word Resolve(const CPU& cpu, Word Operand, s32&, const Mem&)
+			{
+				Byte ZPageAddr = Byte(Operand);
+				ZPageAddr += cpu.*Index; // Wraps around within the zero page
+				return ZPageAddr;
+			}
+		};
+
+		struct Absolute
+		{
+			static constexpr Byte Bytes = 2;
+
+			static Word Operand(const Mem& memory, Word Address)
+			{
+				Word AbsAddr = memory[Address];
+				AbsAddr |= memory[Word(Address + 1)] << 8;
+				return AbsAddr;
+			}
+
+			template <bool PageCrossCycle>
+			static Word Resolve(const CPU&, Word Operand, s32&, const Mem&)
+			{
+				return Operand;
+			}
+		};
+
+		template <Byte CPU::*Index>
+		struct AbsoluteIndexed : Absolute
+		{
+			template <bool PageCrossCycle>
+			static Word Resolve(const CPU& cpu, Word Operand, s32& Cycles, const Mem&)
+			{
+				const Word EffectiveAddr = Operand + cpu.*Index;
+				if (PageCrossCycle && PageCrossed(Operand, EffectiveAddr))
+				{
+					Cycles--;
+				}
+				return EffectiveAddr;
+			}
+		};
+
+		struct IndirectX : ZeroPage
+		{
+			template <bool PageCrossCycle>
+			static Word Resolve(const CPU& cpu, Word Operand, s32&, const Mem& memory)
+			{
+				Byte ZPageAddr = Byte(Operand);
+				ZPageAddr += cpu.X;
+				Word EffectiveAddr = cpu.ReadByte(ZPageAddr, memory);
+				EffectiveAddr |= cpu.ReadByte(Byte(ZPageAddr + 1), memory) << 8;
+				return EffectiveAddr;
+			}
+		};
+
+		struct IndirectY : ZeroPage
+		{
+			template <bool PageCrossCycle>
+			static Word Resolve(const CPU& cpu, Word Operand, s32& Cycles, const Mem& memory)
+			{
+				const Byte ZPageAddr = Byte(Operand);
+				Word BaseAddr = cpu.ReadByte(ZPageAddr, memory);
+				BaseAddr |= cpu.ReadByte(Byte(ZPageAddr + 1), memory) << 8;
+				const Word EffectiveAddr = BaseAddr + cpu.Y;
+				if (PageCrossCycle && PageCrossed(BaseAddr, EffectiveAddr))
+				{
+					Cycles--;
+				}
+				return EffectiveAddr;
+			}
+		};
+
+		// (zp), 65C02
+		struct ZeroPageIndirect : ZeroPage
+		{
+			template <bool PageCrossCycle>
+			static Word Resolve(const CPU& cpu, Word Operand, s32&, const Mem& memory)
+			{
+				const Byte ZPageAddr = Byte(Operand);
+				Word EffectiveAddr = cpu.ReadByte(ZPageAddr, memory);
+				EffectiveAddr |= cpu.ReadByte(Byte(ZPageAddr + 1), memory) << 8;
+				return EffectiveAddr;
+			}
+		};
+
+		using ZeroPageX = ZeroPageIndexed<&CPU::X>;
+		using ZeroPageY = ZeroPageIndexed<&CPU::Y>;
+		using AbsoluteX = AbsoluteIndexed<&CPU::X>;
+		using AbsoluteY = AbsoluteIndexed<&CPU::Y>;
+	}
+
+	/*
+	* Operations name their addressing mode and run with an operand that
+	* has already been read from the instruction stream.
+	* */
+
+	/* Loads a register with the value from the memory address */
+	template <Byte CPU::*Register, typename Mode>
+	struct Load
+	{
+		using AddressMode = Mode;
+		static constexpr bool EndsBlock = false;
+		static constexpr bool WritesMemory = false;
+
+		static void Execute(CPU& cpu, s32& Cycles, Mem& memory, Word Operand) noexcept
+		{
+			const Word Address = Mode::template Resolve<true>(cpu, Operand, Cycles, memory);
+			cpu.*Register = cpu.ReadByte(Address, memory);
+			cpu.LoadRegisterSetStatus(cpu.*Register);
+		}
+	};
+
+	/* Stores a register at the memory address, no flags are affected */
+	template <Byte CPU::*Register, typename Mode>
+	struct Store
+	{
+		using AddressMode = Mode;
+		static constexpr bool EndsBlock = false;
+		static constexpr bool WritesMemory = true;
+
+		static void Execute(CPU& cpu, s32& Cycles, Mem& memory, Word Operand) noexcept
+		{
+			const Word Address = Mode::template Resolve<false>(cpu, Operand, Cycles, memory);
+			cpu.WriteByte(Address, cpu.*Register, memory);
+		}
+	};
+
+	/*
+	* ADC and SBC (see decimal_6502.hpp). In decimal mode the result and
+	* flags are one table lookup, the 65C02 spends a cycle more on it.
+	* The 2A03 has no decimal mode and ignores D.
+	* */
+	template <typename Variant, bool Subtract, typename Mode>
+	struct Arithmetic
+	{
+		using AddressMode = Mode;
+		static constexpr bool EndsBlock = false;
+		static constexpr bool WritesMemory = false;
+
+		static void Execute(CPU& cpu, s32& Cycles, Mem& memory, Word Operand) noexcept
+		{
+			const Word Address = Mode::template Resolve<true>(cpu, Operand, Cycles, memory);
+			const Byte Value = cpu.ReadByte(Address, memory);
+			const Byte Carry = cpu.P & CPU::C_FLAG;
+			ArithmeticResult Result;
+			if constexpr (Variant::DecimalMode)
+			{
+				if (cpu.P & CPU::D_FLAG)
+				{
+					const auto& Table = Subtract ? DecimalSubtractTable<Variant>() : DecimalAddTable<Variant>();
+					Result = Table[DecimalIndex(cpu.A, Value, Carry)];
+					if constexpr (Variant::CMOS)
+					{
+						Cycles--;
+					}
+					cpu.A = Result.Result;
+					cpu.SetArithmeticFlags(Result.Flags);
+					return;
+				}
+			}
+			Result = Subtract ? BinarySubtract(cpu.A, Value, Carry) : BinaryAdd(cpu.A, Value, Carry);
+			cpu.A = Result.Result;
+			cpu.SetArithmeticFlags(Result.Flags);
+		}
+	};
+
+	/* CLC, SEC, CLD and SED */
+	template <Byte Flag, bool Value>
+	struct ChangeFlag
+	{
+		using AddressMode = Addr::Implied;
+		static constexpr bool EndsBlock = false;
+		static constexpr bool WritesMemory = false;
+
+		static void Execute(CPU& cpu, s32&, Mem&, Word) noexcept
+		{
+			cpu.P = Value ? Byte(cpu.P | Flag) : Byte(cpu.P & ~Flag);
+		}
+	};
+
+	template <typename Variant, typename Mode>
+	using AddWithCarry = Arithmetic<Variant, false, Mode>;
+	template <typename Variant, typename Mode>
+	using SubtractWithCarry = Arithmetic<Variant, true, Mode>;
+
+	/* Stores zero at the memory address, 65C02 */
+	template <typename Mode>
+	struct StoreZero
+	{
+		using AddressMode = Mode;
+		static constexpr bool EndsBlock = false;
+		static constexpr bool WritesMemory = true;
+
+		static void Execute(CPU& cpu, s32& Cycles, Mem& memory, Word Operand) noexcept
+		{
+			const Word Address = Mode::template Resolve<false>(cpu, Operand, Cycles, memory);
+			cpu.WriteByte(Address, 0, memory);
+		}
+	};
+
+	struct JumpToSubroutine
+	{
+		using AddressMode = Addr::Absolute;
+		static constexpr bool EndsBlock = true;
+		static constexpr bool WritesMemory = true;
+
+		static void Execute(CPU& cpu, s32& Cycles, Mem& memory, Word Operand) noexcept;
+	};
+
+	/* Pulls the return address pushed by JSR */
+	struct ReturnFromSubroutine
+	{
+		using AddressMode = Addr::Implied;
+		static constexpr bool EndsBlock = true;
+		static constexpr bool WritesMemory = false;
+
+		static void Execute(CPU& cpu, s32&, Mem& memory, Word) noexcept
+		{
+			cpu.PC = Word(cpu.PopWord(memory) + 1);
+		}
+	};
+
+	struct Jump
+	{
+		using AddressMode = Addr::Absolute;
+		static constexpr bool EndsBlock = true;
+		static constexpr bool WritesMemory = false;
+
+		static void Execute(CPU& cpu, s32&, Mem&, Word Operand) noexcept
+		{
+			cpu.PC = Operand;
+		}
+	};
+
+	/*
+	* JMP (abs). The NMOS 6502 reads the high byte of the target from the
+	* start of the pointer's page when the pointer is at $xxFF, the 65C02
+	* reads across the page.
+	* */
+	template <typename Variant>
+	struct JumpIndirect
+	{
+		using AddressMode = Addr::Absolute;
+		static constexpr bool EndsBlock = true;
+		static constexpr bool WritesMemory = false;
+
+		static void Execute(CPU& cpu, s32&, Mem& memory, Word Pointer) noexcept
+		{
+			Word High = Word(Pointer + 1);
+			if constexpr (!Variant::CMOS)
+			{
+				High = Word((Pointer & 0xFF00) | (High & 0x00FF));
+			}
+			cpu.PC = Word(cpu.ReadByte(Pointer, memory) | (cpu.ReadByte(High, memory) << 8));
+		}
+	};
+
+	/* JMP (abs,X), 65C02 */
+	struct JumpIndexedIndirect
+	{
+		using AddressMode = Addr::Absolute;
+		static constexpr bool EndsBlock = true;
+		static constexpr bool WritesMemory = false;
+
+		static void Execute(CPU& cpu, s32&, Mem& memory, Word Operand) noexcept
+		{
+			cpu.PC = cpu.ReadWord(Word(Operand + cpu.X), memory);
+		}
+	};
+
+	/*
+	* BRK is a software interrupt: pushes the address after its padding
+	* byte and the status with B set, then jumps through the IRQ vector.
+	* */
+	template <typename Variant>
+	struct Break
+	{
+		using AddressMode = Addr::Immediate; // Skips the padding byte
+		static constexpr bool EndsBlock = true;
+		static constexpr bool WritesMemory = true;
+
+		static void Execute(CPU& cpu, s32&, Mem& memory, Word) noexcept
+		{
+			cpu.EnterInterrupt<Variant>(CPU::IRQ_VECTOR, Byte(cpu.GetStatus() | CPU::B_FLAG), memory);
+		}
+	};
+
+	/* Pulls the status and PC pushed by an interrupt or BRK */
+	struct ReturnFromInterrupt
+	{
+		using AddressMode = Addr::Implied;
+		static constexpr bool EndsBlock = true;
+		static constexpr bool WritesMemory = false;
+
+		static void Execute(CPU& cpu, s32&, Mem& memory, Word) noexcept
+		{
+			cpu.SetStatus(Byte(cpu.PopByte(memory) & ~CPU::B_FLAG));
+			cpu.PC = cpu.PopWord(memory);
+			// Clearing I may let an asserted IRQ in
+			cpu.PollInterrupts();
+		}
+	};
+
+	/*
+	* JAM locks up an NMOS 6502, here it halts the run with PC left on the
+	* JAM opcode. Costs no cycles since it never completes.
+	* */
+	struct Jam
+	{
+		using AddressMode = Addr::Implied;
+		static constexpr bool EndsBlock = true;
+		static constexpr bool WritesMemory = false;
+
+		static void Execute(CPU& cpu, s32& Cycles, Mem&, Word) noexcept
+		{
+			cpu.PC--;
+			cpu.RequestStop(StopReason::Halt, CPU::INS_JAM, Cycles);
+		}
+	};
+
+	/* Reads the operand at PC, then runs the operation */
+	template <typename Operation>
+	void Interpret(CPU& cpu, s32& Cycles, Mem& memory) noexcept
+	{
+		using Mode = typename Operation::AddressMode;
+		const Word Operand = Mode::Operand(memory, cpu.PC);
+		cpu.PC += Mode::Bytes;
+		Operation::Execute(cpu, Cycles, memory, Operand);
+	}
+
+	/* Runs the operation with the operand the block cache decoded */
+	template <typename Operation>
+	void RunDecoded(CPU& cpu, s32& Cycles, Mem& memory, const DecodedOp& Op) noexcept
+	{
+		cpu.PC += Op.Bytes;
+		Cycles -= Op.Cycles;
+		Operation::Execute(cpu, Cycles, memory, Op.Operand);
+	}
+
+	// Stops the run with StopReason::IllegalOpcode, PC on the opcode
+	void IllegalOpcode(CPU& cpu, s32& Cycles, Mem& memory) noexcept;
+
+	template <typename Operation>
+	constexpr Instruction MakeInstruction(Byte Cycles)
+	{
+		using Mode = typename Operation::AddressMode;
+		return { &Interpret<Operation>, &RunDecoded<Operation>, &Mode::Operand, Cycles,
+			Byte(1 + Mode::Bytes), Operation::EndsBlock, Operation::WritesMemory };
+	}
+
+/*
+* The instruction set: INSTRUCTION(Opcode, BaseCycles, Operation).
+* Both the dispatch table and the threaded interpreter are generated
+* from these lists, so new instructions only have to be added here.
+* The operation is the last (variadic) argument so template argument
+* commas pass through the macro untouched.
+*
+* M6502_OPCODES is shared by every variant, M6502_NMOS_OPCODES and
+* M6502_CMOS_OPCODES only exist on the NMOS (6502, 2A03) and CMOS (65C02)
+* parts. Entries may use Variant, the variant the table is built for.
+* */
+#define M6502_OPCODES(INSTRUCTION) \
+	INSTRUCTION(INS_BRK, 7, Break<Variant>) \
+	INSTRUCTION(INS_RTI, 6, ReturnFromInterrupt) \
+	INSTRUCTION(INS_JSR, 6, JumpToSubroutine) \
+	INSTRUCTION(INS_RTS, 6, ReturnFromSubroutine) \
+	INSTRUCTION(INS_JMP_ABS, 3, Jump) \
+	INSTRUCTION(INS_JMP_IND, Variant::CMOS ? 6 : 5, JumpIndirect<Variant>) \
+	/* Load Register Instructions */ \
+	INSTRUCTION(INS_LDA_IM, 2, Load<&CPU::A, Addr::Immediate>) \
+	INSTRUCTION(INS_LDA_ZP, 3, Load<&CPU::A, Addr::ZeroPage>) \
+	INSTRUCTION(INS_LDA_ZPX, 4, Load<&CPU::A, Addr::ZeroPageX>) \
+	INSTRUCTION(INS_LDA_ABS, 4, Load<&CPU::A, Addr::Absolute>) \
+	INSTRUCTION(INS_LDA_ABSX, 4, Load<&CPU::A, Addr::AbsoluteX>) \
+	INSTRUCTION(INS_LDA_ABSY, 4, Load<&CPU::A, Addr::AbsoluteY>) \
+	INSTRUCTION(INS_LDA_INDX, 6, Load<&CPU::A, Addr::IndirectX>) \
+	INSTRUCTION(INS_LDA_INDY, 5, Load<&CPU::A, Addr::IndirectY>) \
+	INSTRUCTION(INS_LDX_IM, 2, Load<&CPU::X, Addr::Immediate>) \
+	INSTRUCTION(INS_LDX_ZP, 3, Load<&CPU::X, Addr::ZeroPage>) \
+	INSTRUCTION(INS_LDX_ZPY, 4, Load<&CPU::X, Addr::ZeroPageY>) \
+	INSTRUCTION(INS_LDX_ABS, 4, Load<&CPU::X, Addr::Absolute>) \
+	INSTRUCTION(INS_LDX_ABSY, 4, Load<&CPU::X, Addr::AbsoluteY>) \
+	INSTRUCTION(INS_LDY_IM, 2, Load<&CPU::Y, Addr::Immediate>) \
+	INSTRUCTION(INS_LDY_ZP, 3, Load<&CPU::Y, Addr::ZeroPage>) \
+	INSTRUCTION(INS_LDY_ZPX, 4, Load<&CPU::Y, Addr::ZeroPageX>) \
+	INSTRUCTION(INS_LDY_ABS, 4, Load<&CPU::Y, Addr::Absolute>) \
+	INSTRUCTION(INS_LDY_ABSX, 4, Load<&CPU::Y, Addr::AbsoluteX>) \
+	/* Arithmetic Instructions */ \
+	INSTRUCTION(INS_ADC_IM, 2, AddWithCarry<Variant, Addr::Immediate>) \
+	INSTRUCTION(INS_ADC_ZP, 3, AddWithCarry<Variant, Addr::ZeroPage>) \
+	INSTRUCTION(INS_ADC_ZPX, 4, AddWithCarry<Variant, Addr::ZeroPageX>) \
+	INSTRUCTION(INS_ADC_ABS, 4, AddWithCarry<Variant, Addr::Absolute>) \
+	INSTRUCTION(INS_ADC_ABSX, 4, AddWithCarry<Variant, Addr::AbsoluteX>) \
+	INSTRUCTION(INS_ADC_ABSY, 4, AddWithCarry<Variant, Addr::AbsoluteY>) \
+	INSTRUCTION(INS_ADC_INDX, 6, AddWithCarry<Variant, Addr::IndirectX>) \
+	INSTRUCTION(INS_ADC_INDY, 5, AddWithCarry<Variant, Addr::IndirectY>) \
+	INSTRUCTION(INS_SBC_IM, 2, SubtractWithCarry<Variant, Addr::Immediate>) \
+	INSTRUCTION(INS_SBC_ZP, 3, SubtractWithCarry<Variant, Addr::ZeroPage>) \
+	INSTRUCTION(INS_SBC_ZPX, 4, SubtractWithCarry<Variant, Addr::ZeroPageX>) \
+	INSTRUCTION(INS_SBC_ABS, 4, SubtractWithCarry<Variant, Addr::Absolute>) \
+	INSTRUCTION(INS_SBC_ABSX, 4, SubtractWithCarry<Variant, Addr::AbsoluteX>) \
+	INSTRUCTION(INS_SBC_ABSY, 4, SubtractWithCarry<Variant, Addr::AbsoluteY>) \
+	INSTRUCTION(INS_SBC_INDX, 6, SubtractWithCarry<Variant, Addr::IndirectX>) \
+	INSTRUCTION(INS_SBC_INDY, 5, SubtractWithCarry<Variant, Addr::IndirectY>) \
+	/* Flag Instructions */ \
+	INSTRUCTION(INS_CLC, 2, ChangeFlag<CPU::C_FLAG, false>) \
+	INSTRUCTION(INS_SEC, 2, ChangeFlag<CPU::C_FLAG, true>) \
+	INSTRUCTION(INS_CLD, 2, ChangeFlag<CPU::D_FLAG, false>) \
+	INSTRUCTION(INS_SED, 2, ChangeFlag<CPU::D_FLAG, true>) \
+	/* Store Register Instructions */ \
+	INSTRUCTION(INS_STA_ZP, 3, Store<&CPU::A, Addr::ZeroPage>) \
+	INSTRUCTION(INS_STA_ZPX, 4, Store<&CPU::A, Addr::ZeroPageX>) \
+	INSTRUCTION(INS_STA_ABS, 4, Store<&CPU::A, Addr::Absolute>) \
+	INSTRUCTION(INS_STA_ABSX, 5, Store<&CPU::A, Addr::AbsoluteX>) \
+	INSTRUCTION(INS_STA_ABSY, 5, Store<&CPU::A, Addr::AbsoluteY>) \
+	INSTRUCTION(INS_STA_INDX, 6, Store<&CPU::A, Addr::IndirectX>) \
+	INSTRUCTION(INS_STA_INDY, 6, Store<&CPU::A, Addr::IndirectY>) \
+	INSTRUCTION(INS_STX_ZP, 3, Store<&CPU::X, Addr::ZeroPage>) \
+	INSTRUCTION(INS_STX_ABS, 4, Store<&CPU::X, Addr::Absolute>) \
+	INSTRUCTION(INS_STY_ZP, 3, Store<&CPU::Y, Addr::ZeroPage>) \
+	INSTRUCTION(INS_STY_ZPX, 4, Store<&CPU::Y, Addr::ZeroPageX>) \
+	INSTRUCTION(INS_STY_ABS, 4, Store<&CPU::Y, Addr::Absolute>)
+
+#define M6502_NMOS_OPCODES(INSTRUCTION) \
+	INSTRUCTION(INS_JAM, 0, Jam)
+
+#define M6502_CMOS_OPCODES(INSTRUCTION) \
+	INSTRUCTION(INS_JMP_ABSX, 6, JumpIndexedIndirect) \
+	INSTRUCTION(INS_LDA_ZPI, 5, Load<&CPU::A, Addr::ZeroPageIndirect>) \
+	INSTRUCTION(INS_STA_ZPI, 5, Store<&CPU::A, Addr::ZeroPageIndirect>) \
+	INSTRUCTION(INS_ADC_ZPI, 5, AddWithCarry<Variant, Addr::ZeroPageIndirect>) \
+	INSTRUCTION(INS_SBC_ZPI, 5, SubtractWithCarry<Variant, Addr::ZeroPageIndirect>) \
+	INSTRUCTION(INS_STZ_ZP, 3, StoreZero<Addr::ZeroPage>) \
+	INSTRUCTION(INS_STZ_ZPX, 4, StoreZero<Addr::ZeroPageX>) \
+	INSTRUCTION(INS_STZ_ABS, 4, StoreZero<Addr::Absolute>) \
+	INSTRUCTION(INS_STZ_ABSX, 5, StoreZero<Addr::AbsoluteX>)
+
+	template <typename Variant>
+	constexpr std::array<Instruction, 256> MakeOpcodeTable()
+	{
+		std::array<Instruction, 256> Table{};
+		for (Instruction& Entry : Table)
+		{
+			Entry = { &IllegalOpcode, nullptr, nullptr, 0, 1, true, false };
+		}
+
+#define M6502_TABLE_ENTRY(Opcode, Cycles, ...) Table[CPU::Opcode] = MakeInstruction<__VA_ARGS__>(Cycles);
+		M6502_OPCODES(M6502_TABLE_ENTRY)
+		if constexpr (Variant::CMOS)
+		{
+			M6502_CMOS_OPCODES(M6502_TABLE_ENTRY)
+		}
+		else
+		{
+			M6502_NMOS_OPCODES(M6502_TABLE_ENTRY)
+		}
+#undef M6502_TABLE_ENTRY
+
+		return Table;
+	}
+
+	/*
+	* Position of every opcode in M6502_OPCODES, M6502_NMOS_OPCODES and
+	* M6502_CMOS_OPCODES in that order, counting from 1. Slot 0 is the
+	* illegal opcode handler, used by the threaded dispatch to index its
+	* label table. Opcodes the variant doesn't have keep slot 0.
+	* */
+	template <typename Variant>
+	constexpr std::array<Byte, 256> MakeOpcodeSlots()
+	{
+		std::array<Byte, 256> Slots{};
+		Byte Slot = 0;
+
+#define M6502_SLOT_ENTRY(Opcode, Cycles, ...) Slots[CPU::Opcode] = ++Slot;
+#define M6502_SKIP_ENTRY(Opcode, Cycles, ...) ++Slot;
+		M6502_OPCODES(M6502_SLOT_ENTRY)
+		if constexpr (Variant::CMOS)
+		{
+			M6502_NMOS_OPCODES(M6502_SKIP_ENTRY)
+			M6502_CMOS_OPCODES(M6502_SLOT_ENTRY)
+		}
+		else
+		{
+			M6502_NMOS_OPCODES(M6502_SLOT_ENTRY)
+			M6502_CMOS_OPCODES(M6502_SKIP_ENTRY)
+		}
+#undef M6502_SKIP_ENTRY
+#undef M6502_SLOT_ENTRY
+
+		return Slots;
+	}
+
+	template <typename Variant>
+	inline constexpr std::array<Instruction, 256> VariantOpcodeTable = MakeOpcodeTable<Variant>();
+	template <typename Variant>
+	inline constexpr std::array<Byte, 256> VariantOpcodeSlots = MakeOpcodeSlots<Variant>();
+
+	/*
+	* The operation behind an opcode, for handlers that run several
+	* instructions (see fusion_6502.hpp). Defined for every listed opcode
+	* whether or not the variant has it, check the table for that.
+	* */
+	template <typename Variant, Byte Opcode>
+	struct OperationOf;
+
+#define M6502_OPERATION_OF(Opcode, Cycles, ...) \
+	template <typename Variant> \
+	struct OperationOf<Variant, CPU::Opcode> \
+	{ \
+		using Type = __VA_ARGS__; \
+	};
+	M6502_OPCODES(M6502_OPERATION_OF)
+	M6502_NMOS_OPCODES(M6502_OPERATION_OF)
+	M6502_CMOS_OPCODES(M6502_OPERATION_OF)
+#undef M6502_OPERATION_OF
+
+	// The NMOS 6502 table, what CPU, the block cache and batches run
+	inline constexpr const std::array<Instruction, 256>& OpcodeTable = VariantOpcodeTable<NMOS6502>;
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <vector>
+#include <mappedfile_6502.hpp>
+
+/*
+* Program image loader.
+*
+* ProgramImage maps a file (mappedfile_6502.hpp) and splits it into
+* segments that point straight into the mapping, nothing is read until a
+* segment is loaded:
+*  - Raw: the whole file, loaded at the address given to Open.
+*  - PRG: Commodore program, a little endian load address and the data.
+*  - Segments: Atari style binary, an $FFFF marker and then blocks of first
+*    address, last address (inclusive, little endian) and data. Further
+*    $FFFF markers between blocks are skipped. A block covering $02E0-$02E1
+*    (RUNAD) gives the entry point.
+*
+* LoadRAM copies every segment into RAM with a copy per page. MapROM maps
+* the segments as ROM pages reading from the file itself; a trailing part
+* page is padded into a copy owned by the image. Mapped pages keep
+* pointing into the image, so it has to outlive the Mem (or its mapping).
+*
+* CPU::Reset clears RAM and starts at RESET_VECTOR, so load after Reset
+* and Boot to start at the entry point. A ROM image that covers the reset
+* vector survives Reset.
+* */
+namespace m6502
+{
+	enum class ImageFormat : Byte
+	{
+		Raw,
+		PRG,
+		Segments
+	};
+
+	struct ImageSegment
+	{
+		Word LoadAddress;
+		u32 Size;
+		const Byte* Data;
+	};
+
+	struct ProgramImage;
+}
+
+struct m6502::ProgramImage
+{
+	static constexpr Word RUNAD = 0x02E0;
+
+	ProgramImage() = default;
+
+	ProgramImage(const ProgramImage&) = delete;
+	ProgramImage& operator=(const ProgramImage&) = delete;
+
+	// False when the file can't be opened or isn't a valid image. LoadAddress is for Raw images
+	bool Open(const char* Path, ImageFormat Format, Word LoadAddress = 0x0200);
+	// Same as Open for an image already in memory, Data has to outlive the image
+	bool Parse(const Byte* Data, u64 Size, ImageFormat Format, Word LoadAddress = 0x0200);
+	void Close();
+
+	bool IsOpen() const
+	{
+		return !SegmentList.empty();
+	}
+
+	const std::vector<ImageSegment>& Segments() const
+	{
+		return SegmentList;
+	}
+
+	// RUNAD for Segments images that set it, otherwise where the first segment loads
+	Word Entry() const
+	{
+		return EntryPoint;
+	}
+
+	// Bytes the segments hold
+	u64 Size() const;
+
+	void LoadRAM(Mem& memory) const;
+	// False, with nothing mapped, unless every segment starts on a page
+	bool MapROM(Mem& memory) const;
+
+	// Starts the CPU at the entry point
+	void Boot(CPU& cpu) const
+	{
+		cpu.PC = EntryPoint;
+	}
+
+private:
+	bool ParseSegments(const Byte* Data, u64 Size);
+
+	MappedFile File;
+	std::vector<ImageSegment> SegmentList;
+	// Last part page of every segment, zero padded, for MapROM
+	std::vector<Byte> Tails;
+	Word EntryPoint = 0;
+};
@@ -1,5 +1,8 @@
+#pragma once
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <atomic>
 
 // Needs to be accessed by both CPU and memory
 namespace m6502
@@ -9,42 +12,280 @@ namespace m6502
 
 	using u32 = unsigned int;
 	using s32 = signed int;
+	using u64 = unsigned long long;
+	using s64 = signed long long;
 
 	struct Mem;
 	struct CPU;
+	struct BlockCache;
+	struct RunControl;
+
+	/*
+	* CPU variants, picked at compile time (see VariantCPU):
+	*  - NMOS6502: the original. JMP ($xxFF) doesn't carry into the high
+	*    byte of the pointer and the JAM opcodes lock up the CPU.
+	*  - CMOS65C02: adds the (zp) addressing mode, STZ and JMP (abs,X),
+	*    fixes JMP indirect at the cost of a cycle and clears D when taking
+	*    an interrupt.
+	*  - Ricoh2A03: the NES CPU, an NMOS 6502 without decimal mode.
+	* */
+	struct NMOS6502
+	{
+		static constexpr bool CMOS = false;
+		static constexpr bool DecimalMode = true;
+	};
+
+	struct CMOS65C02
+	{
+		static constexpr bool CMOS = true;
+		static constexpr bool DecimalMode = true;
+	};
+
+	struct Ricoh2A03
+	{
+		static constexpr bool CMOS = false;
+		static constexpr bool DecimalMode = false;
+	};
+
+	template <typename Variant>
+	struct VariantCPU;
+
+	// Why CPU::Run returned
+	enum class StopReason : Byte
+	{
+		CyclesExhausted,
+		IllegalOpcode, // PC and Opcode point at the offending instruction
+		Breakpoint, // PC is on a breakpoint, the instruction has not run
+		Halt, // JAM, PC is on the JAM opcode
+		HostRequest // RunControl::RequestStop
+	};
+
+	struct RunResult
+	{
+		StopReason Reason;
+		s32 CyclesUsed;
+		Word PC;
+		Byte Opcode; // For IllegalOpcode and Halt
+	};
 }
 
+/*
+* 64KB address space seen through a 256 entry page table.
+*
+* Each page reads and writes either straight from host memory (RAM, ROM)
+* or through a registered I/O handler. RAM sits behind every page. ROM
+* pages read from the ROM image and write to the RAM underneath, so the
+* ROM itself is never modified (like the C64).
+* The non-const operator[] always pokes RAM, whatever the page maps to.
+*
+* RAM is made of reference counted pages that are copied on first write.
+* Copying a Mem only shares its pages, so forking a machine costs the
+* pages written afterwards rather than 64KB. A page that is not owned
+* exclusively has no write pointer, so the first write takes the slow path.
+* */
 struct m6502::Mem
 {
 	static constexpr u32 MAX_MEM = 1024 * 64;
-	Byte Data[MAX_MEM];
+	static constexpr u32 PAGE_SIZE = 256;
+	static constexpr u32 NUM_PAGES = MAX_MEM / PAGE_SIZE;
+
+	// Handlers are plain function pointers with a context, no virtual calls
+	using ReadHandler = Byte (*)(void* Context, Word Address);
+	using WriteHandler = void (*)(void* Context, Word Address, Byte Value);
+
+	struct IOHandler
+	{
+		ReadHandler Read;
+		WriteHandler Write;
+		void* Context;
+	};
+
+	struct Page
+	{
+		Byte Bytes[PAGE_SIZE];
+		std::atomic<u32> RefCount{ 1 };
+	};
+
+	enum class PageKind : Byte
+	{
+		RAM,
+		ROM,
+		IO
+	};
+
+	// Shared all zero page, RAM starts out as this
+	static Page ZeroPage;
+
+	Page* RAM[NUM_PAGES];
+	PageKind Kinds[NUM_PAGES];
+
+	// One bit per page, set by every write. Only cleared by whoever owns the Mem (ClearDirty)
+	u64 DirtyPages[NUM_PAGES / 64];
+	// The same bits, owned by the block cache: it clears them as it drops decoded code
+	u64 CodeWrites[NUM_PAGES / 64];
+
+	/*
+	* Pages that may hold non zero bytes, the only ones Initialise clears.
+	* A page gets its write pointer through the slow path, which sets the
+	* bit, so the fast path does not have to track anything.
+	* */
+	u64 WrittenPages[NUM_PAGES / 64];
+
+	// Host memory of each page, nullptr routes the access to the slow path
+	const Byte* ReadPages[NUM_PAGES];
+	// Mutable because copying a Mem shares its pages, which revokes these
+	mutable Byte* WritePages[NUM_PAGES];
+	IOHandler IOHandlers[NUM_PAGES];
+
+	// Reads and writes that went to an I/O handler
+	mutable u64 IOAccesses = 0;
+
+	Mem();
+	Mem(const Mem& Other);
+	Mem& operator=(const Mem& Other);
+	~Mem();
+
+	// Zeroes the RAM written since the last Initialise, owned pages are kept
+	void Initialise();
+
+	/* Page mapping, the mapping survives Initialise */
+	void MapRAM(Byte FirstPage, u32 NumPages);
+	void MapROM(Byte FirstPage, u32 NumPages, const Byte* Rom);
+	void MapIO(Byte FirstPage, u32 NumPages, ReadHandler Read, WriteHandler Write, void* Context); // Both handlers required
 
-	void Initialise()
+	Byte Read(Word Address) const
 	{
-		for (u32 i = 0; i < MAX_MEM; i++)
+		if (const Byte* Page = ReadPages[Address / PAGE_SIZE])
 		{
-			Data[i] = 0;
+			return Page[Address % PAGE_SIZE];
 		}
+		const IOHandler& Handler = IOHandlers[Address / PAGE_SIZE];
+		IOAccesses++;
+		return Handler.Read(Handler.Context, Address);
 	}
 
 	// Read 1 byte
 	Byte operator[](u32 Address) const
 	{
-		return Data[Address];
+		return Read(Word(Address));
 	}
 	
-	// Assign byte
+	// Assign byte, the page is assumed to be written
 	Byte& operator[](u32 Address)
 	{
-		return Data[Address];
+		MarkDirty(Address);
+		return OwnPage(Word(Address) / PAGE_SIZE)[Address % PAGE_SIZE];
 	}
 
-  void WriteWord(s32& Cycles, Word Value, u32 Address)
+	// RAM byte whatever the page maps to
+	Byte ReadRAM(Word Address) const
+	{
+		return RAM[Address / PAGE_SIZE]->Bytes[Address % PAGE_SIZE];
+	}
+
+	// Read without side effects: RAM and ROM as mapped, I/O pages give the RAM underneath
+	Byte Peek(Word Address) const
+	{
+		const Byte* Page = ReadPages[Address / PAGE_SIZE];
+		return Page ? Page[Address % PAGE_SIZE] : ReadRAM(Address);
+	}
+
+	void WriteByte(Word Address, Byte Value)
+	{
+		MarkDirty(Address);
+		if (Byte* Page = WritePages[Address / PAGE_SIZE])
+		{
+			Page[Address % PAGE_SIZE] = Value;
+			return;
+		}
+		WriteSlow(Address, Value);
+	}
+
+  void WriteWord(Word Value, Word Address)
   {
-    Data[Address] = Value & 0xFF;
-    Data[Address + 1] = (Value >> 8);
-    Cycles -= 2;
+    WriteByte(Address, Value & 0xFF);
+    WriteByte(Word(Address + 1), Value >> 8);
   }
+
+	void MarkDirty(u32 Address)
+	{
+		const u32 Page = (Address / PAGE_SIZE) % NUM_PAGES;
+		DirtyPages[Page / 64] |= 1ull << (Page % 64);
+		CodeWrites[Page / 64] |= 1ull << (Page % 64);
+	}
+
+	bool IsDirty(u32 Page) const
+	{
+		return DirtyPages[Page / 64] & (1ull << (Page % 64));
+	}
+
+	// True if any page in the Pages bitmap has been written
+	bool AnyDirty(const u64 (&Pages)[NUM_PAGES / 64]) const
+	{
+		u64 Hits = 0;
+		for (u32 i = 0; i < NUM_PAGES / 64; i++)
+		{
+			Hits |= DirtyPages[i] & Pages[i];
+		}
+		return Hits != 0;
+	}
+
+	void ClearDirty()
+	{
+		for (u64& Bits : DirtyPages)
+		{
+			Bits = 0;
+		}
+	}
+
+	// Number of RAM pages this Mem shares with other copies
+	u32 SharedPages() const;
+
+	// Replaces the RAM of Page with PAGE_SIZE Bytes, nullptr for all zeros
+	void SetPage(u32 Page, const Byte* Bytes);
+
+	// Writes Size Bytes from Address on, a copy per page instead of per byte. I/O pages get every byte
+	void WriteBlock(Word Address, const Byte* Bytes, u32 Size);
+
+	// True if Page holds the same RAM as in Other, shared pages compare for free
+	bool SamePage(const Mem& Other, u32 Page) const;
+
+private:
+	void WriteSlow(Word Address, Byte Value);
+	// Copies the RAM page if it is shared and hands out its write pointer
+	Byte* OwnPage(u32 Page);
+	void UpdatePointers(u32 Page);
+	void Release(u32 Page);
+};
+
+/*
+* Optional controls for CPU::Run, checked before every instruction.
+* RequestStop may be called from another thread.
+* */
+struct m6502::RunControl
+{
+	std::atomic<bool> StopRequested{ false };
+	u64 Breakpoints[Mem::MAX_MEM / 64] = {};
+
+	void RequestStop()
+	{
+		StopRequested.store(true, std::memory_order_relaxed);
+	}
+
+	void SetBreakpoint(Word Address)
+	{
+		Breakpoints[Address / 64] |= 1ull << (Address % 64);
+	}
+
+	void ClearBreakpoint(Word Address)
+	{
+		Breakpoints[Address / 64] &= ~(1ull << (Address % 64));
+	}
+
+	bool HasBreakpoint(Word Address) const
+	{
+		return Breakpoints[Address / 64] & (1ull << (Address % 64));
+	}
 };
 
 struct m6502::CPU
@@ -55,17 +296,72 @@ struct m6502::CPU
 
 	Byte A, X, Y; // Registers
 
-	Byte C : 1; // Status flag
-	Byte Z : 1; // Status flag
-	Byte I : 1; // Status flag
-	Byte D : 1; // Status flag
-	Byte B : 1; // Status flag
-	Byte V : 1; // Status flag
-	Byte N : 1; // Status flag
+	// Status flags, bit positions in the processor status byte
+	static constexpr Byte C_FLAG = 0x01; // Carry
+	static constexpr Byte Z_FLAG = 0x02; // Zero
+	static constexpr Byte I_FLAG = 0x04; // Interrupt disable
+	static constexpr Byte D_FLAG = 0x08; // Decimal
+	static constexpr Byte B_FLAG = 0x10; // Break
+	static constexpr Byte U_FLAG = 0x20; // Unused, reads as 1
+	static constexpr Byte V_FLAG = 0x40; // Overflow
+	static constexpr Byte N_FLAG = 0x80; // Negative
+
+	/*
+	* Nearly every instruction sets N and Z from its result, so they are
+	* not stored as flags. NZ keeps the last result instead: Z is set when
+	* the low byte is zero, N when bit 7 of either byte is set. The high
+	* byte is only used to represent N and Z set at the same time.
+	* P holds the remaining flags, its N and Z bits are unused.
+	* */
+	Word NZ;
+	Byte P;
+
+	/*
+	* Set by handlers that stop the run loop. They park their remaining
+	* cycles in StopCycles and zero the budget, so the loop's own cycle
+	* check ends the run and stopping costs nothing per instruction.
+	* */
+	StopReason PendingStop = StopReason::CyclesExhausted;
+	s32 StopCycles = 0;
+	Byte StopOpcode = 0;
+	bool CyclesParked = false;
+
+	/*
+	* Interrupt lines. IRQ is level triggered: every device sharing it owns
+	* a bit of IRQLines and the line is asserted while any bit is set, the
+	* I flag masks it. NMI is edge triggered, a rising edge latches
+	* NMIPending until it is taken.
+	*
+	* Raising a line that can be taken parks the running loop's budget the
+	* same way a stop does, so the loop's cycle check also catches pending
+	* interrupts and nothing is checked per instruction. The loop takes the
+	* interrupt once the current instruction completes and carries on with
+	* the budget it had left.
+	* */
+	static constexpr Word NMI_VECTOR = 0xFFFA;
+	static constexpr Word RESET_VECTOR = 0xFFFC;
+	static constexpr Word IRQ_VECTOR = 0xFFFE; // Shared with BRK
+	static constexpr s32 INTERRUPT_CYCLES = 7;
+
+	Byte IRQLines = 0;
+	bool NMILine = false;
+	bool NMIPending = false;
+	s32* Budget = nullptr; // Cycles of the running loop, null between runs
 
 	// Opcodes (this CPU has byte codes)
-	// JSR
+	// BRK
+	static constexpr Byte INS_BRK = 0x00;
+	// RTI
+	static constexpr Byte INS_RTI = 0x40;
+	// JAM, one of the NMOS opcodes that lock up the CPU
+	static constexpr Byte INS_JAM = 0x02;
+	// JSR, RTS
 	static constexpr Byte INS_JSR = 0x20;
+	static constexpr Byte INS_RTS = 0x60;
+	// JMP
+	static constexpr Byte INS_JMP_ABS = 0x4C;
+	static constexpr Byte INS_JMP_IND = 0x6C;
+	static constexpr Byte INS_JMP_ABSX = 0x7C; // 65C02
 	
 	/* Load Register Instructions */
 	// LDA
@@ -77,6 +373,7 @@ struct m6502::CPU
 	static constexpr Byte INS_LDA_ABSY = 0xB9;
 	static constexpr Byte INS_LDA_INDX = 0xA1;
 	static constexpr Byte INS_LDA_INDY = 0xB1;
+	static constexpr Byte INS_LDA_ZPI = 0xB2; // 65C02
 	// LDX
 	static constexpr Byte INS_LDX_IM = 0xA2;
 	static constexpr Byte INS_LDX_ZP = 0xA6;
@@ -90,6 +387,34 @@ struct m6502::CPU
 	static constexpr Byte INS_LDY_ABS = 0xAC;
 	static constexpr Byte INS_LDY_ABSX = 0xBC;
 
+	/* Arithmetic Instructions */
+	// ADC
+	static constexpr Byte INS_ADC_IM = 0x69;
+	static constexpr Byte INS_ADC_ZP = 0x65;
+	static constexpr Byte INS_ADC_ZPX = 0x75;
+	static constexpr Byte INS_ADC_ABS = 0x6D;
+	static constexpr Byte INS_ADC_ABSX = 0x7D;
+	static constexpr Byte INS_ADC_ABSY = 0x79;
+	static constexpr Byte INS_ADC_INDX = 0x61;
+	static constexpr Byte INS_ADC_INDY = 0x71;
+	static constexpr Byte INS_ADC_ZPI = 0x72; // 65C02
+	// SBC
+	static constexpr Byte INS_SBC_IM = 0xE9;
+	static constexpr Byte INS_SBC_ZP = 0xE5;
+	static constexpr Byte INS_SBC_ZPX = 0xF5;
+	static constexpr Byte INS_SBC_ABS = 0xED;
+	static constexpr Byte INS_SBC_ABSX = 0xFD;
+	static constexpr Byte INS_SBC_ABSY = 0xF9;
+	static constexpr Byte INS_SBC_INDX = 0xE1;
+	static constexpr Byte INS_SBC_INDY = 0xF1;
+	static constexpr Byte INS_SBC_ZPI = 0xF2; // 65C02
+
+	/* Flag Instructions */
+	static constexpr Byte INS_CLC = 0x18;
+	static constexpr Byte INS_SEC = 0x38;
+	static constexpr Byte INS_CLD = 0xD8;
+	static constexpr Byte INS_SED = 0xF8;
+
 	/* Store Register Instructions */
 	// STA
 	static constexpr Byte INS_STA_ZP = 0x85;
@@ -99,6 +424,7 @@ struct m6502::CPU
 	static constexpr Byte INS_STA_ABSY = 0x99;
 	static constexpr Byte INS_STA_INDX = 0x81;
 	static constexpr Byte INS_STA_INDY = 0x91;
+	static constexpr Byte INS_STA_ZPI = 0x92; // 65C02
 	// STX
 	static constexpr Byte INS_STX_ZP = 0x86;
 	static constexpr Byte INS_STX_ABS = 0x8E;
@@ -106,14 +432,354 @@ struct m6502::CPU
 	static constexpr Byte INS_STY_ZP = 0x84;
 	static constexpr Byte INS_STY_ZPX = 0x94;
 	static constexpr Byte INS_STY_ABS = 0x8C;
+	// STZ, 65C02
+	static constexpr Byte INS_STZ_ZP = 0x64;
+	static constexpr Byte INS_STZ_ZPX = 0x74;
+	static constexpr Byte INS_STZ_ABS = 0x9C;
+	static constexpr Byte INS_STZ_ABSX = 0x9E;
 
+	/*
+	* Runs at least Cycles and reports why it stopped, never throws.
+	* The RunControl overload also honours breakpoints and stop requests.
+	* */
+	RunResult Run(s32 Cycles, Mem& memory) noexcept;
+	RunResult Run(s32 Cycles, Mem& memory, RunControl& Control) noexcept;
+	// Runs from pre-decoded blocks, see blockcache_6502.hpp
+	RunResult Run(s32 Cycles, Mem& memory, BlockCache& cache) noexcept;
+
+	/*
+	* Run with an instrumentation policy (stats_6502.hpp, trace_6502.hpp),
+	* instantiated for NoStats, Stats and Tracer. Run without one uses NoStats.
+	* */
+	template <typename Policy>
+	RunResult Run(s32 Cycles, Mem& memory, Policy& Instrumentation) noexcept
+	{
+		return RunVariant<NMOS6502>(Cycles, memory, Instrumentation);
+	}
+
+	// The interpreter built for Variant, instantiated for every variant and policy
+	template <typename Variant, typename Policy>
+	RunResult RunVariant(s32 Cycles, Mem& memory, Policy& Instrumentation) noexcept;
+
+	// Run, returning only the cycles used
 	s32 Execute(s32 Cycles, Mem& memory);
+	s32 Execute(s32 Cycles, Mem& memory, BlockCache& cache);
+
+	template <typename Policy>
+	s32 Execute(s32 Cycles, Mem& memory, Policy& Instrumentation)
+	{
+		return Run(Cycles, memory, Instrumentation).CyclesUsed;
+	}
 
 	void Reset(Mem& memory);
-	Byte FetchByte(s32& Cycles, const Mem& memory);
-	Word FetchWord(s32& Cycles, const Mem& memory); // 6502 is little endian
-	Byte ReadByte(s32& Cycles, Word Address, const Mem& memory);
-	Word ReadWord(s32& Cycles, Word Address, const Mem& memory);
-	void LoadRegisterSetStatus(Byte Register);
-	Word AddrZeroPage(s32& Cycles, const Mem& memory);
+
+	/*
+	* Memory accessors do not count cycles, the base cycle count of
+	* every opcode lives in the dispatch table (see instructions_6502.hpp)
+	* and handlers only add extra cycles (page crossings, 65C02 decimal
+	* mode) on top.
+	* */
+	Byte FetchByte(const Mem& memory)
+	{
+		return memory[PC++];
+	}
+
+	Word FetchWord(const Mem& memory) // 6502 is little endian
+	{
+		/*
+		* If the platform is big endian,
+		* it has to be implemented here, e.g.:
+		* IF (PLATFORM_BIG_ENDIAN)
+		*  SwapBytesInWord(Data);
+		* */
+		Word Data = memory[PC];
+		Data |= (memory[Word(PC + 1)] << 8);
+		PC += 2;
+		return Data;
+	}
+
+	Byte ReadByte(Word Address, const Mem& memory) const
+	{
+		return memory[Address];
+	}
+
+	Word ReadWord(Word Address, const Mem& memory) const
+	{
+		Word Data = memory[Address];
+		Data |= (memory[Word(Address + 1)] << 8);
+		return Data;
+	}
+
+	void WriteByte(Word Address, Byte Value, Mem& memory) const
+	{
+		memory.WriteByte(Address, Value);
+	}
+
+	void LoadRegisterSetStatus(Byte Register)
+	{
+		NZ = Register;
+	}
+
+	// Sets C, V, N and Z from Flags, as ADC and SBC do
+	void SetArithmeticFlags(Byte Flags)
+	{
+		P = Byte((P & ~(C_FLAG | V_FLAG)) | (Flags & (C_FLAG | V_FLAG)));
+		NZ = Word(((Flags & Z_FLAG) ? 0 : 1) | ((Flags & N_FLAG) ? 0x8000 : 0));
+	}
+
+	bool GetFlag(Byte Flag) const
+	{
+		return GetStatus() & Flag;
+	}
+
+	void SetFlag(Byte Flag, bool Value)
+	{
+		SetStatus(Value ? GetStatus() | Flag : GetStatus() & ~Flag);
+	}
+
+	// The processor status byte as PHP and interrupts push it
+	Byte GetStatus() const
+	{
+		const Byte Zero = Byte(NZ) == 0 ? Z_FLAG : 0;
+		const Byte Negative = (NZ & 0x8080) ? N_FLAG : 0;
+		return Byte((P & ~(N_FLAG | Z_FLAG)) | Zero | Negative | U_FLAG);
+	}
+
+	// Same registers and flags, what the next instruction depends on
+	bool SameState(const CPU& Other) const
+	{
+		return PC == Other.PC && SP == Other.SP && A == Other.A && X == Other.X && Y == Other.Y &&
+			GetStatus() == Other.GetStatus();
+	}
+
+	void SetStatus(Byte Status)
+	{
+		P = Status;
+		NZ = Word(((Status & Z_FLAG) ? 0 : 1) | ((Status & N_FLAG) ? 0x8000 : 0));
+	}
+
+	void RequestStop(StopReason Reason, Byte Opcode, s32& Cycles) noexcept
+	{
+		PendingStop = Reason;
+		StopOpcode = Opcode;
+		ParkCycles(Cycles);
+	}
+
+	// Moves the budget to StopCycles so the loop's cycle check ends it
+	void ParkCycles(s32& Cycles) noexcept
+	{
+		if (!CyclesParked)
+		{
+			StopCycles = Cycles;
+			Cycles = 0;
+			CyclesParked = true;
+		}
+	}
+
+	// Budget left as if nothing had been parked, cycles charged after parking went below zero
+	s32 UnparkedCycles(s32 Cycles) const noexcept
+	{
+		return CyclesParked ? StopCycles + Cycles : Cycles;
+	}
+
+	/*
+	* The stack lives in page 1, the low byte of SP is the next free slot.
+	* The static forms work on any stack pointer, so engines that keep SP
+	* outside a CPU (CPUBatch lanes) push and pop the same way.
+	* */
+	static void PushByte(Word& SP, Byte Value, Mem& memory)
+	{
+		memory.WriteByte(Word(0x0100 | Byte(SP)), Value);
+		SP = Word(0x0100 | Byte(SP - 1));
+	}
+
+	static Byte PopByte(Word& SP, const Mem& memory)
+	{
+		SP = Word(0x0100 | Byte(SP + 1));
+		return memory[SP];
+	}
+
+	static void PushWord(Word& SP, Word Value, Mem& memory)
+	{
+		PushByte(SP, Byte(Value >> 8), memory);
+		PushByte(SP, Byte(Value), memory);
+	}
+
+	static Word PopWord(Word& SP, const Mem& memory)
+	{
+		const Word Low = PopByte(SP, memory);
+		return Word(Low | (PopByte(SP, memory) << 8));
+	}
+
+	void PushByte(Byte Value, Mem& memory)
+	{
+		PushByte(SP, Value, memory);
+	}
+
+	Byte PopByte(const Mem& memory)
+	{
+		return PopByte(SP, memory);
+	}
+
+	void PushWord(Word Value, Mem& memory)
+	{
+		PushWord(SP, Value, memory);
+	}
+
+	Word PopWord(const Mem& memory)
+	{
+		return PopWord(SP, memory);
+	}
+
+	// Source is this device's bit of IRQLines
+	void SetIRQ(Byte Source, bool Asserted) noexcept
+	{
+		IRQLines = Byte(Asserted ? IRQLines | Source : IRQLines & ~Source);
+		PollInterrupts();
+	}
+
+	void SetNMI(bool Asserted) noexcept
+	{
+		if (Asserted && !NMILine)
+		{
+			NMIPending = true;
+		}
+		NMILine = Asserted;
+		PollInterrupts();
+	}
+
+	// Pulses NMI
+	void TriggerNMI() noexcept
+	{
+		SetNMI(true);
+		SetNMI(false);
+	}
+
+	bool InterruptPending() const
+	{
+		return NMIPending || (IRQLines != 0 && !(P & I_FLAG));
+	}
+
+	// Ends the running loop's budget early when an interrupt can be taken
+	void PollInterrupts() noexcept
+	{
+		if (Budget != nullptr && InterruptPending())
+		{
+			ParkCycles(*Budget);
+		}
+	}
+
+	// Pushes PC and Status and jumps through Vector, as interrupts and BRK do
+	template <typename Variant = NMOS6502>
+	void EnterInterrupt(Word Vector, Byte Status, Mem& memory)
+	{
+		PushWord(PC, memory);
+		PushByte(Status, memory);
+		P |= I_FLAG;
+		if constexpr (Variant::CMOS)
+		{
+			P &= ~D_FLAG;
+		}
+		PC = ReadWord(Vector, memory);
+	}
+
+	// Takes the pending interrupt, NMI first, and returns the cycles it took
+	template <typename Variant = NMOS6502>
+	s32 TakeInterrupt(Mem& memory) noexcept
+	{
+		Word Vector = IRQ_VECTOR;
+		if (NMIPending)
+		{
+			NMIPending = false;
+			Vector = NMI_VECTOR;
+		}
+		EnterInterrupt<Variant>(Vector, Byte(GetStatus() & ~B_FLAG), memory);
+		return INTERRUPT_CYCLES;
+	}
+
+	// Called by run loops before their first instruction
+	template <typename Variant = NMOS6502>
+	void StartRun(s32& Cycles, Mem& memory) noexcept
+	{
+		Budget = &Cycles;
+		if (Cycles > 0 && InterruptPending())
+		{
+			Cycles -= TakeInterrupt<Variant>(memory);
+		}
+	}
+
+	/*
+	* Called by run loops once the budget is used up. If it was parked for
+	* an interrupt, the instruction that raised it has completed: gives the
+	* budget back, takes the interrupt and returns true to carry on.
+	* Interrupts still pending at the end of the budget wait for the next run.
+	* */
+	template <typename Variant = NMOS6502>
+	bool ResumeRun(s32& Cycles, Mem& memory) noexcept
+	{
+		if (!CyclesParked || PendingStop != StopReason::CyclesExhausted)
+		{
+			return false;
+		}
+		CyclesParked = false;
+		Cycles += StopCycles;
+		if (Cycles > 0 && InterruptPending())
+		{
+			Cycles -= TakeInterrupt<Variant>(memory);
+		}
+		return Cycles > 0;
+	}
+
+	// Builds the result of a run loop that started with CyclesRequested
+	RunResult FinishRun(s32 CyclesRequested, s32 Cycles) noexcept
+	{
+		RunResult Result = { PendingStop, 0, PC, 0 };
+		if (PendingStop != StopReason::CyclesExhausted)
+		{
+			Cycles = StopCycles;
+			Result.Opcode = StopOpcode;
+			PendingStop = StopReason::CyclesExhausted;
+		}
+		CyclesParked = false;
+		Budget = nullptr;
+		Result.CyclesUsed = CyclesRequested - Cycles;
+		return Result;
+	}
 };
+
+/*
+* A CPU of the given variant. Every variant runs its own interpreter,
+* built from its own opcode table with handlers that take the variant as
+* a template argument, so no handler checks the variant at run time.
+* CPU itself is the NMOS 6502, and the block cache, batch and RunControl
+* runs are NMOS 6502 only.
+* */
+template <typename Variant>
+struct m6502::VariantCPU : CPU
+{
+	RunResult Run(s32 Cycles, Mem& memory) noexcept;
+
+	template <typename Policy>
+	RunResult Run(s32 Cycles, Mem& memory, Policy& Instrumentation) noexcept
+	{
+		return RunVariant<Variant>(Cycles, memory, Instrumentation);
+	}
+
+	s32 Execute(s32 Cycles, Mem& memory)
+	{
+		return Run(Cycles, memory).CyclesUsed;
+	}
+
+	template <typename Policy>
+	s32 Execute(s32 Cycles, Mem& memory, Policy& Instrumentation)
+	{
+		return Run(Cycles, memory, Instrumentation).CyclesUsed;
+	}
+};
+
+namespace m6502
+{
+	using CPU6502 = VariantCPU<NMOS6502>;
+	using CPU65C02 = VariantCPU<CMOS65C02>;
+	using CPU2A03 = VariantCPU<Ricoh2A03>;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <main_6502.hpp>
+
+/*
+* Read only view of a whole file. Mapped on POSIX systems, on Windows the
+* file is read into memory instead. Data stays valid until Close or the
+* destructor.
+* */
+namespace m6502
+{
+	struct MappedFile;
+}
+
+struct m6502::MappedFile
+{
+	MappedFile() = default;
+	explicit MappedFile(const char* Path)
+	{
+		Open(Path);
+	}
+	~MappedFile()
+	{
+		Close();
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// False when the file can't be opened or is empty
+	bool Open(const char* Path);
+	void Close();
+
+	bool IsOpen() const
+	{
+		return Bytes != nullptr;
+	}
+
+	const Byte* Data() const
+	{
+		return Bytes;
+	}
+
+	u64 Size() const
+	{
+		return Length;
+	}
+
+private:
+	const Byte* Bytes = nullptr;
+	u64 Length = 0;
+};
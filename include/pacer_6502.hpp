@@ -0,0 +1,150 @@
+#pragma once
+
+#include <chrono>
+#include <main_6502.hpp>
+
+/*
+* Real-time pacing.
+*
+* Pacer runs emulation at a fixed clock rate. The caller runs the slices
+* it hands out and reports them back, and SliceDone waits until wall time
+* reaches the end of the slice in emulated time:
+*  - Deadlines are absolute, the epoch plus cycles / clock, so rounding in
+*    one wait never carries over into the next and the pace can't drift.
+*  - Slices are at most SliceMicroseconds long and always end on a frame
+*    boundary, so a frame is complete on its deadline. When the host falls
+*    behind by more than a slice, slices run to the end of the frame and
+*    skip waiting until emulation has caught up.
+*  - More than MaxLagMicroseconds behind (the host was suspended, the
+*    machine was stalled by an output) the epoch moves forward instead, so
+*    emulation doesn't race to make up for the lost time.
+*  - Waits sleep until SpinMicroseconds before the deadline and yield the
+*    rest of the way: sleeping alone wakes up too late, spinning the whole
+*    wait would keep a core busy.
+*
+* Metrics, since Start: slices that finished after their deadline, wake
+* up jitter (how late a wait returned, in 1us buckets) and the share of
+* wall time the pacing thread was not asleep.
+*
+* Wall time, sleeping and yielding all go through a PacerTime, the steady
+* clock and this_thread by default. Handing in one that moves time by
+* itself makes the pacer's decisions independent of the host's timing.
+* */
+namespace m6502
+{
+	// Commodore 64 clocks and cycles per frame (lines * cycles per line)
+	constexpr u32 PAL_CLOCK_HZ = 985248;
+	constexpr u32 NTSC_CLOCK_HZ = 1022727;
+	constexpr u32 PAL_FRAME_CYCLES = 312 * 63;
+	constexpr u32 NTSC_FRAME_CYCLES = 263 * 65;
+
+	struct PacerConfig
+	{
+		u32 ClockHz = PAL_CLOCK_HZ;
+		u32 FrameCycles = PAL_FRAME_CYCLES;
+		u32 SliceMicroseconds = 2000; // Longest slice, shorter ones bring input latency down
+		u32 SpinMicroseconds = 500;
+		u32 MaxLagMicroseconds = 100000;
+
+		static PacerConfig PAL()
+		{
+			return PacerConfig{};
+		}
+
+		static PacerConfig NTSC()
+		{
+			PacerConfig Settings;
+			Settings.ClockHz = NTSC_CLOCK_HZ;
+			Settings.FrameCycles = NTSC_FRAME_CYCLES;
+			return Settings;
+		}
+	};
+
+	// Function pointers with a context, like the I/O handlers
+	struct PacerTime
+	{
+		using Clock = std::chrono::steady_clock;
+
+		Clock::time_point (*Now)(void* Context);
+		void (*SleepFor)(void* Context, Clock::duration Duration);
+		void (*Yield)(void* Context);
+		void* Context;
+
+		// steady_clock, this_thread::sleep_for and this_thread::yield
+		static PacerTime System();
+	};
+
+	struct PacerMetrics
+	{
+		u64 Slices;
+		u64 Frames;
+		u64 Overruns; // Slices that finished after their deadline
+		u64 WorstOverrunNs;
+		u64 Resyncs; // Times the epoch moved because emulation fell too far behind
+		u64 JitterP50Ns; // How late waits returned
+		u64 JitterP90Ns;
+		u64 JitterP99Ns;
+		u64 JitterMaxNs;
+		double HostShare; // Fraction of wall time not spent asleep
+	};
+
+	struct Pacer;
+}
+
+struct m6502::Pacer
+{
+	using Clock = PacerTime::Clock;
+	// 1us each, the last bucket holds waits JITTER_BUCKETS - 1 us late or more
+	static constexpr u32 JITTER_BUCKETS = 1024;
+
+	explicit Pacer(const PacerConfig& Settings = PacerConfig{}, const PacerTime& Time = PacerTime::System());
+
+	// Emulated cycle 0 is now, clears the metrics
+	void Start();
+
+	// Cycles to run next
+	s32 NextSlice() const;
+
+	// Counts the cycles the slice used and waits for its deadline
+	void SliceDone(s32 CyclesUsed);
+
+	PacerMetrics Metrics() const;
+
+	u64 Cycle() const
+	{
+		return Cycles;
+	}
+
+	const PacerConfig& Settings() const
+	{
+		return Config;
+	}
+
+private:
+	// Wall time of emulated cycle Cycle
+	Clock::time_point Deadline(u64 Cycle) const;
+	void Wait(Clock::time_point Until);
+	u64 JitterPercentile(u32 Percent) const;
+
+	Clock::time_point Now() const
+	{
+		return Time.Now(Time.Context);
+	}
+
+	PacerConfig Config;
+	PacerTime Time;
+	s32 SliceCycles;
+	Clock::time_point Epoch;
+	Clock::time_point Started;
+	u64 Cycles = 0;
+	bool CatchingUp = false;
+
+	u64 Slices = 0;
+	u64 Overruns = 0;
+	u64 WorstOverrunNs = 0;
+	u64 Resyncs = 0;
+	u64 Waits = 0;
+	u64 JitterMaxNs = 0;
+	u64 JitterHistogram[JITTER_BUCKETS];
+	Clock::duration Asleep{ 0 };
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <main_6502.hpp>
+
+/*
+* Reusable CPU/Mem pairs for batch runners.
+*
+* Released machines keep their RAM pages and Acquire resets them, which
+* only clears the pages the previous program wrote. Once the pool has
+* grown to the number of machines in use it never allocates again.
+* Not thread safe, give each worker its own pool.
+* */
+namespace m6502
+{
+	struct Machine
+	{
+		CPU cpu;
+		Mem mem;
+	};
+
+	struct MachinePool;
+}
+
+struct m6502::MachinePool
+{
+	explicit MachinePool(u32 InitialSize = 0);
+
+	// A reset machine, only allocates when every machine is in use
+	Machine* Acquire();
+	void Release(Machine* machine);
+
+	u32 Size() const
+	{
+		return u32(Machines.size());
+	}
+
+	u32 Available() const
+	{
+		return u32(Free.size());
+	}
+
+private:
+	std::vector<std::unique_ptr<Machine>> Machines;
+	std::vector<Machine*> Free;
+};
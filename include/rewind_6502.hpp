@@ -0,0 +1,181 @@
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <vector>
+#include <main_6502.hpp>
+
+/*
+* Rewind and replay.
+*
+* Rewinder runs a CPU and keeps a keyframe of it every KeyframeInterval
+* cycles. A keyframe is a CPU copy and a Mem copy, and Mem copies share
+* their pages until either side writes one, so a keyframe only costs the
+* pages written since the one before it.
+*
+* Execution is deterministic given memory and the interrupt lines, so
+* between keyframes only what comes from outside is journaled:
+*  - every I/O read and write, in order (Attach routes the I/O pages
+*    through the rewinder), with the interrupt lines the device left if
+*    the access changed them,
+*  - host writes made through Rewinder::Write, with their cycle,
+*  - interrupt lines changed between runs (by the host or a device
+*    scheduler calling CPU::SetIRQ / SetNMI), with the cycle they were
+*    seen at.
+* Seek restores the nearest keyframe at or before the target and replays
+* forward with CPU::Run. While replaying, I/O reads return the journaled
+* values, I/O writes are not passed on and the interrupt lines follow the
+* journal, so devices only see the live run and the replay takes every
+* interrupt the live run took. Once the journal runs out the run is live
+* again.
+*
+* History is bounded: keyframes older than Window cycles are dropped, and
+* past MaxKeyframes the older half is thinned, so recent history stays
+* dense and seeking anywhere replays at most one keyframe gap.
+* Writing (Rewinder::Write) or changing an interrupt line while in the
+* past drops the future.
+* */
+namespace m6502
+{
+	struct RewindConfig
+	{
+		u32 KeyframeInterval = 10000;
+		u32 MaxKeyframes = 64;
+		u64 Window = 10000000; // Cycles of history kept
+	};
+
+	struct Rewinder;
+}
+
+struct m6502::Rewinder
+{
+	// Attaches to the I/O pages mapped in memory, map devices before this
+	Rewinder(CPU& cpu, Mem& memory, const RewindConfig& Config = RewindConfig());
+	// Gives the I/O pages their own handlers back
+	~Rewinder();
+
+	Rewinder(const Rewinder&) = delete;
+	Rewinder& operator=(const Rewinder&) = delete;
+
+	// Runs at least Cycles from the current cycle, replaying while in the past
+	RunResult Run(s32 Cycles);
+
+	// Host write at the current cycle, journaled so replays see it too
+	void Write(Word Address, Byte Value);
+
+	// Moves to the first instruction boundary at or after Cycle, false outside the window
+	bool Seek(u64 Cycle);
+
+	bool Rewind(u64 Cycles)
+	{
+		return Cycles <= Now && Seek(Now - Cycles);
+	}
+
+	u64 Cycle() const
+	{
+		return Now;
+	}
+
+	// Furthest cycle run live
+	u64 HeadCycle() const
+	{
+		return Head;
+	}
+
+	// Earliest cycle Seek can reach
+	u64 OldestCycle() const
+	{
+		return Keyframes.front()->Cycle;
+	}
+
+	u32 NumKeyframes() const
+	{
+		return u32(Keyframes.size());
+	}
+
+	u64 JournalSize() const
+	{
+		return IOJournal.size() + HostJournal.size();
+	}
+
+private:
+	struct Keyframe
+	{
+		u64 Cycle;
+		u64 IOPos; // Absolute positions in the journals
+		u64 HostPos;
+		CPU cpu; // Interrupt lines included
+		Mem memory;
+	};
+
+	// What the outside drives on the CPU's interrupt inputs
+	struct InterruptLines
+	{
+		Byte IRQLines;
+		bool NMILine;
+		bool NMIPending;
+
+		bool operator==(const InterruptLines& Other) const
+		{
+			return IRQLines == Other.IRQLines && NMILine == Other.NMILine && NMIPending == Other.NMIPending;
+		}
+	};
+
+	struct IOEntry
+	{
+		Word Address;
+		Byte Value;
+		bool Write;
+		bool Interrupt; // The device changed the lines to Lines
+		InterruptLines Lines;
+	};
+
+	// A host write, or with Interrupt set the lines the host left
+	struct HostEntry
+	{
+		u64 Cycle;
+		Word Address;
+		Byte Value;
+		bool Interrupt;
+		InterruptLines Lines;
+	};
+
+	static Byte ReadIO(void* Context, Word Address);
+	static void WriteIO(void* Context, Word Address, Byte Value);
+
+	// Runs to Target, taking keyframes at new boundaries
+	RunResult Advance(u64 Target);
+	void TakeKeyframe();
+	void SetLines(const InterruptLines& Set);
+
+	static InterruptLines LinesOf(const CPU& cpu)
+	{
+		return { cpu.IRQLines, cpu.NMILine, cpu.NMIPending };
+	}
+
+	void DropFuture();
+	void Thin();
+
+	bool Replaying() const
+	{
+		return IOPos < IOBase + IOJournal.size();
+	}
+
+	CPU& cpu;
+	Mem& memory;
+	RewindConfig Config;
+	Mem::IOHandler Devices[Mem::NUM_PAGES];
+
+	u64 Now = 0;
+	u64 Head = 0;
+	InterruptLines Lines; // As the last run left them
+	std::vector<std::unique_ptr<Keyframe>> Keyframes;
+
+	// Journals drop their front as keyframes are dropped, Base is the absolute index of the front
+	std::deque<IOEntry> IOJournal;
+	u64 IOBase = 0;
+	u64 IOPos = 0;
+	std::deque<HostEntry> HostJournal;
+	u64 HostBase = 0;
+	u64 HostPos = 0;
+};
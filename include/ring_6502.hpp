@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <main_6502.hpp>
+
+namespace m6502
+{
+	template <typename T>
+	class SPSCRing;
+}
+
+/*
+* Fixed size single producer/single consumer ring. The read and write
+* indices only ever grow, the slot is the index masked by the power of two
+* capacity. Each side caches the other side's index so it only touches the
+* shared cache line when the ring looks full (producer) or empty (consumer).
+* */
+template <typename T>
+class m6502::SPSCRing
+{
+public:
+	// Capacity is rounded up to a power of two
+	explicit SPSCRing(u32 Capacity)
+	{
+		u32 Size = 1;
+		while (Size < Capacity)
+		{
+			Size <<= 1;
+		}
+		Items.resize(Size);
+		Mask = Size - 1;
+	}
+
+	u32 Capacity() const
+	{
+		return u32(Items.size());
+	}
+
+	// Producer side
+	bool TryPush(const T& Item)
+	{
+		const u64 Head = WriteIndex.load(std::memory_order_relaxed);
+		if (Head - CachedReadIndex >= Items.size())
+		{
+			CachedReadIndex = ReadIndex.load(std::memory_order_acquire);
+			if (Head - CachedReadIndex >= Items.size())
+			{
+				return false;
+			}
+		}
+		Items[Head & Mask] = Item;
+		WriteIndex.store(Head + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer side
+	bool TryPop(T& Item)
+	{
+		const u64 Tail = ReadIndex.load(std::memory_order_relaxed);
+		if (Tail == CachedWriteIndex)
+		{
+			CachedWriteIndex = WriteIndex.load(std::memory_order_acquire);
+			if (Tail == CachedWriteIndex)
+			{
+				return false;
+			}
+		}
+		Item = Items[Tail & Mask];
+		ReadIndex.store(Tail + 1, std::memory_order_release);
+		return true;
+	}
+
+private:
+	std::vector<T> Items;
+	u64 Mask;
+	// Producer side
+	alignas(64) std::atomic<u64> WriteIndex{ 0 };
+	u64 CachedReadIndex = 0;
+	// Consumer side
+	alignas(64) std::atomic<u64> ReadIndex{ 0 };
+	u64 CachedWriteIndex = 0;
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vector>
+#include <main_6502.hpp>
+
+/*
+* Save states.
+*
+* A save state holds the registers, the packed status, the interrupt
+* lines, a cycle counter and the RAM of every page (ROM images and I/O
+* mappings are host setup and are not saved). Two kinds are written:
+*  - Full: every page that isn't all zeros.
+*  - Delta: only the pages that differ from a base state. The base is a
+*    Mem copy taken when the base was saved, copies share their pages so
+*    keeping one is cheap and unchanged pages are found by comparing
+*    pointers.
+*
+* Format, all integers little endian:
+*  - "M65S", version, kind (0 full, 1 delta), two reserved bytes
+*  - Id and BaseId (u64), Cycle (u64)
+*  - PC, SP (u16), A, X, Y, P, IRQLines, then NMILine in bit 0 and
+*    NMIPending in bit 1
+*  - A 256 bit bitmap of the pages that follow, then their bytes in page order
+* The Id is a hash of every byte but the Id, kind included, a delta only
+* loads on top of the state its BaseId names. Page bytes are read in
+* place, so a state loaded from a MappedFile is copied straight from the
+* mapping into Mem.
+* */
+namespace m6502
+{
+	constexpr Byte SAVESTATE_MAGIC[4] = { 'M', '6', '5', 'S' };
+	constexpr Byte SAVESTATE_VERSION = 2; // 1 left the kind out of the Id
+
+	struct SaveStateInfo
+	{
+		u64 Id;
+		u64 BaseId; // 0 for full states
+		u64 Cycle;
+		bool Delta;
+		u32 Pages; // Pages stored
+	};
+
+	// Appends a full state to Out
+	SaveStateInfo SaveFull(const CPU& cpu, const Mem& memory, u64 Cycle, std::vector<Byte>& Out);
+
+	// Appends the pages of memory that differ from Base, the Mem the base state was saved from
+	SaveStateInfo SaveDelta(const CPU& cpu, const Mem& memory, u64 Cycle,
+		const Mem& Base, const SaveStateInfo& BaseInfo, std::vector<Byte>& Out);
+
+	// Checks the state at Data and fills in Info, false if it's not a valid state
+	bool ReadSaveStateInfo(const Byte* Data, u64 Size, SaveStateInfo& Info);
+
+	/*
+	* Loads the state at Data into cpu and memory. A delta only loads when
+	* memory holds the state with Id LoadedId equal to its BaseId, pass 0
+	* when loading a full state. On failure cpu and memory are untouched.
+	* */
+	bool LoadSaveState(const Byte* Data, u64 Size, CPU& cpu, Mem& memory, u64 LoadedId, SaveStateInfo& Info);
+
+	// Writes Bytes to Path, false on any error
+	bool WriteFile(const char* Path, const std::vector<Byte>& Bytes);
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <vector>
+#include <main_6502.hpp>
+
+/*
+* Device event scheduler.
+*
+* Devices schedule events at absolute cycle timestamps instead of being
+* polled after every instruction. Events are kept in a min-heap ordered by
+* cycle, then by the order they were scheduled. Run gives the CPU exactly
+* the cycles up to the next deadline, so the run loop itself never looks
+* at a device, then dispatches every event that is due.
+*
+* The CPU stops on instruction boundaries, so an event can be dispatched a
+* few cycles after its timestamp. Handlers get the exact timestamp to
+* schedule their next event from, which keeps periodic timers drift free,
+* and Cycle() for the actual one.
+*
+* Handlers are plain function pointers with a context, like the I/O
+* handlers, and may schedule, cancel or Stop from inside a dispatch.
+* */
+namespace m6502
+{
+	struct Scheduler;
+}
+
+struct m6502::Scheduler
+{
+	using EventHandler = void (*)(void* Context, Scheduler& Events, u64 Cycle);
+	// Slot in the low 32 bits, generation in the high ones, never 0
+	using EventId = u64;
+
+	// Schedules Handler at Cycle, events in the past are due right away
+	EventId Schedule(u64 Cycle, EventHandler Handler, void* Context);
+
+	EventId ScheduleIn(u64 Delay, EventHandler Handler, void* Context)
+	{
+		return Schedule(Now + Delay, Handler, Context);
+	}
+
+	// False if the event already fired or was cancelled
+	bool Cancel(EventId Id);
+
+	// Runs the CPU for at least Cycles, dispatching events as they come due
+	RunResult Run(CPU& cpu, Mem& memory, s32 Cycles);
+	RunResult Run(CPU& cpu, Mem& memory, BlockCache& cache, s32 Cycles);
+
+	// Ends the current Run after this dispatch with StopReason::HostRequest
+	void Stop()
+	{
+		StopRequested = true;
+	}
+
+	u64 Cycle() const
+	{
+		return Now;
+	}
+
+	bool Pending() const
+	{
+		return !Heap.empty();
+	}
+
+	// Timestamp of the next event, or ~0 with none scheduled
+	u64 NextDeadline();
+
+private:
+	struct Event
+	{
+		u64 Cycle;
+		u64 Sequence; // Keeps events at the same cycle in scheduling order
+		EventHandler Handler;
+		void* Context;
+		u32 Slot;
+		u32 Generation;
+	};
+
+	// Min-heap order for std::push_heap and friends
+	static bool Later(const Event& Left, const Event& Right)
+	{
+		return Left.Cycle != Right.Cycle ? Left.Cycle > Right.Cycle : Left.Sequence > Right.Sequence;
+	}
+
+	template <typename Executor>
+	RunResult RunUntil(CPU& cpu, s32 Cycles, Executor Execute);
+	void DispatchDue();
+	void DropCancelled();
+	void FreeSlot(u32 Slot);
+
+	u64 Now = 0;
+	u64 NextSequence = 0;
+	u64 Cancelled = 0; // Stale entries still in the heap
+	bool StopRequested = false;
+	std::vector<Event> Heap;
+	std::vector<u32> Generations; // Current generation of every slot
+	std::vector<u32> FreeSlots;
+};
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <string.h>
+#include <instructions_6502.hpp>
+
+/*
+* Instrumentation policies for CPU::Run / CPU::Execute.
+*
+* The run loop calls the policy's hooks around every instruction, BeginRun
+* gets the opcode table of the variant that runs, Fetched gets the
+* instruction at PC before it runs and Executed the CPU state after it
+* ran. NoStats
+* has empty hooks and Enabled = false, so the loop compiles to exactly the
+* uninstrumented code. Stats counts per opcode:
+*  - executions and cycles,
+*  - extra cycles, the cycles used above the base cycles: page crossings
+*    of the ABSX/ABSY/INDY reads and, on the 65C02, decimal mode ADC/SBC,
+* and keeps histograms of cycles per instruction and instructions per run.
+* */
+namespace m6502
+{
+	struct NoStats
+	{
+		static constexpr bool Enabled = false;
+
+		void BeginRun(const std::array<Instruction, 256>&) {}
+		void Fetched(const Mem&, Word, Byte) {}
+		void Executed(const CPU&, const Mem&, Word, Byte, s32) {}
+		void EndRun() {}
+	};
+
+	struct Stats
+	{
+		static constexpr bool Enabled = true;
+		// Instructions per run are bucketed by log2, bucket N holds [2^(N-1), 2^N)
+		static constexpr u32 RUN_BUCKETS = 33;
+		static constexpr u32 CYCLE_BUCKETS = 16;
+
+		u64 Executions[256];
+		u64 Cycles[256];
+		u64 ExtraCycles[256]; // Cycles paid above the base cycles
+		u64 CycleHistogram[CYCLE_BUCKETS]; // Instructions by cycles taken, last bucket is 15 or more
+		u64 RunHistogram[RUN_BUCKETS]; // Runs by instructions executed
+		u64 Runs;
+		u64 Instructions;
+
+		Stats()
+		{
+			Reset();
+		}
+
+		void Reset()
+		{
+			memset(this, 0, sizeof(*this));
+		}
+
+		u64 TotalCycles() const
+		{
+			u64 Total = 0;
+			for (u64 OpcodeCycles : Cycles)
+			{
+				Total += OpcodeCycles;
+			}
+			return Total;
+		}
+
+		void BeginRun(const std::array<Instruction, 256>& Table)
+		{
+			RunTable = Table.data();
+			RunInstructions = 0;
+		}
+
+		void Fetched(const Mem&, Word, Byte) {}
+
+		void Executed(const CPU& cpu, const Mem&, Word, Byte Opcode, s32 CyclesUsed)
+		{
+			// Instructions that stopped the run never completed
+			if (cpu.PendingStop != StopReason::CyclesExhausted)
+			{
+				return;
+			}
+			Executions[Opcode]++;
+			Cycles[Opcode] += u64(CyclesUsed);
+			ExtraCycles[Opcode] += u64(CyclesUsed - RunTable[Opcode].Cycles);
+			CycleHistogram[CyclesUsed < s32(CYCLE_BUCKETS) ? CyclesUsed : CYCLE_BUCKETS - 1]++;
+			RunInstructions++;
+		}
+
+		void EndRun()
+		{
+			u32 Bucket = 0;
+			while (Bucket < RUN_BUCKETS - 1 && (RunInstructions >> Bucket) != 0)
+			{
+				Bucket++;
+			}
+			RunHistogram[Bucket]++;
+			Runs++;
+			Instructions += RunInstructions;
+		}
+
+	private:
+		const Instruction* RunTable;
+		u64 RunInstructions;
+	};
+}
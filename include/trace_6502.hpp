@@ -0,0 +1,274 @@
+#pragma once
+
+#include <atomic>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+#include <instructions_6502.hpp>
+#include <mappedfile_6502.hpp>
+#include <ring_6502.hpp>
+
+/*
+* Execution tracing.
+*
+* Tracer is an instrumentation policy (see stats_6502.hpp): pass it to
+* CPU::Run and every completed instruction is pushed as a TraceRecord into
+* a lock-free single producer/single consumer ring. A background thread
+* drains the ring into a TraceWriter, so the emulation thread only pays
+* for filling in a record. When the ring is full the emulation thread
+* waits for the writer, records are never lost.
+*
+* File format, all integers little endian:
+*  - "M65T" and a version byte.
+*  - Chunks of up to CHUNK_RECORDS encoded records. A record is a change
+*    mask, the opcode and its operand bytes, followed by only the fields
+*    the mask marks as changed:
+*     - PC when it isn't the previous PC plus the previous instruction's length,
+*     - A, X, Y, P and SP when they differ from the previous record,
+*     - the cycles used, as a varint, when they differ from the base cycles.
+*    Every chunk starts a new delta chain so it decodes on its own. Most
+*    instructions encode to 3 or 4 bytes.
+*  - The index, one TraceChunk per chunk in cycle order: its offset, size,
+*    record count, cycle range and a bitmap of the code it ran.
+*  - The index offset (u64), the chunk count (u32) and "M65I".
+* TraceReader maps the file and uses the index to find a PC or a cycle by
+* decoding only the chunks that can hold it.
+* */
+namespace m6502
+{
+	// CPU state after the instruction at PC ran
+	struct TraceRecord
+	{
+		u64 Cycle; // Cycles traced so far, including this instruction
+		Word PC;
+		Word SP;
+		Byte Opcode;
+		Byte Operand[2]; // Only the instruction's operand bytes are kept
+		Byte A, X, Y;
+		Byte P; // Packed status, CPU::GetStatus
+	};
+
+	constexpr Byte TRACE_MAGIC[4] = { 'M', '6', '5', 'T' };
+	constexpr Byte TRACE_INDEX_MAGIC[4] = { 'M', '6', '5', 'I' };
+	constexpr Byte TRACE_VERSION = 2;
+
+	// Lengths and base cycles traces are encoded with, the 65C02 table has the right length for every variant
+	inline constexpr const std::array<Instruction, 256>& TraceOpcodes = VariantOpcodeTable<CMOS65C02>;
+
+	struct TraceChunk
+	{
+		static constexpr u32 CHUNK_RECORDS = 4096;
+		// One bit per PC_BLOCK bytes of address space
+		static constexpr u32 PC_BLOCK = 64;
+		static constexpr u32 PC_BITMAP_WORDS = Mem::MAX_MEM / PC_BLOCK / 64;
+		static constexpr u32 SERIALISED_SIZE = 8 + 4 + 4 + 8 + 8 + PC_BITMAP_WORDS * 8;
+
+		u64 Offset; // From the start of the file
+		u32 Size; // Encoded bytes
+		u32 Records;
+		u64 FirstCycle; // Cycle stamps of the first and last record
+		u64 LastCycle;
+		u64 PCBitmap[PC_BITMAP_WORDS]; // Blocks that may hold a traced PC
+
+		void AddPC(Word PC)
+		{
+			const u32 Block = PC / PC_BLOCK;
+			PCBitmap[Block / 64] |= 1ull << (Block % 64);
+		}
+
+		bool MayHavePC(Word PC) const
+		{
+			const u32 Block = PC / PC_BLOCK;
+			return PCBitmap[Block / 64] & (1ull << (Block % 64));
+		}
+	};
+
+	struct TraceEncoder;
+	struct TraceDecoder;
+	struct TraceWriter;
+	using TraceRing = SPSCRing<TraceRecord>;
+	struct Tracer;
+	struct TraceReader;
+}
+
+// Delta encodes records against the previous one
+struct m6502::TraceEncoder
+{
+	void Encode(const TraceRecord& Record, std::vector<Byte>& Out);
+
+	// Starts a new delta chain, the next record is encoded against zeros
+	void Restart()
+	{
+		Previous = TraceRecord{};
+	}
+
+private:
+	TraceRecord Previous{};
+};
+
+struct m6502::TraceDecoder
+{
+	// Decodes one record at Cursor and advances it, false on a truncated record
+	bool Decode(const Byte*& Cursor, const Byte* End, TraceRecord& Record);
+
+	void Restart()
+	{
+		Previous = TraceRecord{};
+	}
+
+private:
+	TraceRecord Previous{};
+};
+
+// Writes records into chunks and the index, see the file format above
+struct m6502::TraceWriter
+{
+	TraceWriter() = default;
+	~TraceWriter();
+
+	TraceWriter(const TraceWriter&) = delete;
+	TraceWriter& operator=(const TraceWriter&) = delete;
+
+	bool Open(const char* Path);
+
+	bool IsOpen() const
+	{
+		return File != nullptr;
+	}
+
+	void Append(const TraceRecord& Record);
+
+	// Writes the last chunk and the index, false if any write since Open failed
+	bool Close();
+
+	// A write failed (disk full, I/O error), the file is missing records or its index
+	bool Failed() const
+	{
+		return WriteError;
+	}
+
+private:
+	void Write(const void* Data, u64 Size);
+	void WriteChunk();
+
+	FILE* File = nullptr;
+	bool WriteError = false;
+	u64 Offset = 0;
+	TraceEncoder Encoder;
+	std::vector<Byte> Buffer;
+	TraceChunk Current{};
+	std::vector<TraceChunk> Index;
+};
+
+struct m6502::Tracer
+{
+	static constexpr bool Enabled = true;
+	static constexpr u32 DEFAULT_RING_CAPACITY = 1 << 16;
+
+	// Check IsOpen, a tracer that couldn't open Path records nothing
+	explicit Tracer(const char* Path, u32 RingCapacity = DEFAULT_RING_CAPACITY);
+	~Tracer();
+
+	Tracer(const Tracer&) = delete;
+	Tracer& operator=(const Tracer&) = delete;
+
+	bool IsOpen() const
+	{
+		return Output.IsOpen();
+	}
+
+	// Writes out every pending record and closes the file, false if the trace couldn't be written in full
+	bool Close();
+
+	u64 Cycle = 0;
+
+	void BeginRun(const std::array<Instruction, 256>&) {}
+
+	// The operand as fetched, the instruction may overwrite it. Peeked so I/O handlers don't see a second read
+	void Fetched(const Mem& memory, Word PC, Byte Opcode)
+	{
+		const Byte Bytes = TraceOpcodes[Opcode].Bytes;
+		Operand[0] = Bytes > 1 ? memory.Peek(Word(PC + 1)) : 0;
+		Operand[1] = Bytes > 2 ? memory.Peek(Word(PC + 2)) : 0;
+	}
+
+	void Executed(const CPU& cpu, const Mem&, Word PC, Byte Opcode, s32 CyclesUsed)
+	{
+		// Instructions that stopped the run never completed
+		if (!Running || cpu.PendingStop != StopReason::CyclesExhausted)
+		{
+			return;
+		}
+		Cycle += u64(CyclesUsed);
+		const TraceRecord Record = { Cycle, PC, cpu.SP, Opcode, { Operand[0], Operand[1] }, cpu.A, cpu.X, cpu.Y, cpu.GetStatus() };
+		while (!Ring.TryPush(Record))
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	void EndRun() {}
+
+private:
+	void Write();
+
+	TraceRing Ring;
+	TraceWriter Output;
+	Byte Operand[2] = { 0, 0 }; // Of the instruction running
+	bool Running = false;
+	std::atomic<bool> Stopping{ false };
+	std::thread Writer;
+};
+
+/*
+* Reads a trace file through a read only mapping. Next walks it record by
+* record, FindExecution and StateAt only decode the chunks the index
+* points them at.
+* */
+struct m6502::TraceReader
+{
+	explicit TraceReader(const char* Path);
+
+	TraceReader(const TraceReader&) = delete;
+	TraceReader& operator=(const TraceReader&) = delete;
+
+	// False when the file couldn't be mapped or isn't a complete trace
+	bool IsOpen() const
+	{
+		return Data != nullptr;
+	}
+
+	const std::vector<TraceChunk>& Chunks() const
+	{
+		return Index;
+	}
+
+	u64 Records() const;
+
+	// The next record in file order, false at the end of the trace
+	bool Next(TraceRecord& Record);
+
+	// First record at PC that completed after cycle AfterCycle
+	bool FindExecution(Word PC, u64 AfterCycle, TraceRecord& Record) const;
+
+	// State after the last instruction completed by Cycle, false before the first one
+	bool StateAt(u64 Cycle, TraceRecord& Record) const;
+
+private:
+	bool ReadIndex();
+
+	const Byte* ChunkData(const TraceChunk& Chunk) const
+	{
+		return Data + Chunk.Offset;
+	}
+
+	MappedFile File;
+	const Byte* Data = nullptr;
+	u64 Size = 0;
+	std::vector<TraceChunk> Index;
+	// Position of Next
+	u32 NextChunk = 0;
+	const Byte* Cursor = nullptr;
+	const Byte* ChunkEnd = nullptr;
+	TraceDecoder Decoder;
+};
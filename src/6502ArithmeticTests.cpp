@@ -0,0 +1,162 @@
+#include <gtest/gtest.h>
+#include <initializer_list>
+#include "main_6502.hpp"
+#include "decimal_6502.hpp"
+
+using namespace m6502;
+
+class ArithmeticTests : public testing::Test
+{
+  public:
+    Mem mem;
+
+    virtual void SetUp()
+    {
+    }
+
+    virtual void TearDown()
+    {
+    }
+
+    // Runs Program from 0x0200 up to the JAM or illegal opcode after it
+    template <typename CPUType>
+    RunResult RunProgram(CPUType& cpu, std::initializer_list<Byte> Program)
+    {
+      cpu.Reset(mem);
+      cpu.PC = 0x0200;
+      Word Address = 0x0200;
+      for (Byte Value : Program)
+      {
+        mem[Address++] = Value;
+      }
+      mem[Address] = 0xFF;
+      return cpu.Run(1000, mem);
+    }
+};
+
+TEST_F(ArithmeticTests, DecimalTablesMatchTheReference)
+{
+  for (u32 Carry = 0; Carry < 2; Carry++)
+  {
+    for (u32 A = 0; A < 256; A++)
+    {
+      for (u32 Operand = 0; Operand < 256; Operand++)
+      {
+        const u32 Index = DecimalIndex(Byte(A), Byte(Operand), Byte(Carry));
+        const ArithmeticResult Expected[] = {
+          DecimalAdd(false, Byte(A), Byte(Operand), Byte(Carry)),
+          DecimalSubtract(false, Byte(A), Byte(Operand), Byte(Carry)),
+          DecimalAdd(true, Byte(A), Byte(Operand), Byte(Carry)),
+          DecimalSubtract(true, Byte(A), Byte(Operand), Byte(Carry)),
+        };
+        const ArithmeticResult Actual[] = {
+          NMOSDecimalAdd[Index], NMOSDecimalSubtract[Index], CMOSDecimalAdd[Index], CMOSDecimalSubtract[Index],
+        };
+        for (u32 Table = 0; Table < 4; Table++)
+        {
+          ASSERT_EQ(Actual[Table].Result, Expected[Table].Result) << Table << " " << A << " " << Operand;
+          ASSERT_EQ(Actual[Table].Flags, Expected[Table].Flags) << Table << " " << A << " " << Operand;
+        }
+      }
+    }
+  }
+}
+
+TEST_F(ArithmeticTests, DecimalAddAndSubtract)
+{
+  // Given, When: 58 + 46 + 1
+  CPU cpu;
+  RunProgram(cpu, { CPU::INS_SED, CPU::INS_SEC, CPU::INS_LDA_IM, 0x58, CPU::INS_ADC_IM, 0x46 });
+
+  // Then
+  EXPECT_EQ(cpu.A, 0x05);
+  EXPECT_TRUE(cpu.GetFlag(CPU::C_FLAG));
+
+  // When: 12 - 21, borrows
+  RunProgram(cpu, { CPU::INS_SED, CPU::INS_SEC, CPU::INS_LDA_IM, 0x12, CPU::INS_SBC_IM, 0x21 });
+
+  // Then
+  EXPECT_EQ(cpu.A, 0x91);
+  EXPECT_FALSE(cpu.GetFlag(CPU::C_FLAG));
+
+  // When: 46 - 12
+  RunProgram(cpu, { CPU::INS_SED, CPU::INS_SEC, CPU::INS_LDA_IM, 0x46, CPU::INS_SBC_IM, 0x12 });
+
+  // Then
+  EXPECT_EQ(cpu.A, 0x34);
+  EXPECT_TRUE(cpu.GetFlag(CPU::C_FLAG));
+}
+
+TEST_F(ArithmeticTests, DecimalFlagsFollowEachPart)
+{
+  // Given: 99 + 01, the binary sum is $9A
+  const std::initializer_list<Byte> Program = {
+    CPU::INS_SED, CPU::INS_CLC, CPU::INS_LDA_IM, 0x99, CPU::INS_ADC_IM, 0x01 };
+  CPU Nmos;
+  CPU65C02 Cmos;
+  CPU2A03 Ricoh;
+
+  // When
+  const RunResult NmosResult = RunProgram(Nmos, Program);
+  const RunResult CmosResult = RunProgram(Cmos, Program);
+  const RunResult RicohResult = RunProgram(Ricoh, Program);
+
+  // Then: NMOS Z comes from the binary sum and N from the half fixed sum
+  EXPECT_EQ(Nmos.A, 0x00);
+  EXPECT_TRUE(Nmos.GetFlag(CPU::C_FLAG));
+  EXPECT_FALSE(Nmos.GetFlag(CPU::Z_FLAG));
+  EXPECT_TRUE(Nmos.GetFlag(CPU::N_FLAG));
+  EXPECT_EQ(NmosResult.CyclesUsed, 2 + 2 + 2 + 2);
+  EXPECT_EQ(Cmos.A, 0x00);
+  EXPECT_TRUE(Cmos.GetFlag(CPU::C_FLAG));
+  EXPECT_TRUE(Cmos.GetFlag(CPU::Z_FLAG));
+  EXPECT_FALSE(Cmos.GetFlag(CPU::N_FLAG));
+  EXPECT_EQ(CmosResult.CyclesUsed, 2 + 2 + 2 + 3);
+  // No decimal mode on the 2A03
+  EXPECT_EQ(Ricoh.A, 0x9A);
+  EXPECT_FALSE(Ricoh.GetFlag(CPU::C_FLAG));
+  EXPECT_EQ(RicohResult.CyclesUsed, 2 + 2 + 2 + 2);
+}
+
+TEST_F(ArithmeticTests, BinaryAddAndSubtractSetCarryAndOverflow)
+{
+  // Given, When: $50 + $50
+  CPU cpu;
+  RunProgram(cpu, { CPU::INS_CLD, CPU::INS_CLC, CPU::INS_LDA_IM, 0x50, CPU::INS_ADC_IM, 0x50 });
+
+  // Then
+  EXPECT_EQ(cpu.A, 0xA0);
+  EXPECT_TRUE(cpu.GetFlag(CPU::V_FLAG));
+  EXPECT_TRUE(cpu.GetFlag(CPU::N_FLAG));
+  EXPECT_FALSE(cpu.GetFlag(CPU::C_FLAG));
+
+  // When: $50 - $B0
+  RunProgram(cpu, { CPU::INS_SEC, CPU::INS_LDA_IM, 0x50, CPU::INS_SBC_IM, 0xB0 });
+
+  // Then
+  EXPECT_EQ(cpu.A, 0xA0);
+  EXPECT_TRUE(cpu.GetFlag(CPU::V_FLAG));
+  EXPECT_FALSE(cpu.GetFlag(CPU::C_FLAG));
+
+  // When: $FF + $01
+  RunProgram(cpu, { CPU::INS_CLC, CPU::INS_LDA_IM, 0xFF, CPU::INS_ADC_IM, 0x01 });
+
+  // Then
+  EXPECT_EQ(cpu.A, 0x00);
+  EXPECT_TRUE(cpu.GetFlag(CPU::Z_FLAG));
+  EXPECT_TRUE(cpu.GetFlag(CPU::C_FLAG));
+  EXPECT_FALSE(cpu.GetFlag(CPU::V_FLAG));
+}
+
+TEST_F(ArithmeticTests, AddWithCarryAbsoluteXPaysForCrossingAPage)
+{
+  // Given, When: $05 stored at $0310 (Reset clears memory), then ADC $02F0,X with X = $20
+  CPU cpu;
+  const RunResult Result = RunProgram(cpu, {
+    CPU::INS_LDA_IM, 0x05, CPU::INS_STA_ABS, 0x10, 0x03,
+    CPU::INS_CLC, CPU::INS_LDX_IM, 0x20, CPU::INS_LDA_IM, 0x01, CPU::INS_ADC_ABSX, 0xF0, 0x02 });
+
+  // Then
+  EXPECT_EQ(cpu.A, 0x06);
+  EXPECT_EQ(Result.CyclesUsed, 2 + 4 + 2 + 2 + 2 + 5);
+}
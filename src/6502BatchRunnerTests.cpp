@@ -0,0 +1,140 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include "main_6502.hpp"
+#include "batchrunner_6502.hpp"
+
+using namespace m6502;
+
+class BatchRunnerTests : public testing::Test
+{
+  public:
+    // LDA #Value, STA $10, JAM: halts after 5 cycles
+    std::vector<Byte> Halting(Byte Value)
+    {
+      return { CPU::INS_LDA_IM, Value, CPU::INS_STA_ZP, 0x10, CPU::INS_JAM };
+    }
+
+    // LDX #Value, JMP $0202: runs out its budget
+    std::vector<Byte> Spinning(Byte Value)
+    {
+      return { CPU::INS_LDX_IM, Value, CPU::INS_JMP_ABS, 0x02, 0x02 };
+    }
+
+    BatchJob Job(const std::vector<Byte>& Image, s64 Cycles)
+    {
+      return { Image.data(), u32(Image.size()), 0x0200, 0x0200, Cycles };
+    }
+
+    virtual void SetUp()
+    {
+    }
+
+    virtual void TearDown()
+    {
+    }
+};
+
+TEST_F(BatchRunnerTests, ResultsMatchRunningEachJobAlone)
+{
+  // Given
+  std::vector<std::vector<Byte>> Images;
+  for (u32 Index = 0; Index < 300; Index++)
+  {
+    Images.push_back(Index % 3 ? Halting(Byte(Index)) : Spinning(Byte(Index)));
+  }
+  std::vector<BatchJob> Jobs;
+  for (u32 Index = 0; Index < Images.size(); Index++)
+  {
+    Jobs.push_back(Job(Images[Index], 100 + Index));
+  }
+  BatchRunner Runner(4);
+
+  // When
+  std::vector<BatchJobResult> Results;
+  Runner.Run(Jobs, Results);
+
+  // Then
+  ASSERT_EQ(Results.size(), Jobs.size());
+  u64 JobsRun = 0;
+  for (u64 Count : Runner.JobsPerWorker())
+  {
+    JobsRun += Count;
+  }
+  EXPECT_EQ(JobsRun, Jobs.size());
+  for (u32 Index = 0; Index < Jobs.size(); Index++)
+  {
+    Machine Alone;
+    Alone.cpu.Reset(Alone.mem);
+    const BatchJobResult Expected = BatchRunner::RunJob(Jobs[Index], Alone);
+    const BatchJobResult& Actual = Results[Index];
+    EXPECT_EQ(Actual.Reason, Expected.Reason);
+    EXPECT_EQ(Actual.CyclesUsed, Expected.CyclesUsed);
+    EXPECT_EQ(Actual.PC, Expected.PC);
+    EXPECT_EQ(Actual.A, Expected.A);
+    EXPECT_EQ(Actual.X, Expected.X);
+    EXPECT_EQ(Actual.MemoryDigest, Expected.MemoryDigest);
+  }
+  EXPECT_EQ(Results[1].Reason, StopReason::Halt);
+  EXPECT_EQ(Results[1].CyclesUsed, 5);
+  EXPECT_EQ(Results[1].PC, 0x0204);
+  EXPECT_EQ(Results[0].Reason, StopReason::CyclesExhausted);
+  EXPECT_GE(Results[0].CyclesUsed, 100);
+}
+
+TEST_F(BatchRunnerTests, IdleWorkersStealFromBusyOnes)
+{
+  // Given: the first half of the jobs is far longer than the second
+  const std::vector<Byte> Long = Spinning(0x01);
+  const std::vector<Byte> Short = Halting(0x02);
+  std::vector<BatchJob> Jobs;
+  for (u32 Index = 0; Index < 32; Index++)
+  {
+    Jobs.push_back(Index < 16 ? Job(Long, 200000) : Job(Short, 100));
+  }
+  BatchRunner Runner(2);
+
+  // When
+  std::vector<BatchJobResult> Results;
+  Runner.Run(Jobs, Results);
+
+  // Then: the split was 16/16, whichever worker finished first took work from the other
+  const std::vector<u64> Counts = Runner.JobsPerWorker();
+  EXPECT_EQ(Counts[0] + Counts[1], 32u);
+  EXPECT_NE(Counts[0], Counts[1]);
+  for (u32 Index = 0; Index < 32; Index++)
+  {
+    EXPECT_EQ(Results[Index].Reason, Index < 16 ? StopReason::CyclesExhausted : StopReason::Halt);
+  }
+}
+
+TEST_F(BatchRunnerTests, MachinesAreReusedCleanBetweenJobs)
+{
+  // Given: the same program twice, with a different one in between
+  const std::vector<Byte> First = Halting(0x11);
+  const std::vector<Byte> Second = Halting(0x22);
+  const std::vector<BatchJob> Jobs = { Job(First, 100), Job(Second, 100), Job(First, 100) };
+  BatchRunner Runner(1);
+
+  // When
+  std::vector<BatchJobResult> Results;
+  Runner.Run(Jobs, Results);
+
+  // Then
+  EXPECT_EQ(Results[0].MemoryDigest, Results[2].MemoryDigest);
+  EXPECT_NE(Results[0].MemoryDigest, Results[1].MemoryDigest);
+}
+
+TEST_F(BatchRunnerTests, MemoryDigestOnlyDependsOnTheContents)
+{
+  // Given
+  Mem Untouched;
+  Mem Cleared;
+  Cleared[0x1234] = 0x55;
+  Cleared[0x1234] = 0x00;
+  Mem Written;
+  Written[0x1234] = 0x55;
+
+  // Then
+  EXPECT_EQ(MemoryDigest(Untouched), MemoryDigest(Cleared));
+  EXPECT_NE(MemoryDigest(Untouched), MemoryDigest(Written));
+}
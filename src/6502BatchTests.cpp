@@ -0,0 +1,247 @@
+#include <gtest/gtest.h>
+#include <memory>
+#include "main_6502.hpp"
+#include "batch_6502.hpp"
+
+using namespace m6502;
+
+class BatchTests : public testing::Test
+{
+  public:
+    static constexpr u32 NUM_LANES = 37; // Not a multiple of the vector width
+
+    std::vector<std::unique_ptr<Mem>> Memories;
+    std::vector<CPU> CPUs;
+
+    virtual void SetUp()
+    {
+      for (u32 Lane = 0; Lane < NUM_LANES; Lane++)
+      {
+        Memories.push_back(std::make_unique<Mem>());
+        CPUs.emplace_back();
+        CPUs.back().Reset(*Memories.back());
+      }
+    }
+
+    virtual void TearDown()
+    {
+    }
+
+    // LDA abs,X / STA zp / LDX #imm / JSR to the start, with lane specific data
+    void LoadProgram(u32 Lane)
+    {
+      Mem& mem = *Memories[Lane];
+      CPUs[Lane].X = Byte(Lane * 7);
+      mem[0xFFFC] = CPU::INS_JSR;
+      mem[0xFFFD] = 0x00;
+      mem[0xFFFE] = 0x02;
+      mem[0x0200] = CPU::INS_LDA_ABSX;
+      mem[0x0201] = 0xF0;
+      mem[0x0202] = 0x40;
+      mem[0x0203] = CPU::INS_STA_ZP;
+      mem[0x0204] = 0x10;
+      mem[0x0205] = (Lane % 2) ? CPU::INS_LDX_IM : CPU::INS_LDY_IM;
+      mem[0x0206] = Byte(Lane);
+      mem[0x0207] = CPU::INS_JSR;
+      mem[0x0208] = 0x00;
+      mem[0x0209] = 0x02;
+      mem[Word(0x40F0 + Lane * 7)] = Byte(0x80 - Lane);
+      mem[Word(0x40F0 + Lane)] = Byte(Lane);
+    }
+};
+
+TEST_F(BatchTests, BatchLanesEndInTheSameStateAsSeparateCPUs)
+{
+  // Given
+  CPUBatch Batch(NUM_LANES);
+  std::vector<std::unique_ptr<Mem>> RefMemories;
+  for (u32 Lane = 0; Lane < NUM_LANES; Lane++)
+  {
+    LoadProgram(Lane);
+    Batch.SetLane(Lane, CPUs[Lane], *Memories[Lane]);
+    RefMemories.push_back(std::make_unique<Mem>(*Memories[Lane]));
+  }
+  constexpr s32 NUM_CYCLES = 100;
+
+  // When
+  Batch.Execute(NUM_CYCLES);
+
+  // Then
+  for (u32 Lane = 0; Lane < NUM_LANES; Lane++)
+  {
+    CPU Ref = CPUs[Lane];
+    const s32 RefCyclesUsed = Ref.Execute(NUM_CYCLES, *RefMemories[Lane]);
+    CPU Result;
+    Batch.GetLane(Lane, Result);
+
+    EXPECT_EQ(Batch.CyclesUsed(Lane), RefCyclesUsed);
+    EXPECT_EQ(Result.PC, Ref.PC);
+    EXPECT_EQ(Result.SP, Ref.SP);
+    EXPECT_EQ(Result.A, Ref.A);
+    EXPECT_EQ(Result.X, Ref.X);
+    EXPECT_EQ(Result.Y, Ref.Y);
+    EXPECT_EQ(Result.GetFlag(CPU::Z_FLAG), Ref.GetFlag(CPU::Z_FLAG));
+    EXPECT_EQ(Result.GetFlag(CPU::N_FLAG), Ref.GetFlag(CPU::N_FLAG));
+    EXPECT_EQ((*Memories[Lane])[0x0010], (*RefMemories[Lane])[0x0010]);
+    EXPECT_FALSE(Batch.IsHalted(Lane));
+  }
+}
+
+TEST_F(BatchTests, LockstepLanesEndInTheSameStateAsSeparateCPUs)
+{
+  // Given: one program forked into every lane, with lane specific data and flags
+  Mem Base;
+  const Byte Program[] = {
+    CPU::INS_LDA_ZPX, 0x10,
+    CPU::INS_ADC_IM, 0x37,
+    CPU::INS_SBC_ABSX, 0xF0, 0x40,
+    CPU::INS_STA_ZP, 0x20,
+    CPU::INS_SEC,
+    CPU::INS_JSR, 0x80, 0x02,
+    CPU::INS_JMP_ABS, 0x00, 0x02 };
+  const Byte Subroutine[] = {
+    CPU::INS_ADC_ZP, 0x20,
+    CPU::INS_STA_INDY, 0x30,
+    CPU::INS_CLC,
+    CPU::INS_RTS };
+  for (u32 i = 0; i < sizeof(Program); i++)
+  {
+    Base[0x0200 + i] = Program[i];
+  }
+  for (u32 i = 0; i < sizeof(Subroutine); i++)
+  {
+    Base[0x0280 + i] = Subroutine[i];
+  }
+
+  CPUBatch Batch(NUM_LANES);
+  std::vector<std::unique_ptr<Mem>> RefMemories;
+  for (u32 Lane = 0; Lane < NUM_LANES; Lane++)
+  {
+    Memories[Lane] = std::make_unique<Mem>(Base);
+    Mem& mem = *Memories[Lane];
+    CPU& cpu = CPUs[Lane];
+    cpu.PC = 0x0200;
+    cpu.X = Byte(Lane * 7);
+    cpu.Y = Byte(Lane);
+    cpu.SetFlag(CPU::D_FLAG, Lane % 4 == 1);
+    cpu.SetFlag(CPU::C_FLAG, Lane % 3 == 0);
+    mem[Word(0x10 + Lane * 7) & 0xFF] = Byte(Lane * 13);
+    mem[Word(0x40F0 + Lane * 7)] = Byte(0x80 - Lane);
+    // STA ($30),Y lands in data, except lane 6 which patches its own ADC #$37 operand
+    mem[0x30] = Lane == 6 ? 0xFD : 0x00;
+    mem[0x31] = Lane == 6 ? 0x01 : 0x50;
+    Batch.SetLane(Lane, cpu, mem);
+    RefMemories.push_back(std::make_unique<Mem>(mem));
+  }
+  constexpr s32 NUM_CYCLES = 500;
+
+  // When
+  Batch.Execute(NUM_CYCLES);
+
+  // Then
+  for (u32 Lane = 0; Lane < NUM_LANES; Lane++)
+  {
+    CPU Ref = CPUs[Lane];
+    const s32 RefCyclesUsed = Ref.Execute(NUM_CYCLES, *RefMemories[Lane]);
+    CPU Result;
+    Batch.GetLane(Lane, Result);
+
+    EXPECT_EQ(Batch.CyclesUsed(Lane), RefCyclesUsed) << "Lane " << Lane;
+    EXPECT_EQ(Result.PC, Ref.PC) << "Lane " << Lane;
+    EXPECT_EQ(Result.SP, Ref.SP) << "Lane " << Lane;
+    EXPECT_EQ(Result.A, Ref.A) << "Lane " << Lane;
+    EXPECT_EQ(Result.GetStatus(), Ref.GetStatus()) << "Lane " << Lane;
+    EXPECT_EQ((*Memories[Lane])[0x0020], (*RefMemories[Lane])[0x0020]) << "Lane " << Lane;
+    EXPECT_EQ((*Memories[Lane])[0x0203], (*RefMemories[Lane])[0x0203]) << "Lane " << Lane;
+    EXPECT_EQ((*Memories[Lane])[Word(0x5000 + Lane)], (*RefMemories[Lane])[Word(0x5000 + Lane)]) << "Lane " << Lane;
+    EXPECT_FALSE(Batch.IsHalted(Lane));
+  }
+  EXPECT_NE((*Memories[6])[0x0203], 0x37);
+}
+
+TEST_F(BatchTests, CommitArithmeticMatchesBinaryAddAndSubtract)
+{
+  // Given: every A and operand pair for a handful of lanes at a time
+  constexpr u32 COUNT = 35;
+  for (const bool Subtract : { false, true })
+  {
+    for (u32 First = 0; First < 256 * 256; First += COUNT)
+    {
+      std::vector<Byte> A(COUNT), C(COUNT), Z(COUNT, 1), V(COUNT, 1), N(COUNT, 1), Values(COUNT), Mask(COUNT);
+      for (u32 i = 0; i < COUNT; i++)
+      {
+        const u32 Pair = (First + i) % (256 * 256);
+        A[i] = Byte(Pair >> 8);
+        Values[i] = Byte(Pair);
+        C[i] = Byte(i & 1);
+        Mask[i] = (i % 5) ? 0xFF : 0x00;
+      }
+      const std::vector<Byte> OldA = A, OldC = C;
+
+      // When
+      CommitArithmetic(A.data(), C.data(), Z.data(), V.data(), N.data(), Values.data(), Mask.data(), Subtract, COUNT);
+
+      // Then
+      for (u32 i = 0; i < COUNT; i++)
+      {
+        if (!Mask[i])
+        {
+          ASSERT_EQ(A[i], OldA[i]);
+          ASSERT_EQ(C[i], OldC[i]);
+          ASSERT_EQ(Z[i] & V[i] & N[i], 1);
+          continue;
+        }
+        const ArithmeticResult Expected = Subtract ? BinarySubtract(OldA[i], Values[i], OldC[i]) : BinaryAdd(OldA[i], Values[i], OldC[i]);
+        ASSERT_EQ(A[i], Expected.Result);
+        ASSERT_EQ(C[i], (Expected.Flags & CPU::C_FLAG) != 0);
+        ASSERT_EQ(Z[i], (Expected.Flags & CPU::Z_FLAG) != 0);
+        ASSERT_EQ(V[i], (Expected.Flags & CPU::V_FLAG) != 0);
+        ASSERT_EQ(N[i], (Expected.Flags & CPU::N_FLAG) != 0);
+      }
+    }
+  }
+}
+
+TEST_F(BatchTests, LaneWithAnIllegalOpcodeHaltsWithoutStoppingTheOthers)
+{
+  // Given
+  CPUBatch Batch(2);
+  (*Memories[0])[0xFFFC] = 0xFF;
+  (*Memories[1])[0xFFFC] = CPU::INS_LDA_IM;
+  (*Memories[1])[0xFFFD] = 0x00;
+  Batch.SetLane(0, CPUs[0], *Memories[0]);
+  Batch.SetLane(1, CPUs[1], *Memories[1]);
+
+  // When
+  Batch.Execute(2);
+
+  // Then
+  EXPECT_TRUE(Batch.IsHalted(0));
+  EXPECT_FALSE(Batch.IsHalted(1));
+  EXPECT_EQ(Batch.CyclesUsed(1), 2);
+  EXPECT_EQ(Batch.Z[1], 1);
+}
+
+TEST_F(BatchTests, CommitLoadOnlyTouchesMaskedLanes)
+{
+  // Given
+  constexpr u32 COUNT = 70;
+  std::vector<Byte> Register(COUNT, 0x55), Z(COUNT, 1), N(COUNT, 1), Values(COUNT), Mask(COUNT);
+  for (u32 i = 0; i < COUNT; i++)
+  {
+    Values[i] = Byte(i * 5);
+    Mask[i] = (i % 3) ? 0xFF : 0x00;
+  }
+
+  // When
+  CommitLoad(Register.data(), Z.data(), N.data(), Values.data(), Mask.data(), COUNT);
+
+  // Then
+  for (u32 i = 0; i < COUNT; i++)
+  {
+    const bool Selected = Mask[i] != 0;
+    EXPECT_EQ(Register[i], Selected ? Values[i] : 0x55);
+    EXPECT_EQ(Z[i], Selected ? (Values[i] == 0) : 1);
+    EXPECT_EQ(N[i], Selected ? (Values[i] >> 7) : 1);
+  }
+}
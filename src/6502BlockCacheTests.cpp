@@ -0,0 +1,233 @@
+#include <gtest/gtest.h>
+#include "main_6502.hpp"
+#include "blockcache_6502.hpp"
+
+using namespace m6502;
+
+class BlockCacheTests : public testing::Test
+{
+  public:
+    Mem mem;
+    CPU cpu;
+    BlockCache cache;
+
+    virtual void SetUp()
+    {
+      cpu.Reset(mem);
+    }
+
+    virtual void TearDown()
+    {
+    }
+
+    // LDA #$11, LDX #$22, STX $0201, JSR $0200 at 0x0200, 14 cycles per loop
+    void LoadSelfModifyingLoop()
+    {
+      cpu.PC = 0x0200;
+      mem[0x0200] = CPU::INS_LDA_IM;
+      mem[0x0201] = 0x11;
+      mem[0x0202] = CPU::INS_LDX_IM;
+      mem[0x0203] = 0x22;
+      mem[0x0204] = CPU::INS_STX_ABS;
+      mem[0x0205] = 0x01;
+      mem[0x0206] = 0x02;
+      mem[0x0207] = CPU::INS_JSR;
+      mem[0x0208] = 0x00;
+      mem[0x0209] = 0x02;
+    }
+};
+
+TEST_F(BlockCacheTests, CachedExecutionMatchesTheInterpreterForAnyCycleBudget)
+{
+  // Given
+  LoadSelfModifyingLoop();
+  mem[0x0201] = 0x80;
+  mem[0x0203] = 0x80;
+
+  for (s32 NumCycles = 0; NumCycles < 60; NumCycles++)
+  {
+    Mem RefMem = mem;
+    CPU RefCPU = cpu;
+    Mem CachedMem = mem;
+    CPU CachedCPU = cpu;
+    BlockCache FreshCache;
+
+    // When
+    const s32 RefCyclesUsed = RefCPU.Execute(NumCycles, RefMem);
+    const s32 CachedCyclesUsed = CachedCPU.Execute(NumCycles, CachedMem, FreshCache);
+
+    // Then
+    EXPECT_EQ(CachedCyclesUsed, RefCyclesUsed);
+    EXPECT_EQ(CachedCPU.PC, RefCPU.PC);
+    EXPECT_EQ(CachedCPU.A, RefCPU.A);
+    EXPECT_EQ(CachedCPU.X, RefCPU.X);
+    EXPECT_EQ(CachedCPU.SP, RefCPU.SP);
+  }
+}
+
+TEST_F(BlockCacheTests, BlockIsDecodedAgainAfterItRewritesItsOwnOperand)
+{
+  // Given
+  LoadSelfModifyingLoop();
+  constexpr s32 NUM_CYCLES = 14 * 2;
+
+  // When
+  const s32 CyclesUsed = cpu.Execute(NUM_CYCLES, mem, cache);
+
+  // Then
+  EXPECT_EQ(CyclesUsed, NUM_CYCLES);
+  EXPECT_EQ(cpu.A, 0x22);
+  EXPECT_EQ(cpu.PC, 0x0200);
+}
+
+TEST_F(BlockCacheTests, HostWritesBetweenRunsInvalidateTheBlock)
+{
+  // Given
+  cpu.PC = 0x0300;
+  mem[0x0300] = CPU::INS_LDY_IM;
+  mem[0x0301] = 0x05;
+  mem[0x0302] = CPU::INS_JSR;
+  mem[0x0303] = 0x00;
+  mem[0x0304] = 0x03;
+  cpu.Execute(8, mem, cache);
+  EXPECT_EQ(cpu.Y, 0x05);
+
+  // When
+  mem[0x0301] = 0x06;
+  cpu.Execute(8, mem, cache);
+
+  // Then
+  EXPECT_EQ(cpu.Y, 0x06);
+}
+
+TEST_F(BlockCacheTests, InvalidatingLeavesTheDirtyPagesAlone)
+{
+  // Given: a cached block, then a host write to it
+  LoadSelfModifyingLoop();
+  cpu.Execute(14, mem, cache);
+  mem.ClearDirty();
+  mem[0x0203] = 0x33;
+
+  // When: the cache drops the block
+  cache.Lookup(0x0200, mem);
+
+  // Then: the Mem's own dirty set still has the write
+  EXPECT_FALSE(cache.CodeModified(mem));
+  EXPECT_TRUE(mem.IsDirty(0x02));
+  EXPECT_FALSE(mem.IsDirty(0x03));
+}
+
+TEST_F(BlockCacheTests, IllegalOpcodeIsLeftToTheInterpreter)
+{
+  // Given
+  mem[0xFFFC] = 0xFF;
+
+  // When
+  RunResult Result = cpu.Run(2, mem, cache);
+
+  // Then
+  EXPECT_EQ(Result.Reason, StopReason::IllegalOpcode);
+  EXPECT_EQ(Result.Opcode, 0xFF);
+  EXPECT_EQ(Result.PC, 0xFFFC);
+}
+
+TEST_F(BlockCacheTests, LoadsInACachedBlockSetTheFlagsAndPageCrossingCycles)
+{
+  // Given
+  cpu.X = 0xFF;
+  mem[0xFFFC] = CPU::INS_LDA_ABSX;
+  mem[0xFFFD] = 0x02;
+  mem[0xFFFE] = 0x44;
+  mem[0x4501] = 0x80;
+  constexpr s32 NUM_CYCLES = 5;
+
+  // When
+  CPU CPUCopy = cpu;
+  const s32 CyclesUsed = cpu.Execute(NUM_CYCLES, mem, cache);
+
+  // Then
+  EXPECT_EQ(CyclesUsed, NUM_CYCLES);
+  EXPECT_EQ(cpu.A, 0x80);
+  EXPECT_TRUE(cpu.GetFlag(CPU::N_FLAG));
+  EXPECT_FALSE(cpu.GetFlag(CPU::Z_FLAG));
+  EXPECT_EQ(cpu.GetFlag(CPU::C_FLAG), CPUCopy.GetFlag(CPU::C_FLAG));
+}
+
+TEST_F(BlockCacheTests, FusedPairsMatchTheInterpreterForAnyCycleBudget)
+{
+  // Given: LDA $10, STA $11, LDA #$22, STA $0300, then LDA $30FF,X,
+  // LDA $30FF,Y, LDA ($40),Y, LDA $30FF,X all crossing a page, JSR $0200
+  cpu.PC = 0x0200;
+  cpu.X = 0x01;
+  cpu.Y = 0x01;
+  mem[0x0010] = 0x30;
+  mem[0x0040] = 0xFF;
+  mem[0x0041] = 0x30;
+  mem[0x3100] = 0x80;
+  const Byte Program[] = {
+    CPU::INS_LDA_ZP, 0x10, CPU::INS_STA_ZP, 0x11,
+    CPU::INS_LDA_IM, 0x22, CPU::INS_STA_ABS, 0x00, 0x03,
+    CPU::INS_LDA_ABSX, 0xFF, 0x30, CPU::INS_LDA_ABSY, 0xFF, 0x30,
+    CPU::INS_LDA_INDY, 0x40, CPU::INS_LDA_ABSX, 0xFF, 0x30,
+    CPU::INS_JSR, 0x00, 0x02 };
+  Word Address = 0x0200;
+  for (Byte Value : Program)
+  {
+    mem[Address++] = Value;
+  }
+
+  for (s32 NumCycles = 0; NumCycles < 60; NumCycles++)
+  {
+    Mem RefMem = mem;
+    CPU RefCPU = cpu;
+    Mem FusedMem = mem;
+    CPU FusedCPU = cpu;
+    BlockCache FusedCache;
+
+    // When
+    const RunResult RefResult = RefCPU.Run(NumCycles, RefMem);
+    const RunResult FusedResult = FusedCPU.Run(NumCycles, FusedMem, FusedCache);
+
+    // Then: stops between the two halves of a pair like the interpreter
+    EXPECT_EQ(FusedResult.CyclesUsed, RefResult.CyclesUsed);
+    EXPECT_EQ(FusedCPU.PC, RefCPU.PC);
+    EXPECT_EQ(FusedCPU.A, RefCPU.A);
+    EXPECT_EQ(FusedCPU.SP, RefCPU.SP);
+    EXPECT_EQ(FusedCPU.GetStatus(), RefCPU.GetStatus());
+    EXPECT_EQ(FusedMem[0x0300], RefMem[0x0300]);
+    EXPECT_EQ(FusedMem[0x0011], RefMem[0x0011]);
+  }
+}
+
+TEST_F(BlockCacheTests, FusionCanBeTurnedOff)
+{
+  // Given: LDA #$10, STA $0300, JMP $0200
+  cpu.PC = 0x0200;
+  mem[0x0200] = CPU::INS_LDA_IM;
+  mem[0x0201] = 0x10;
+  mem[0x0202] = CPU::INS_STA_ABS;
+  mem[0x0203] = 0x00;
+  mem[0x0204] = 0x03;
+  mem[0x0205] = CPU::INS_JMP_ABS;
+  mem[0x0206] = 0x00;
+  mem[0x0207] = 0x02;
+  BlockCache Unfused(false);
+
+  // When
+  const Block& FusedBlock = cache.Lookup(0x0200, mem);
+  const Block& UnfusedBlock = Unfused.Lookup(0x0200, mem);
+
+  // Then
+  EXPECT_EQ(FusedBlock.Ops.size(), 2u);
+  EXPECT_EQ(FusedBlock.Ops[0].Bytes, 5);
+  EXPECT_EQ(FusedBlock.Ops[0].Cycles, 2 + 4);
+  EXPECT_EQ(UnfusedBlock.Ops.size(), 3u);
+  EXPECT_EQ(FusedBlock.Cycles, UnfusedBlock.Cycles);
+
+  // When
+  cache.SetFusion(false);
+
+  // Then
+  EXPECT_FALSE(cache.FusionEnabled());
+  EXPECT_EQ(cache.Lookup(0x0200, mem).Ops.size(), 3u);
+}
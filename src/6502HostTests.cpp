@@ -0,0 +1,248 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <ctime>
+#include <functional>
+#include <thread>
+#include <vector>
+#include "main_6502.hpp"
+#include "host_6502.hpp"
+
+using namespace m6502;
+
+class HostTests : public testing::Test
+{
+  public:
+    virtual void SetUp()
+    {
+    }
+
+    virtual void TearDown()
+    {
+    }
+
+    // LDA $10, STA $D000, JMP $0200: a video event every 10 cycles, the first one at cycle 7
+    void LoadEcho(EmulationThread& Host)
+    {
+      Host.cpu.Reset(Host.mem);
+      Host.cpu.PC = 0x0200;
+      Host.MapVideo(0xD0, 1);
+      Host.mem[0x0200] = CPU::INS_LDA_ZP;
+      Host.mem[0x0201] = 0x10;
+      Host.mem[0x0202] = CPU::INS_STA_ABS;
+      Host.mem[0x0203] = 0x00;
+      Host.mem[0x0204] = 0xD0;
+      Host.mem[0x0205] = CPU::INS_JMP_ABS;
+      Host.mem[0x0206] = 0x00;
+      Host.mem[0x0207] = 0x02;
+    }
+
+    // Waits up to 10 seconds for Done
+    bool WaitFor(const std::function<bool()>& Done)
+    {
+      const auto Deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+      while (!Done())
+      {
+        if (std::chrono::steady_clock::now() > Deadline)
+        {
+          return false;
+        }
+        std::this_thread::yield();
+      }
+      return true;
+    }
+
+    // Pops Count events, in order
+    std::vector<HostEvent> Pop(HostOutput& Output, u32 Count, std::chrono::microseconds Pause = {})
+    {
+      std::vector<HostEvent> Events;
+      HostEvent Event;
+      WaitFor([&] {
+        if (Output.TryPop(Event))
+        {
+          Events.push_back(Event);
+          std::this_thread::sleep_for(Pause);
+        }
+        return Events.size() == Count;
+      });
+      return Events;
+    }
+};
+
+TEST_F(HostTests, InputLandsOnItsCycleAndOutputIsStamped)
+{
+  // Given
+  EmulationThread::Config Settings;
+  Settings.VideoPolicy = Backpressure::Stretch;
+  EmulationThread Host(Settings);
+  LoadEcho(Host);
+  ASSERT_TRUE(Host.PostInput({ 5000, 0x0010, 0x42 }));
+
+  // When
+  Host.Start();
+  const std::vector<HostEvent> Events = Pop(Host.Video, 520);
+  Host.Stop();
+
+  // Then: nothing lost or reordered, the value shows up on the first pass after cycle 5000
+  ASSERT_EQ(Events.size(), 520u);
+  for (u32 Index = 0; Index < Events.size(); Index++)
+  {
+    EXPECT_EQ(Events[Index].Cycle, 7u + 10u * Index);
+    EXPECT_EQ(Events[Index].Address, 0xD000);
+    EXPECT_EQ(Events[Index].Value, Events[Index].Cycle < 5000 ? 0x00 : 0x42);
+  }
+}
+
+TEST_F(HostTests, StretchWaitsForASlowConsumer)
+{
+  // Given
+  EmulationThread::Config Settings;
+  Settings.VideoCapacity = 8;
+  Settings.VideoPolicy = Backpressure::Stretch;
+  EmulationThread Host(Settings);
+  LoadEcho(Host);
+
+  // When
+  Host.Start();
+  const std::vector<HostEvent> Events = Pop(Host.Video, 64, std::chrono::microseconds(200));
+  const u64 CycleAfterPopping = Host.Cycle();
+  Host.Stop();
+
+  // Then: emulation only got a ring's worth ahead of the consumer
+  ASSERT_EQ(Events.size(), 64u);
+  for (u32 Index = 0; Index < Events.size(); Index++)
+  {
+    EXPECT_EQ(Events[Index].Cycle, 7u + 10u * Index);
+  }
+  EXPECT_LT(CycleAfterPopping, 7u + 10u * (64 + 8 + 2));
+  EXPECT_EQ(Host.Video.Dropped(), 0u);
+}
+
+TEST_F(HostTests, BlockWaitsForASlowConsumerAndStopReleasesIt)
+{
+  // Given
+  EmulationThread::Config Settings;
+  Settings.VideoCapacity = 4;
+  Settings.VideoPolicy = Backpressure::Block;
+  EmulationThread Host(Settings);
+  LoadEcho(Host);
+
+  // When
+  Host.Start();
+  const std::vector<HostEvent> Events = Pop(Host.Video, 32, std::chrono::microseconds(200));
+
+  // Then
+  ASSERT_EQ(Events.size(), 32u);
+  for (u32 Index = 0; Index < Events.size(); Index++)
+  {
+    EXPECT_EQ(Events[Index].Cycle, 7u + 10u * Index);
+  }
+
+  // When: nobody consumes any more, the emulation thread is stuck in a write
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  Host.Stop();
+
+  // Then
+  EXPECT_FALSE(Host.IsRunning());
+}
+
+TEST_F(HostTests, DropKeepsEmulationGoing)
+{
+  // Given
+  EmulationThread::Config Settings;
+  Settings.VideoCapacity = 16;
+  Settings.VideoPolicy = Backpressure::Drop;
+  EmulationThread Host(Settings);
+  LoadEcho(Host);
+
+  // When
+  Host.Start();
+  ASSERT_TRUE(WaitFor([&] { return Host.Cycle() > 100000; }));
+  Host.Stop();
+
+  // Then: the ring holds the oldest events, the rest were counted
+  const std::vector<HostEvent> Events = Pop(Host.Video, 16);
+  HostEvent Extra;
+  EXPECT_FALSE(Host.Video.TryPop(Extra));
+  ASSERT_EQ(Events.size(), 16u);
+  EXPECT_EQ(Events[0].Cycle, 7u);
+  EXPECT_EQ(Events[15].Cycle, 7u + 10u * 15);
+  EXPECT_GT(Host.Video.Dropped(), 10000u - 16u);
+}
+
+TEST_F(HostTests, ProgramStopIsReported)
+{
+  // Given: writes an audio sample and halts
+  EmulationThread Host;
+  Host.cpu.Reset(Host.mem);
+  Host.cpu.PC = 0x0200;
+  Host.MapAudio(0xD4, 1);
+  Host.mem[0x0200] = CPU::INS_LDA_IM;
+  Host.mem[0x0201] = 0x7F;
+  Host.mem[0x0202] = CPU::INS_STA_ABS;
+  Host.mem[0x0203] = 0x00;
+  Host.mem[0x0204] = 0xD4;
+  Host.mem[0x0205] = CPU::INS_JAM;
+
+  // When
+  Host.Start();
+  ASSERT_TRUE(WaitFor([&] { return Host.ProgramStop() != StopReason::CyclesExhausted; }));
+  Host.Stop();
+
+  // Then
+  EXPECT_EQ(Host.ProgramStop(), StopReason::Halt);
+  EXPECT_EQ(Host.Cycle(), 6u);
+  EXPECT_EQ(Host.cpu.PC, 0x0205);
+  HostEvent Sample;
+  ASSERT_TRUE(Host.Audio.TryPop(Sample));
+  EXPECT_EQ(Sample.Cycle, 6u);
+  EXPECT_EQ(Sample.Address, 0xD400);
+  EXPECT_EQ(Sample.Value, 0x7F);
+}
+
+TEST_F(HostTests, AHaltedMachineWaitsWithoutSpinning)
+{
+  // Given
+  EmulationThread Host;
+  Host.cpu.Reset(Host.mem);
+  Host.cpu.PC = 0x0200;
+  Host.mem[0x0200] = CPU::INS_JAM;
+  Host.Start();
+  ASSERT_TRUE(WaitFor([&] { return Host.ProgramStop() == StopReason::Halt; }));
+
+  // When
+  const std::clock_t CPUBefore = std::clock();
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  const double CPUSeconds = double(std::clock() - CPUBefore) / CLOCKS_PER_SEC;
+  Host.Stop();
+
+  // Then: well under the 0.2s a spinning thread would take
+  EXPECT_LT(CPUSeconds, 0.05);
+}
+
+TEST_F(HostTests, StoppedMachineRestartsCleanly)
+{
+  // Given: halted, with input still pending for a cycle it never reached
+  EmulationThread Host;
+  Host.cpu.Reset(Host.mem);
+  Host.cpu.PC = 0x0200;
+  Host.mem[0x0200] = CPU::INS_JAM;
+  ASSERT_TRUE(Host.PostInput({ 1000, 0x0010, 0x42 }));
+  Host.Start();
+  ASSERT_TRUE(WaitFor([&] { return Host.ProgramStop() == StopReason::Halt; }));
+  Host.Stop();
+
+  // When: reloaded with the echo program
+  LoadEcho(Host);
+  Host.Start();
+  const std::vector<HostEvent> Events = Pop(Host.Video, 200);
+  Host.Stop();
+
+  // Then: running again from cycle 0, the old input is gone
+  EXPECT_EQ(Host.ProgramStop(), StopReason::CyclesExhausted);
+  ASSERT_EQ(Events.size(), 200u);
+  for (u32 Index = 0; Index < Events.size(); Index++)
+  {
+    EXPECT_EQ(Events[Index].Cycle, 7u + 10u * Index);
+    EXPECT_EQ(Events[Index].Value, 0x00);
+  }
+}
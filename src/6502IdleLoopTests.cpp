@@ -0,0 +1,176 @@
+#include <gtest/gtest.h>
+#include <functional>
+#include "main_6502.hpp"
+#include "blockcache_6502.hpp"
+
+using namespace m6502;
+
+class IdleLoopTests : public testing::Test
+{
+  public:
+    struct Port
+    {
+      u32 Reads = 0;
+
+      static Byte Read(void* Context, Word)
+      {
+        static_cast<Port*>(Context)->Reads++;
+        return 0x00;
+      }
+
+      static void Write(void*, Word, Byte)
+      {
+      }
+    };
+
+    // Interpreted and cached runs of the same program from the same state
+    Mem InterpretedMem, CachedMem;
+    CPU Interpreted, Cached;
+    BlockCache cache;
+    Port InterpretedPort, CachedPort;
+
+    virtual void SetUp()
+    {
+      Interpreted.Reset(InterpretedMem);
+      Cached.Reset(CachedMem);
+      InterpretedMem.MapIO(0xD0, 1, &Port::Read, &Port::Write, &InterpretedPort);
+      CachedMem.MapIO(0xD0, 1, &Port::Read, &Port::Write, &CachedPort);
+    }
+
+    virtual void TearDown()
+    {
+    }
+
+    void Load(const std::function<void(CPU&, Mem&)>& Program)
+    {
+      Program(Interpreted, InterpretedMem);
+      Program(Cached, CachedMem);
+      cache.Flush();
+    }
+
+    // Runs both for Cycles and checks they agree
+    void RunBoth(s32 Cycles)
+    {
+      const RunResult Expected = Interpreted.Run(Cycles, InterpretedMem);
+      const RunResult Actual = Cached.Run(Cycles, CachedMem, cache);
+      EXPECT_EQ(Actual.CyclesUsed, Expected.CyclesUsed) << Cycles;
+      EXPECT_TRUE(Cached.SameState(Interpreted)) << Cycles;
+      EXPECT_EQ(CachedPort.Reads, InterpretedPort.Reads) << Cycles;
+    }
+};
+
+TEST_F(IdleLoopTests, JumpToSelfEndsWithTheInterpretedStateAndCycles)
+{
+  // Given, JMP $0200
+  Load([](CPU& cpu, Mem& mem)
+  {
+    cpu.PC = 0x0200;
+    mem[0x0200] = CPU::INS_JMP_ABS;
+    mem[0x0201] = 0x00;
+    mem[0x0202] = 0x02;
+  });
+
+  // When, Then
+  for (s32 Cycles = 1; Cycles < 20; Cycles++)
+  {
+    RunBoth(Cycles);
+  }
+  RunBoth(1000001);
+}
+
+TEST_F(IdleLoopTests, PollingLoopEndsWithTheInterpretedStateAndCycles)
+{
+  // Given, LDX $10 / LDA $0300,X (crosses a page) / JMP $0200, 12 cycles a pass
+  Load([](CPU& cpu, Mem& mem)
+  {
+    cpu.PC = 0x0200;
+    mem[0x0010] = 0xF0;
+    mem[0x03F5] = 0x80;
+    mem[0x0200] = CPU::INS_LDX_ZP;
+    mem[0x0201] = 0x10;
+    mem[0x0202] = CPU::INS_LDA_ABSX;
+    mem[0x0203] = 0x05;
+    mem[0x0204] = 0x03;
+    mem[0x0205] = CPU::INS_JMP_ABS;
+    mem[0x0206] = 0x00;
+    mem[0x0207] = 0x02;
+  });
+
+  // When, Then
+  for (s32 Cycles = 1; Cycles < 40; Cycles++)
+  {
+    RunBoth(Cycles);
+  }
+  RunBoth(999999);
+}
+
+TEST_F(IdleLoopTests, LoopThatSettlesOverSeveralPassesStaysExact)
+{
+  // Given, LDX $20,X walks 1 -> 2 -> 3 -> 3, then the loop is idle
+  Load([](CPU& cpu, Mem& mem)
+  {
+    cpu.PC = 0x0200;
+    cpu.X = 0x01;
+    mem[0x0021] = 0x02;
+    mem[0x0022] = 0x03;
+    mem[0x0023] = 0x03;
+    mem[0x0200] = CPU::INS_LDX_ZPY;
+    mem[0x0201] = 0x20;
+    mem[0x0202] = CPU::INS_LDY_IM;
+    mem[0x0203] = 0x00;
+    mem[0x0204] = CPU::INS_JMP_ABS;
+    mem[0x0205] = 0x00;
+    mem[0x0206] = 0x02;
+  });
+
+  // When, Then
+  for (s32 Cycles = 1; Cycles < 60; Cycles += 3)
+  {
+    RunBoth(Cycles);
+  }
+  RunBoth(123457);
+}
+
+TEST_F(IdleLoopTests, LoopPollingIOIsInterpreted)
+{
+  // Given, LDA $D000 / JMP $0200
+  Load([](CPU& cpu, Mem& mem)
+  {
+    cpu.PC = 0x0200;
+    mem[0x0200] = CPU::INS_LDA_ABS;
+    mem[0x0201] = 0x00;
+    mem[0x0202] = 0xD0;
+    mem[0x0203] = CPU::INS_JMP_ABS;
+    mem[0x0204] = 0x00;
+    mem[0x0205] = 0x02;
+  });
+
+  // When
+  RunBoth(7000);
+
+  // Then, every pass read the port
+  EXPECT_EQ(CachedPort.Reads, 1000u);
+}
+
+TEST_F(IdleLoopTests, HugeBudgetsOnIdleLoopsAreSkipped)
+{
+  // Given
+  Load([](CPU& cpu, Mem& mem)
+  {
+    cpu.PC = 0x0200;
+    mem[0x0200] = CPU::INS_LDA_ZP;
+    mem[0x0201] = 0x10;
+    mem[0x0202] = CPU::INS_JMP_ABS;
+    mem[0x0203] = 0x00;
+    mem[0x0204] = 0x02;
+  });
+
+  // When, interpreting this many 6 cycle passes would take seconds
+  constexpr s32 NUM_CYCLES = 2000000001; // 3 past a whole pass
+  RunResult Result = Cached.Run(NUM_CYCLES, CachedMem, cache);
+
+  // Then, the run stops on the first instruction boundary past the budget, after LDA
+  EXPECT_EQ(Result.Reason, StopReason::CyclesExhausted);
+  EXPECT_EQ(Result.CyclesUsed, NUM_CYCLES);
+  EXPECT_EQ(Cached.PC, 0x0202);
+}
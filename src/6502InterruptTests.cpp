@@ -0,0 +1,238 @@
+#include <gtest/gtest.h>
+#include <functional>
+#include <vector>
+#include "main_6502.hpp"
+#include "blockcache_6502.hpp"
+
+using namespace m6502;
+
+class InterruptTests : public testing::Test
+{
+  public:
+    // Writing a non zero value to $D000 asserts IRQ, zero releases it
+    struct Device
+    {
+      CPU* cpu = nullptr;
+      std::vector<Word> Reads;
+
+      static Byte Read(void* Context, Word Address)
+      {
+        static_cast<Device*>(Context)->Reads.push_back(Address);
+        return 0x00;
+      }
+
+      static void Write(void* Context, Word, Byte Value)
+      {
+        static_cast<Device*>(Context)->cpu->SetIRQ(0x01, Value != 0);
+      }
+    };
+
+    Mem mem;
+    CPU cpu;
+    Device Port;
+
+    virtual void SetUp()
+    {
+      cpu.Reset(mem);
+      cpu.PC = 0x0200;
+      Port.cpu = &cpu;
+      mem.MapIO(0xD0, 1, &Device::Read, &Device::Write, &Port);
+      // IRQ and BRK at 0x0400, NMI at 0x0500
+      mem[0xFFFE] = 0x00;
+      mem[0xFFFF] = 0x04;
+      mem[0xFFFA] = 0x00;
+      mem[0xFFFB] = 0x05;
+    }
+
+    virtual void TearDown()
+    {
+    }
+
+    // JMP $0200 forever
+    void LoadSpin()
+    {
+      mem[0x0200] = CPU::INS_JMP_ABS;
+      mem[0x0201] = 0x00;
+      mem[0x0202] = 0x02;
+    }
+
+    // LDA Address then RTI at Handler, 10 cycles
+    void LoadReadingHandler(Word Handler, Word Address)
+    {
+      mem[Handler] = CPU::INS_LDA_ABS;
+      mem[Handler + 1] = Byte(Address);
+      mem[Handler + 2] = Byte(Address >> 8);
+      mem[Handler + 3] = CPU::INS_RTI;
+    }
+};
+
+TEST_F(InterruptTests, BreakPushesStateAndReturnsPastItsPaddingByte)
+{
+  // Given
+  mem[0x0200] = CPU::INS_BRK;
+  mem[0x0201] = 0xFF; // Padding
+  mem[0x0202] = CPU::INS_LDA_IM;
+  mem[0x0203] = 0x22;
+  mem[0x0204] = CPU::INS_JAM;
+  mem[0x0400] = CPU::INS_LDX_IM;
+  mem[0x0401] = 0x01;
+  mem[0x0402] = CPU::INS_RTI;
+
+  // When
+  const RunResult InHandler = cpu.Run(9, mem);
+  const bool IMasked = cpu.GetFlag(CPU::I_FLAG);
+  const RunResult Result = cpu.Run(100, mem);
+
+  // Then
+  EXPECT_EQ(InHandler.PC, 0x0402);
+  EXPECT_TRUE(IMasked);
+  EXPECT_EQ(mem[0x0100], 0x02);
+  EXPECT_EQ(mem[0x01FF], 0x02);
+  EXPECT_TRUE(mem[0x01FE] & CPU::B_FLAG);
+  EXPECT_EQ(Result.Reason, StopReason::Halt);
+  EXPECT_EQ(Result.CyclesUsed, 6 + 2);
+  EXPECT_EQ(Result.PC, 0x0204);
+  EXPECT_EQ(cpu.A, 0x22);
+  EXPECT_EQ(cpu.X, 0x01);
+  EXPECT_EQ(cpu.SP, 0x0100);
+  EXPECT_FALSE(cpu.GetFlag(CPU::I_FLAG));
+  EXPECT_FALSE(cpu.GetFlag(CPU::B_FLAG));
+}
+
+TEST_F(InterruptTests, BreakInsideASubroutineKeepsItsReturnAddress)
+{
+  // Given: JSR $0300, JAM; the subroutine BRKs and returns
+  mem[0x0200] = CPU::INS_JSR;
+  mem[0x0201] = 0x00;
+  mem[0x0202] = 0x03;
+  mem[0x0203] = CPU::INS_JAM;
+  mem[0x0300] = CPU::INS_BRK;
+  mem[0x0301] = 0xFF; // Padding
+  mem[0x0302] = CPU::INS_RTS;
+  mem[0x0400] = CPU::INS_RTI;
+
+  // When
+  const RunResult Result = cpu.Run(100, mem);
+
+  // Then
+  EXPECT_EQ(Result.Reason, StopReason::Halt);
+  EXPECT_EQ(Result.PC, 0x0203);
+  EXPECT_EQ(Result.CyclesUsed, 6 + 7 + 6 + 6);
+  EXPECT_EQ(cpu.SP, 0x0100);
+}
+
+TEST_F(InterruptTests, IRQRaisedByAnInstructionIsTakenOnceItCompletes)
+{
+  // Given: the handler acknowledges the device
+  mem[0x0200] = CPU::INS_LDA_IM;
+  mem[0x0201] = 0x01;
+  mem[0x0202] = CPU::INS_STA_ABS;
+  mem[0x0203] = 0x00;
+  mem[0x0204] = 0xD0;
+  mem[0x0205] = CPU::INS_LDA_IM;
+  mem[0x0206] = 0x22;
+  mem[0x0207] = CPU::INS_JAM;
+  mem[0x0400] = CPU::INS_LDY_IM;
+  mem[0x0401] = 0x00;
+  mem[0x0402] = CPU::INS_STY_ABS;
+  mem[0x0403] = 0x00;
+  mem[0x0404] = 0xD0;
+  mem[0x0405] = CPU::INS_LDX_IM;
+  mem[0x0406] = 0x01;
+  mem[0x0407] = CPU::INS_RTI;
+  const CPU Start = cpu;
+  const Mem Program = mem;
+
+  BlockCache cache;
+  RunControl Control;
+  const std::function<RunResult()> Runs[] = {
+    [&] { return cpu.Run(100, mem); },
+    [&] { return cpu.Run(100, mem, cache); },
+    [&] { return cpu.Run(100, mem, Control); },
+  };
+  for (const std::function<RunResult()>& Run : Runs)
+  {
+    cpu = Start;
+    mem = Program;
+
+    // When
+    const RunResult Result = Run();
+
+    // Then: LDA, STA, interrupt, LDY, STY, LDX, RTI, LDA
+    EXPECT_EQ(Result.Reason, StopReason::Halt);
+    EXPECT_EQ(Result.CyclesUsed, 2 + 4 + 7 + 2 + 4 + 2 + 6 + 2);
+    EXPECT_EQ(Result.PC, 0x0207);
+    EXPECT_EQ(mem[0x01FF], 0x05); // Returns to the LDA after the STA
+    EXPECT_FALSE(mem[0x01FE] & CPU::B_FLAG);
+    EXPECT_EQ(cpu.A, 0x22);
+    EXPECT_EQ(cpu.X, 0x01);
+    EXPECT_EQ(cpu.IRQLines, 0x00);
+  }
+}
+
+TEST_F(InterruptTests, IRQIsLevelTriggeredAndMaskedByI)
+{
+  // Given: a handler that never acknowledges
+  LoadSpin();
+  LoadReadingHandler(0x0400, 0xD000);
+  cpu.SetFlag(CPU::I_FLAG, true);
+  cpu.SetIRQ(0x01, true);
+
+  // When
+  const RunResult Masked = cpu.Run(100, mem);
+  cpu.SetFlag(CPU::I_FLAG, false);
+  const RunResult Taken = cpu.Run(170, mem);
+
+  // Then: RTI lets the still asserted IRQ straight back in
+  EXPECT_EQ(Masked.PC, 0x0200);
+  EXPECT_EQ(Taken.CyclesUsed, 170);
+  EXPECT_EQ(Port.Reads.size(), 10u);
+  EXPECT_EQ(cpu.PC, 0x0200);
+  EXPECT_TRUE(cpu.InterruptPending());
+}
+
+TEST_F(InterruptTests, NMIIsEdgeTriggeredAndTakesPriority)
+{
+  // Given
+  LoadSpin();
+  LoadReadingHandler(0x0400, 0xD000);
+  LoadReadingHandler(0x0500, 0xD001);
+  cpu.SetFlag(CPU::I_FLAG, true);
+  cpu.SetNMI(true);
+
+  // When: I doesn't mask NMI, holding the line doesn't retrigger it
+  cpu.Run(100, mem);
+
+  // Then
+  EXPECT_EQ(Port.Reads, (std::vector<Word>{ 0xD001 }));
+
+  // When: both pending
+  cpu.SetFlag(CPU::I_FLAG, false);
+  cpu.SetNMI(false);
+  cpu.SetIRQ(0x02, true);
+  cpu.SetNMI(true);
+  cpu.Run(34, mem);
+
+  // Then: NMI first, IRQ after its RTI
+  EXPECT_EQ(Port.Reads, (std::vector<Word>{ 0xD001, 0xD001, 0xD000 }));
+}
+
+TEST_F(InterruptTests, InterruptPendingAtTheEndOfTheBudgetWaitsForTheNextRun)
+{
+  // Given
+  mem[0x0200] = CPU::INS_LDA_IM;
+  mem[0x0201] = 0x01;
+  mem[0x0202] = CPU::INS_STA_ABS;
+  mem[0x0203] = 0x00;
+  mem[0x0204] = 0xD0;
+
+  // When
+  const RunResult First = cpu.Run(6, mem);
+  const RunResult Second = cpu.Run(7, mem);
+
+  // Then
+  EXPECT_EQ(First.CyclesUsed, 6);
+  EXPECT_EQ(First.PC, 0x0205);
+  EXPECT_EQ(Second.CyclesUsed, 7);
+  EXPECT_EQ(Second.PC, 0x0400);
+}
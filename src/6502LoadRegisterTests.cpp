@@ -21,11 +21,11 @@ class LoadRegisterTests : public testing::Test
 
     void VerifyUnmodifiedFlagsFromLDAXY(const CPU& CPUCopy)
     {
-      EXPECT_EQ(cpu.C, CPUCopy.C);
-      EXPECT_EQ(cpu.I, CPUCopy.I);
-      EXPECT_EQ(cpu.D, CPUCopy.D);
-      EXPECT_EQ(cpu.B, CPUCopy.B);
-      EXPECT_EQ(cpu.V, CPUCopy.V);
+      EXPECT_EQ(cpu.GetFlag(CPU::C_FLAG), CPUCopy.GetFlag(CPU::C_FLAG));
+      EXPECT_EQ(cpu.GetFlag(CPU::I_FLAG), CPUCopy.GetFlag(CPU::I_FLAG));
+      EXPECT_EQ(cpu.GetFlag(CPU::D_FLAG), CPUCopy.GetFlag(CPU::D_FLAG));
+      EXPECT_EQ(cpu.GetFlag(CPU::B_FLAG), CPUCopy.GetFlag(CPU::B_FLAG));
+      EXPECT_EQ(cpu.GetFlag(CPU::V_FLAG), CPUCopy.GetFlag(CPU::V_FLAG));
     }
     
     void TestLoadRegisterImmediate(m6502::Byte OpCodeToTest, m6502::Byte m6502::CPU::*RegisterToTest);
@@ -42,8 +42,8 @@ class LoadRegisterTests : public testing::Test
 void LoadRegisterTests::TestLoadRegisterImmediate(m6502::Byte OpCodeToTest, m6502::Byte m6502::CPU::*RegisterToTest)
 {
   // Given
-  cpu.Z = true;
-  cpu.N = false;
+  cpu.SetFlag(CPU::Z_FLAG, true);
+  cpu.SetFlag(CPU::N_FLAG, false);
   mem[0xFFFC] = OpCodeToTest;
   mem[0xFFFD] = 0x84;
   constexpr u32 NUM_CYCLES = 2;
@@ -55,15 +55,15 @@ void LoadRegisterTests::TestLoadRegisterImmediate(m6502::Byte OpCodeToTest, m650
   // Then
   EXPECT_EQ(cpu.*RegisterToTest, 0x84);
   EXPECT_EQ(CyclesUsed, NUM_CYCLES);
-  EXPECT_FALSE(cpu.Z);
-  EXPECT_TRUE(cpu.N);
+  EXPECT_FALSE(cpu.GetFlag(CPU::Z_FLAG));
+  EXPECT_TRUE(cpu.GetFlag(CPU::N_FLAG));
   VerifyUnmodifiedFlagsFromLDAXY(CPUCopy);
 }
 
 void LoadRegisterTests::TestLoadZeroPage(m6502::Byte OpCodeToTest, m6502::Byte m6502::CPU::*RegisterToTest)
 {
-  cpu.Z = true;
-  cpu.N = true;
+  cpu.SetFlag(CPU::Z_FLAG, true);
+  cpu.SetFlag(CPU::N_FLAG, true);
   // Given
   mem[0xFFFC] = OpCodeToTest;
   mem[0xFFFD] = 0x42;
@@ -77,16 +77,16 @@ void LoadRegisterTests::TestLoadZeroPage(m6502::Byte OpCodeToTest, m6502::Byte m
   // Then
   EXPECT_EQ(cpu.*RegisterToTest, 0x37);
   EXPECT_EQ(CyclesUsed, NUM_CYCLES);
-  EXPECT_FALSE(cpu.Z);
-  EXPECT_FALSE(cpu.N);
+  EXPECT_FALSE(cpu.GetFlag(CPU::Z_FLAG));
+  EXPECT_FALSE(cpu.GetFlag(CPU::N_FLAG));
   VerifyUnmodifiedFlagsFromLDAXY(CPUCopy);
 }
 
 void LoadRegisterTests::TestLoadZeroPageOtherRegister(m6502::Byte OpCodeToTest, m6502::Byte m6502::CPU::*RegisterToTest, m6502::Byte m6502::CPU::*OtherRegister)
 {
   // Given
-  cpu.Z = true;
-  cpu.N = true;
+  cpu.SetFlag(CPU::Z_FLAG, true);
+  cpu.SetFlag(CPU::N_FLAG, true);
   cpu.*OtherRegister = 5;
   mem[0xFFFC] = OpCodeToTest;
   mem[0xFFFD] = 0x42;
@@ -100,16 +100,16 @@ void LoadRegisterTests::TestLoadZeroPageOtherRegister(m6502::Byte OpCodeToTest,
   // Then
   EXPECT_EQ(cpu.*RegisterToTest, 0x37);
   EXPECT_EQ(CyclesUsed, NUM_CYCLES);
-  EXPECT_FALSE(cpu.Z);
-  EXPECT_FALSE(cpu.N);
+  EXPECT_FALSE(cpu.GetFlag(CPU::Z_FLAG));
+  EXPECT_FALSE(cpu.GetFlag(CPU::N_FLAG));
   VerifyUnmodifiedFlagsFromLDAXY(CPUCopy);
 }
 
 void LoadRegisterTests::TestLoadZeroPageAfterWrap(m6502::Byte OpCodeToTest, m6502::Byte m6502::CPU::*RegisterToTest, m6502::Byte m6502::CPU::*OtherRegister)
 {
   // Given
-  cpu.Z = true;
-  cpu.N = true;
+  cpu.SetFlag(CPU::Z_FLAG, true);
+  cpu.SetFlag(CPU::N_FLAG, true);
   cpu.*OtherRegister = 0xFF;
   mem[0xFFFC] = OpCodeToTest;
   mem[0xFFFD] = 0x80;
@@ -123,16 +123,16 @@ void LoadRegisterTests::TestLoadZeroPageAfterWrap(m6502::Byte OpCodeToTest, m650
   // Then
   EXPECT_EQ(cpu.*RegisterToTest, 0x37);
   EXPECT_EQ(CyclesUsed, NUM_CYCLES);
-  EXPECT_FALSE(cpu.Z);
-  EXPECT_FALSE(cpu.N);
+  EXPECT_FALSE(cpu.GetFlag(CPU::Z_FLAG));
+  EXPECT_FALSE(cpu.GetFlag(CPU::N_FLAG));
   VerifyUnmodifiedFlagsFromLDAXY(CPUCopy);
 }
 
 void LoadRegisterTests::TestLoadAbsoluteCanLoadValueIntoRegister(m6502::Byte OpCode, m6502::Byte m6502::CPU::*Register)
 {
   // Given
-  cpu.Z = true;
-  cpu.N = true;
+  cpu.SetFlag(CPU::Z_FLAG, true);
+  cpu.SetFlag(CPU::N_FLAG, true);
   mem[0xFFFC] = OpCode;
   mem[0xFFFD] = 0x80;
   mem[0xFFFE] = 0x44;
@@ -146,16 +146,16 @@ void LoadRegisterTests::TestLoadAbsoluteCanLoadValueIntoRegister(m6502::Byte OpC
   // Then
   EXPECT_EQ(cpu.*Register, 0x37);
   EXPECT_EQ(CyclesUsed, NUM_CYCLES);
-  EXPECT_FALSE(cpu.N);
-  EXPECT_FALSE(cpu.Z);
+  EXPECT_FALSE(cpu.GetFlag(CPU::N_FLAG));
+  EXPECT_FALSE(cpu.GetFlag(CPU::Z_FLAG));
   VerifyUnmodifiedFlagsFromLDAXY(CPUCopy);
 }
 
 void LoadRegisterTests::TestLoadAbsoluteRegisterCanLoadValueIntoRegister(m6502::Byte OpCodeToTest, m6502::Byte m6502::CPU::*RegisterToTest, m6502::Byte m6502::CPU::*OtherRegister)
 {
   // Given
-  cpu.Z = true;
-  cpu.N = true;
+  cpu.SetFlag(CPU::Z_FLAG, true);
+  cpu.SetFlag(CPU::N_FLAG, true);
   cpu.*OtherRegister = 1;
   mem[0xFFFC] = OpCodeToTest;
   mem[0xFFFD] = 0x80;
@@ -170,16 +170,16 @@ void LoadRegisterTests::TestLoadAbsoluteRegisterCanLoadValueIntoRegister(m6502::
   // Then
   EXPECT_EQ(cpu.*RegisterToTest, 0x37);
   EXPECT_EQ(CyclesUsed, NUM_CYCLES);
-  EXPECT_FALSE(cpu.N);
-  EXPECT_FALSE(cpu.Z);
+  EXPECT_FALSE(cpu.GetFlag(CPU::N_FLAG));
+  EXPECT_FALSE(cpu.GetFlag(CPU::Z_FLAG));
   VerifyUnmodifiedFlagsFromLDAXY(CPUCopy);
 }
 
 void LoadRegisterTests::TestLoadAbsoluteCrossesPageBoundary(m6502::Byte OpCodeToTest, m6502::Byte m6502::CPU::*RegisterToTest, m6502::Byte m6502::CPU::*OtherRegister)
 {
   // Given
-  cpu.Z = true;
-  cpu.N = true;
+  cpu.SetFlag(CPU::Z_FLAG, true);
+  cpu.SetFlag(CPU::N_FLAG, true);
   cpu.*OtherRegister = 0xFF;
   mem[0xFFFC] = OpCodeToTest;
   mem[0xFFFD] = 0x02;
@@ -194,16 +194,16 @@ void LoadRegisterTests::TestLoadAbsoluteCrossesPageBoundary(m6502::Byte OpCodeTo
   // Then
   EXPECT_EQ(cpu.*RegisterToTest, 0x37);
   EXPECT_EQ(CyclesUsed, NUM_CYCLES);
-  EXPECT_FALSE(cpu.N);
-  EXPECT_FALSE(cpu.Z);
+  EXPECT_FALSE(cpu.GetFlag(CPU::N_FLAG));
+  EXPECT_FALSE(cpu.GetFlag(CPU::Z_FLAG));
   VerifyUnmodifiedFlagsFromLDAXY(CPUCopy);
 }
 
 void LoadRegisterTests::TestOpCanAffectZeroFlag(m6502::Byte OpCodeToTest, m6502::Byte m6502::CPU::*RegisterToTest)
 {
   // Given
-  cpu.Z = false;
-  cpu.N = true;
+  cpu.SetFlag(CPU::Z_FLAG, false);
+  cpu.SetFlag(CPU::N_FLAG, true);
   cpu.*RegisterToTest = 0x44;
   mem[0xFFFC] = OpCodeToTest;
   mem[0xFFFD] = 0x0;
@@ -214,15 +214,15 @@ void LoadRegisterTests::TestOpCanAffectZeroFlag(m6502::Byte OpCodeToTest, m6502:
 	cpu.Execute(NUM_CYCLES, mem);
 
   // Then
-  EXPECT_FALSE(cpu.N);
-  EXPECT_TRUE(cpu.Z);
+  EXPECT_FALSE(cpu.GetFlag(CPU::N_FLAG));
+  EXPECT_TRUE(cpu.GetFlag(CPU::Z_FLAG));
   VerifyUnmodifiedFlagsFromLDAXY(CPUCopy);
 }
 
 void LoadRegisterTests::TestOpCanAffectNegativeFlag(m6502::Byte OpCodeToTest)
 {
-  cpu.Z = true;
-  cpu.N = false;
+  cpu.SetFlag(CPU::Z_FLAG, true);
+  cpu.SetFlag(CPU::N_FLAG, false);
   mem[0xFFFC] = OpCodeToTest;
   mem[0xFFFD] = 0x80;
   constexpr u32 NUM_CYCLES = 2;
@@ -230,8 +230,8 @@ void LoadRegisterTests::TestOpCanAffectNegativeFlag(m6502::Byte OpCodeToTest)
   CPU CPUCopy = cpu;
   cpu.Execute(NUM_CYCLES, mem);
 
-  EXPECT_FALSE(cpu.Z);
-  EXPECT_TRUE(cpu.N);
+  EXPECT_FALSE(cpu.GetFlag(CPU::Z_FLAG));
+  EXPECT_TRUE(cpu.GetFlag(CPU::N_FLAG));
   VerifyUnmodifiedFlagsFromLDAXY(CPUCopy);
 }
 
@@ -409,8 +409,8 @@ TEST_F(LoadRegisterTests, LDAIndirectYCanLoadValueIntoTheARegisterWhenItCrossesA
   // Then
   EXPECT_EQ(cpu.A, 0x37);
   EXPECT_EQ(CyclesUsed, NUM_CYCLES);
-  EXPECT_FALSE(cpu.N);
-  EXPECT_FALSE(cpu.Z);
+  EXPECT_FALSE(cpu.GetFlag(CPU::N_FLAG));
+  EXPECT_FALSE(cpu.GetFlag(CPU::Z_FLAG));
   VerifyUnmodifiedFlagsFromLDAXY(CPUCopy);
 }
 
@@ -430,6 +430,34 @@ TEST_F(LoadRegisterTests, JumpToSubRoutine)
   EXPECT_EQ(CyclesUsed, NUM_CYCLES);
 }
 
+TEST_F(LoadRegisterTests, JumpToSubRoutinePushesOnPageOneAndRTSReturns)
+{
+  // Given
+	mem[0xFFFC] = CPU::INS_JSR;
+	mem[0xFFFD] = 0x00;
+	mem[0xFFFE] = 0x42;
+	mem[0x4200] = CPU::INS_RTS;
+  constexpr u32 NUM_CYCLES = 6;
+
+  // When
+	s32 CyclesUsed = cpu.Execute(NUM_CYCLES, mem);
+
+  // Then: the address of the JSR's last byte, high byte first
+  EXPECT_EQ(cpu.PC, 0x4200);
+  EXPECT_EQ(CyclesUsed, NUM_CYCLES);
+  EXPECT_EQ(cpu.SP, 0x01FE);
+  EXPECT_EQ(mem[0x0100], 0xFF);
+  EXPECT_EQ(mem[0x01FF], 0xFE);
+
+  // When
+	CyclesUsed = cpu.Execute(NUM_CYCLES, mem);
+
+  // Then
+  EXPECT_EQ(cpu.PC, 0xFFFF);
+  EXPECT_EQ(CyclesUsed, NUM_CYCLES);
+  EXPECT_EQ(cpu.SP, 0x0100);
+}
+
 TEST_F(LoadRegisterTests, LDAIndirectXCanLoadValueIntoTheARegister)
 {
   // Given
@@ -448,8 +476,8 @@ TEST_F(LoadRegisterTests, LDAIndirectXCanLoadValueIntoTheARegister)
   // Then
   EXPECT_EQ(cpu.A, 0x37);
   EXPECT_EQ(CyclesUsed, NUM_CYCLES);
-  EXPECT_FALSE(cpu.N);
-  EXPECT_FALSE(cpu.Z);
+  EXPECT_FALSE(cpu.GetFlag(CPU::N_FLAG));
+  EXPECT_FALSE(cpu.GetFlag(CPU::Z_FLAG));
   VerifyUnmodifiedFlagsFromLDAXY(CPUCopy);
 }
 
@@ -471,7 +499,7 @@ TEST_F(LoadRegisterTests, LDAIndirectYCanLoadValueIntoTheARegister)
   // Then
   EXPECT_EQ(cpu.A, 0x37);
   EXPECT_EQ(CyclesUsed, NUM_CYCLES);
-  EXPECT_FALSE(cpu.N);
-  EXPECT_FALSE(cpu.Z);
+  EXPECT_FALSE(cpu.GetFlag(CPU::N_FLAG));
+  EXPECT_FALSE(cpu.GetFlag(CPU::Z_FLAG));
   VerifyUnmodifiedFlagsFromLDAXY(CPUCopy);
 }
\ No newline at end of file
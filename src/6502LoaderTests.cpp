@@ -0,0 +1,161 @@
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "main_6502.hpp"
+#include "loader_6502.hpp"
+
+using namespace m6502;
+
+class LoaderTests : public testing::Test
+{
+  public:
+    Mem mem;
+    CPU cpu;
+
+    virtual void SetUp()
+    {
+      cpu.Reset(mem);
+    }
+
+    virtual void TearDown()
+    {
+    }
+
+    static bool WriteFile(const char* Path, const std::vector<Byte>& Bytes)
+    {
+      FILE* Out = fopen(Path, "wb");
+      if (Out == nullptr)
+      {
+        return false;
+      }
+      const bool Written = fwrite(Bytes.data(), 1, Bytes.size(), Out) == Bytes.size();
+      fclose(Out);
+      return Written;
+    }
+};
+
+TEST_F(LoaderTests, PRGLoadsAtItsHeaderAddressAndRuns)
+{
+  // Given: LDA #$42, STA $10, JAM at $0801
+  const std::string Path = testing::TempDir() + "m6502_loader_test.prg";
+  ASSERT_TRUE(WriteFile(Path.c_str(), { 0x01, 0x08, CPU::INS_LDA_IM, 0x42, CPU::INS_STA_ZP, 0x10, CPU::INS_JAM }));
+
+  // When
+  ProgramImage Image;
+  const bool Opened = Image.Open(Path.c_str(), ImageFormat::PRG);
+  remove(Path.c_str());
+  ASSERT_TRUE(Opened);
+  Image.LoadRAM(mem);
+  Image.Boot(cpu);
+  const RunResult Result = cpu.Run(100, mem);
+
+  // Then
+  ASSERT_EQ(Image.Segments().size(), 1u);
+  EXPECT_EQ(Image.Segments()[0].LoadAddress, 0x0801);
+  EXPECT_EQ(Image.Size(), 5u);
+  EXPECT_EQ(Image.Entry(), 0x0801);
+  EXPECT_EQ(Result.Reason, StopReason::Halt);
+  EXPECT_EQ(mem.Read(0x0010), 0x42);
+}
+
+TEST_F(LoaderTests, RawImagesAreClampedToTheEndOfMemory)
+{
+  // Given
+  std::vector<Byte> Bytes(0x300, 0xEA);
+
+  // When
+  ProgramImage Image;
+  ASSERT_TRUE(Image.Parse(Bytes.data(), Bytes.size(), ImageFormat::Raw, 0xFF00));
+  Image.LoadRAM(mem);
+
+  // Then
+  EXPECT_EQ(Image.Size(), 0x100u);
+  EXPECT_EQ(mem.Read(0xFFFF), 0xEA);
+  EXPECT_EQ(mem.Read(0x0000), 0x00);
+}
+
+TEST_F(LoaderTests, SegmentsLoadEveryBlockAndTakeTheEntryFromRUNAD)
+{
+  // Given: $0600-$0602, $FFFF marker, $2000-$2000, RUNAD = $0601
+  const std::vector<Byte> Bytes = {
+    0xFF, 0xFF,
+    0x00, 0x06, 0x02, 0x06, 0x11, 0x22, 0x33,
+    0xFF, 0xFF,
+    0x00, 0x20, 0x00, 0x20, 0x44,
+    0xE0, 0x02, 0xE1, 0x02, 0x01, 0x06 };
+
+  // When
+  ProgramImage Image;
+  ASSERT_TRUE(Image.Parse(Bytes.data(), Bytes.size(), ImageFormat::Segments));
+  Image.LoadRAM(mem);
+  Image.Boot(cpu);
+
+  // Then
+  ASSERT_EQ(Image.Segments().size(), 3u);
+  EXPECT_EQ(mem.Read(0x0600), 0x11);
+  EXPECT_EQ(mem.Read(0x0602), 0x33);
+  EXPECT_EQ(mem.Read(0x2000), 0x44);
+  EXPECT_EQ(Image.Entry(), 0x0601);
+  EXPECT_EQ(cpu.PC, 0x0601);
+}
+
+TEST_F(LoaderTests, BrokenImagesAreRejected)
+{
+  ProgramImage Image;
+  const std::vector<Byte> NoMarker = { 0x00, 0x06, 0x00, 0x06, 0x11 };
+  const std::vector<Byte> Truncated = { 0xFF, 0xFF, 0x00, 0x06, 0x02, 0x06, 0x11 };
+  const std::vector<Byte> Backwards = { 0xFF, 0xFF, 0x02, 0x06, 0x00, 0x06, 0x11 };
+  const std::vector<Byte> HeaderOnly = { 0x01, 0x08 };
+
+  EXPECT_FALSE(Image.Parse(NoMarker.data(), NoMarker.size(), ImageFormat::Segments));
+  EXPECT_FALSE(Image.Parse(Truncated.data(), Truncated.size(), ImageFormat::Segments));
+  EXPECT_FALSE(Image.Parse(Backwards.data(), Backwards.size(), ImageFormat::Segments));
+  EXPECT_FALSE(Image.Parse(HeaderOnly.data(), HeaderOnly.size(), ImageFormat::PRG));
+  EXPECT_FALSE(Image.Open("/nonexistent/m6502_loader_test.bin", ImageFormat::Raw));
+  EXPECT_FALSE(Image.IsOpen());
+}
+
+TEST_F(LoaderTests, ROMImagesReadStraightFromTheDataAndSurviveReset)
+{
+  // Given: $FE00-$FFFE, JMP $FE10 at the reset vector
+  std::vector<Byte> Bytes(0x1FF, 0xEA);
+  Bytes[0x1FC] = CPU::INS_JMP_ABS;
+  Bytes[0x1FD] = 0x10;
+  Bytes[0x1FE] = 0xFE;
+  ProgramImage Image;
+  ASSERT_TRUE(Image.Parse(Bytes.data(), Bytes.size(), ImageFormat::Raw, 0xFE00));
+  ASSERT_TRUE(Image.MapROM(mem));
+
+  // When: the full page is the data itself, so it sees LDA #$99, JAM written afterwards; the part page is a copy
+  Bytes[0x010] = CPU::INS_LDA_IM;
+  Bytes[0x011] = 0x99;
+  Bytes[0x012] = CPU::INS_JAM;
+  Bytes[0x1F0] = 0x00;
+  mem.WriteByte(0xFE00, 0x00);
+  cpu.Reset(mem);
+  const RunResult Result = cpu.Run(100, mem);
+
+  // Then
+  EXPECT_EQ(Result.Reason, StopReason::Halt);
+  EXPECT_EQ(cpu.A, 0x99);
+  EXPECT_EQ(mem.ReadPages[0xFE], Bytes.data());
+  EXPECT_EQ(mem.Read(0xFE00), 0xEA);
+  EXPECT_EQ(mem.Read(0xFFF0), 0xEA);
+  EXPECT_EQ(mem.Read(0xFFFF), 0x00);
+}
+
+TEST_F(LoaderTests, ROMImagesMustStartOnAPage)
+{
+  // Given
+  std::vector<Byte> Bytes(0x100, 0xEA);
+  ProgramImage Image;
+  ASSERT_TRUE(Image.Parse(Bytes.data(), Bytes.size(), ImageFormat::Raw, 0xE010));
+
+  // When
+  const bool Mapped = Image.MapROM(mem);
+
+  // Then
+  EXPECT_FALSE(Mapped);
+  EXPECT_EQ(mem.Kinds[0xE0], Mem::PageKind::RAM);
+}
@@ -0,0 +1,95 @@
+#include <gtest/gtest.h>
+#include "main_6502.hpp"
+#include "pool_6502.hpp"
+
+using namespace m6502;
+
+class MachinePoolTests : public testing::Test
+{
+  public:
+    virtual void SetUp()
+    {
+    }
+
+    virtual void TearDown()
+    {
+    }
+};
+
+TEST_F(MachinePoolTests, ResetOnlyClearsThePagesWrittenSinceTheLastReset)
+{
+  // Given
+  Mem mem;
+  CPU cpu;
+  cpu.Reset(mem);
+  mem[0x0200] = 0x42;
+  const Mem::Page* Written = mem.RAM[0x02];
+  mem.ClearDirty();
+
+  // When
+  cpu.Reset(mem);
+
+  // Then
+  EXPECT_EQ(mem.Read(0x0200), 0x00);
+  EXPECT_EQ(mem.RAM[0x02], Written); // Page kept for the next run
+  EXPECT_TRUE(mem.IsDirty(0x02));
+  EXPECT_FALSE(mem.IsDirty(0x03));
+}
+
+TEST_F(MachinePoolTests, WritesAfterAResetAreClearedByTheNextOne)
+{
+  // Given
+  Mem mem;
+  CPU cpu;
+  cpu.Reset(mem);
+  mem[0x0200] = 0x42;
+  cpu.Reset(mem);
+  cpu.A = 0x37;
+  mem[0xFFFC] = CPU::INS_STA_ABS;
+  mem[0xFFFD] = 0x10;
+  mem[0xFFFE] = 0x02;
+  cpu.Execute(4, mem);
+  EXPECT_EQ(mem.Read(0x0210), 0x37);
+
+  // When
+  cpu.Reset(mem);
+
+  // Then
+  EXPECT_EQ(mem.Read(0x0210), 0x00);
+  EXPECT_EQ(mem.Read(0xFFFC), 0x00);
+}
+
+TEST_F(MachinePoolTests, ReleasedMachinesAreReusedAndReset)
+{
+  // Given
+  MachinePool Pool(1);
+  Machine* First = Pool.Acquire();
+  First->mem[0x1234] = 0x56;
+  First->cpu.A = 0x78;
+  Pool.Release(First);
+
+  // When
+  Machine* Second = Pool.Acquire();
+
+  // Then
+  EXPECT_EQ(Second, First);
+  EXPECT_EQ(Pool.Size(), 1u);
+  EXPECT_EQ(Second->mem.Read(0x1234), 0x00);
+  EXPECT_EQ(Second->cpu.A, 0x00);
+  EXPECT_EQ(Second->cpu.PC, 0xFFFC);
+}
+
+TEST_F(MachinePoolTests, PoolGrowsWhenEveryMachineIsInUse)
+{
+  // Given
+  MachinePool Pool(1);
+  Machine* First = Pool.Acquire();
+
+  // When
+  Machine* Second = Pool.Acquire();
+
+  // Then
+  EXPECT_NE(First, Second);
+  EXPECT_EQ(Pool.Size(), 2u);
+  EXPECT_EQ(Pool.Available(), 0u);
+}
@@ -0,0 +1,225 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include "main_6502.hpp"
+
+using namespace m6502;
+
+class MemoryMapTests : public testing::Test
+{
+  public:
+    Mem mem;
+    CPU cpu;
+
+    // Fake device, remembers the last access
+    struct Device
+    {
+      Word LastRead = 0;
+      Word LastWrite = 0;
+      Byte Written = 0;
+
+      static Byte Read(void* Context, Word Address)
+      {
+        Device* Self = static_cast<Device*>(Context);
+        Self->LastRead = Address;
+        return Byte(Address & 0xFF) ^ 0xA5;
+      }
+
+      static void Write(void* Context, Word Address, Byte Value)
+      {
+        Device* Self = static_cast<Device*>(Context);
+        Self->LastWrite = Address;
+        Self->Written = Value;
+      }
+    };
+
+    virtual void SetUp()
+    {
+      cpu.Reset(mem);
+    }
+
+    virtual void TearDown()
+    {
+    }
+};
+
+TEST_F(MemoryMapTests, ROMPagesReadTheImageAndWriteTheRAMUnderneath)
+{
+  // Given
+  std::vector<Byte> Rom(2 * Mem::PAGE_SIZE, 0x37);
+  mem.MapROM(0xA0, 2, Rom.data());
+  cpu.A = 0x42;
+  mem[0xFFFC] = CPU::INS_STA_ABS;
+  mem[0xFFFD] = 0x10;
+  mem[0xFFFE] = 0xA1;
+
+  // When
+  cpu.Execute(4, mem);
+
+  // Then
+  EXPECT_EQ(mem.Read(0xA110), 0x37);
+  EXPECT_EQ(mem.ReadRAM(0xA110), 0x42);
+  EXPECT_EQ(Rom[0x110], 0x37);
+}
+
+TEST_F(MemoryMapTests, LoadFromAnIOPageGoesThroughTheReadHandler)
+{
+  // Given
+  Device Vic;
+  mem.MapIO(0xD0, 4, &Device::Read, &Device::Write, &Vic);
+  mem[0xFFFC] = CPU::INS_LDA_ABS;
+  mem[0xFFFD] = 0x12;
+  mem[0xFFFE] = 0xD0;
+  constexpr s32 NUM_CYCLES = 4;
+
+  // When
+  const s32 CyclesUsed = cpu.Execute(NUM_CYCLES, mem);
+
+  // Then
+  EXPECT_EQ(CyclesUsed, NUM_CYCLES);
+  EXPECT_EQ(Vic.LastRead, 0xD012);
+  EXPECT_EQ(cpu.A, 0x12 ^ 0xA5);
+}
+
+TEST_F(MemoryMapTests, StoreToAnIOPageGoesThroughTheWriteHandler)
+{
+  // Given
+  Device Vic;
+  mem.MapIO(0xD0, 4, &Device::Read, &Device::Write, &Vic);
+  cpu.X = 0x20;
+  mem[0xFFFC] = CPU::INS_STX_ABS;
+  mem[0xFFFD] = 0x20;
+  mem[0xFFFE] = 0xD0;
+
+  // When
+  cpu.Execute(4, mem);
+
+  // Then
+  EXPECT_EQ(Vic.LastWrite, 0xD020);
+  EXPECT_EQ(Vic.Written, 0x20);
+  EXPECT_EQ(mem.ReadRAM(0xD020), 0x00);
+}
+
+TEST_F(MemoryMapTests, MapRAMRestoresPlainMemory)
+{
+  // Given
+  Device Vic;
+  mem.MapIO(0xD0, 1, &Device::Read, &Device::Write, &Vic);
+  mem[0xD001] = 0x99;
+
+  // When
+  mem.MapRAM(0xD0, 1);
+
+  // Then
+  EXPECT_EQ(mem.Read(0xD001), 0x99);
+}
+
+TEST_F(MemoryMapTests, CopiedMemoryUsesItsOwnRAM)
+{
+  // Given
+  std::vector<Byte> Rom(Mem::PAGE_SIZE, 0x11);
+  mem.MapROM(0xE0, 1, Rom.data());
+  mem[0x0200] = 0x01;
+
+  // When
+  Mem Copy = mem;
+  Copy.WriteByte(0x0200, 0x02);
+
+  // Then
+  EXPECT_EQ(mem.Read(0x0200), 0x01);
+  EXPECT_EQ(Copy.Read(0x0200), 0x02);
+  EXPECT_EQ(Copy.Read(0xE000), 0x11);
+}
+
+TEST_F(MemoryMapTests, ForkedMemorySharesPagesUntilTheyAreWritten)
+{
+  // Given
+  mem[0x0200] = 0x01;
+  mem[0x0300] = 0x02;
+
+  // When
+  Mem Fork = mem;
+
+  // Then
+  EXPECT_EQ(mem.SharedPages(), 2u);
+  EXPECT_EQ(Fork.SharedPages(), 2u);
+  EXPECT_EQ(Fork.Read(0x0300), 0x02);
+
+  // When
+  Fork.WriteByte(0x0200, 0x11);
+
+  // Then
+  EXPECT_EQ(Fork.SharedPages(), 1u);
+  EXPECT_EQ(Fork.Read(0x0200), 0x11);
+  EXPECT_EQ(mem.Read(0x0200), 0x01);
+}
+
+TEST_F(MemoryMapTests, ParentWritesAfterAForkDoNotReachTheFork)
+{
+  // Given
+  cpu.A = 0x42;
+  mem[0xFFFC] = CPU::INS_STA_ZP;
+  mem[0xFFFD] = 0x80;
+  mem[0x0080] = 0x00;
+  Mem Fork = mem;
+  CPU ForkCPU = cpu;
+
+  // When
+  cpu.Execute(3, mem);
+
+  // Then
+  EXPECT_EQ(mem.Read(0x0080), 0x42);
+  EXPECT_EQ(Fork.Read(0x0080), 0x00);
+
+  // When
+  ForkCPU.A = 0x24;
+  ForkCPU.Execute(3, Fork);
+
+  // Then
+  EXPECT_EQ(Fork.Read(0x0080), 0x24);
+  EXPECT_EQ(mem.Read(0x0080), 0x42);
+}
+
+TEST_F(MemoryMapTests, InitialiseZeroesForkedMemoryWithoutTouchingTheOriginal)
+{
+  // Given
+  mem[0x1234] = 0x56;
+  Mem Fork = mem;
+
+  // When
+  Fork.Initialise();
+
+  // Then
+  EXPECT_EQ(Fork.Read(0x1234), 0x00);
+  EXPECT_EQ(mem.Read(0x1234), 0x56);
+  EXPECT_EQ(mem.SharedPages(), 0u);
+}
+
+TEST_F(MemoryMapTests, WriteBlockCopiesAcrossPagesAndSendsIOBytesToTheDevice)
+{
+  // Given
+  Device Io;
+  mem.MapIO(0xD0, 1, &Device::Read, &Device::Write, &Io);
+  std::vector<Byte> Block(600);
+  for (u32 i = 0; i < Block.size(); i++)
+  {
+    Block[i] = Byte(i * 7);
+  }
+
+  // When
+  mem.WriteBlock(0x10F0, Block.data(), u32(Block.size()));
+  mem.WriteBlock(0xCFFF, Block.data(), 2);
+  mem.WriteBlock(0xFFFF, Block.data() + 1, 2);
+
+  // Then
+  for (u32 i = 0; i < Block.size(); i++)
+  {
+    EXPECT_EQ(mem.Read(Word(0x10F0 + i)), Block[i]);
+  }
+  EXPECT_TRUE(mem.IsDirty(0x10) && mem.IsDirty(0x11) && mem.IsDirty(0x12) && mem.IsDirty(0x13));
+  EXPECT_EQ(mem.Read(0xCFFF), Block[0]);
+  EXPECT_EQ(Io.LastWrite, 0xD000);
+  EXPECT_EQ(Io.Written, Block[1]);
+  EXPECT_EQ(mem.ReadRAM(0xD000), 0x00);
+  EXPECT_EQ(mem.Read(0xFFFF), Block[1]);
+  EXPECT_EQ(mem.Read(0x0000), Block[2]);
+}
@@ -0,0 +1,198 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "main_6502.hpp"
+#include "pacer_6502.hpp"
+#include "host_6502.hpp"
+
+using namespace m6502;
+
+class PacerTests : public testing::Test
+{
+  public:
+    // Time only moves when the pacer sleeps or yields, or the test stalls
+    struct ManualTime
+    {
+      Pacer::Clock::time_point Now;
+      Pacer::Clock::duration Slept{ 0 };
+
+      static Pacer::Clock::time_point GetNow(void* Context)
+      {
+        return static_cast<ManualTime*>(Context)->Now;
+      }
+
+      static void SleepFor(void* Context, Pacer::Clock::duration Duration)
+      {
+        ManualTime* Self = static_cast<ManualTime*>(Context);
+        Self->Now += Duration + std::chrono::microseconds(50); // Sleeps wake up a little late
+        Self->Slept += Duration;
+      }
+
+      static void Yield(void* Context)
+      {
+        static_cast<ManualTime*>(Context)->Now += std::chrono::microseconds(1);
+      }
+
+      void Stall(Pacer::Clock::duration Duration)
+      {
+        Now += Duration;
+      }
+
+      PacerTime Source()
+      {
+        return { &GetNow, &SleepFor, &Yield, this };
+      }
+
+      double SecondsSince(Pacer::Clock::time_point Start) const
+      {
+        return std::chrono::duration<double>(Now - Start).count();
+      }
+    };
+
+    ManualTime Time;
+
+    virtual void SetUp()
+    {
+    }
+
+    virtual void TearDown()
+    {
+    }
+
+    // 1 MHz, 10000 cycle frames and 2000 cycle slices
+    PacerConfig Megahertz()
+    {
+      PacerConfig Settings;
+      Settings.ClockHz = 1000000;
+      Settings.FrameCycles = 10000;
+      Settings.SliceMicroseconds = 2000;
+      return Settings;
+    }
+
+    static double SecondsSince(std::chrono::steady_clock::time_point Start)
+    {
+      return std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+    }
+};
+
+TEST_F(PacerTests, ClockPresets)
+{
+  EXPECT_EQ(PacerConfig::PAL().ClockHz, 985248u);
+  EXPECT_EQ(PacerConfig::PAL().FrameCycles, 19656u);
+  EXPECT_EQ(PacerConfig::NTSC().ClockHz, 1022727u);
+  EXPECT_EQ(PacerConfig::NTSC().FrameCycles, 17095u);
+}
+
+TEST_F(PacerTests, SlicesEndOnFrameBoundaries)
+{
+  // Given
+  Pacer Pace(Megahertz(), Time.Source());
+
+  // When: every slice overshoots by an instruction
+  std::vector<s32> Slices;
+  for (int Slice = 0; Slice < 6; Slice++)
+  {
+    Slices.push_back(Pace.NextSlice());
+    Pace.SliceDone(Slices.back() + 3);
+  }
+
+  // Then: the fifth slice is cut short to finish the frame, the next one starts a new frame
+  EXPECT_EQ(Slices, (std::vector<s32>{ 2000, 2000, 2000, 2000, 1988, 2000 }));
+  EXPECT_EQ(Pace.Cycle(), 12006u);
+  EXPECT_EQ(Pace.Metrics().Frames, 1u);
+}
+
+TEST_F(PacerTests, RunsAtTheConfiguredClock)
+{
+  // Given: a quarter of a second of PAL
+  Pacer Pace(PacerConfig::PAL(), Time.Source());
+  const u64 Target = PAL_CLOCK_HZ / 4;
+  const Pacer::Clock::time_point Start = Time.Now;
+  Pace.Start();
+
+  // When
+  while (Pace.Cycle() < Target)
+  {
+    Pace.SliceDone(Pace.NextSlice());
+  }
+  const double Elapsed = Time.SecondsSince(Start);
+
+  // Then: never ahead of the clock (deadlines are whole nanoseconds), and no more than a yield behind it
+  const double Emulated = double(Pace.Cycle()) / PAL_CLOCK_HZ;
+  EXPECT_GE(Elapsed, Emulated - 0.000000001);
+  EXPECT_LT(Elapsed, Emulated + 0.000002);
+
+  const PacerMetrics Metrics = Pace.Metrics();
+  EXPECT_EQ(Metrics.Frames, Pace.Cycle() / PAL_FRAME_CYCLES);
+  EXPECT_GT(Metrics.Slices, Metrics.Frames);
+  EXPECT_LE(Metrics.JitterP50Ns, Metrics.JitterP99Ns);
+  EXPECT_LE(Metrics.JitterP99Ns, Metrics.JitterMaxNs + 1000);
+  EXPECT_EQ(Metrics.Overruns, 0u);
+  // Waits sleep until SpinMicroseconds before the deadline and only yield the rest
+  EXPECT_GT(Metrics.HostShare, 0.0);
+  EXPECT_LT(Metrics.HostShare, 0.5);
+  EXPECT_GT(std::chrono::duration<double>(Time.Slept).count(), Emulated * 0.5);
+}
+
+TEST_F(PacerTests, CatchesUpWithWholeFrames)
+{
+  // Given
+  Pacer Pace(Megahertz(), Time.Source());
+
+  // When: the host stalls for a few slices
+  Time.Stall(std::chrono::milliseconds(8));
+  Pace.SliceDone(Pace.NextSlice());
+
+  // Then: the rest of the frame runs in one go
+  EXPECT_EQ(Pace.Metrics().Overruns, 1u);
+  EXPECT_EQ(Pace.NextSlice(), 8000);
+}
+
+TEST_F(PacerTests, ResyncsInsteadOfRacingAfterALongStall)
+{
+  // Given
+  PacerConfig Settings = Megahertz();
+  Settings.MaxLagMicroseconds = 20000;
+  Pacer Pace(Settings, Time.Source());
+
+  // When: stalled far longer than the allowed lag
+  Time.Stall(std::chrono::milliseconds(60));
+  Pace.SliceDone(Pace.NextSlice());
+  const Pacer::Clock::time_point Resumed = Time.Now;
+  Pace.SliceDone(Pace.NextSlice());
+
+  // Then: the next slice is paced normally rather than run flat out
+  const PacerMetrics Metrics = Pace.Metrics();
+  EXPECT_EQ(Metrics.Resyncs, 1u);
+  EXPECT_EQ(Metrics.Overruns, 1u);
+  EXPECT_EQ(Pace.NextSlice(), 2000);
+  EXPECT_GE(Time.SecondsSince(Resumed), 0.002);
+}
+
+TEST_F(PacerTests, EmulationThreadRunsInRealTime)
+{
+  // Given: JMP $0200
+  EmulationThread::Config Settings;
+  Settings.RealTime = true;
+  Settings.Pacing = PacerConfig::NTSC();
+  EmulationThread Host(Settings);
+  Host.cpu.Reset(Host.mem);
+  Host.cpu.PC = 0x0200;
+  Host.mem[0x0200] = CPU::INS_JMP_ABS;
+  Host.mem[0x0201] = 0x00;
+  Host.mem[0x0202] = 0x02;
+
+  // When
+  const auto Start = std::chrono::steady_clock::now();
+  Host.Start();
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  Host.Stop();
+  const double Elapsed = SecondsSince(Start);
+
+  // Then: no further ahead than one slice (and an instruction)
+  const u64 Slice = NTSC_CLOCK_HZ * 2 / 1000;
+  EXPECT_GT(Host.Cycle(), 0u);
+  EXPECT_LE(Host.Cycle(), u64(Elapsed * NTSC_CLOCK_HZ) + Slice + 3);
+  EXPECT_GT(Host.PacingMetrics().Slices, 0u);
+}
@@ -0,0 +1,275 @@
+#include <gtest/gtest.h>
+#include <map>
+#include "main_6502.hpp"
+#include "rewind_6502.hpp"
+
+using namespace m6502;
+
+class RewindTests : public testing::Test
+{
+  public:
+    Mem mem;
+    CPU cpu;
+
+    // Returns a new value on every read, like a timer or an input port
+    struct Counter
+    {
+      Byte Next = 1;
+      u32 Reads = 0;
+      u32 Writes = 0;
+
+      static Byte Read(void* Context, Word)
+      {
+        Counter* Self = static_cast<Counter*>(Context);
+        Self->Reads++;
+        return Self->Next++;
+      }
+
+      static void Write(void* Context, Word, Byte)
+      {
+        static_cast<Counter*>(Context)->Writes++;
+      }
+    };
+
+    struct State
+    {
+      Word PC;
+      Byte A, X;
+      Byte Stored;
+    };
+
+    Counter Port;
+
+    virtual void SetUp()
+    {
+      cpu.Reset(mem);
+      mem.MapIO(0xD0, 1, &Counter::Read, &Counter::Write, &Port);
+
+      // LDA $D000, STA $10, LDX $10, STX $D001, JSR $0200: 20 cycles per loop
+      cpu.PC = 0x0200;
+      mem[0x0200] = CPU::INS_LDA_ABS;
+      mem[0x0201] = 0x00;
+      mem[0x0202] = 0xD0;
+      mem[0x0203] = CPU::INS_STA_ZP;
+      mem[0x0204] = 0x10;
+      mem[0x0205] = CPU::INS_LDX_ZP;
+      mem[0x0206] = 0x10;
+      mem[0x0207] = CPU::INS_STX_ABS;
+      mem[0x0208] = 0x01;
+      mem[0x0209] = 0xD0;
+      mem[0x020A] = CPU::INS_JSR;
+      mem[0x020B] = 0x00;
+      mem[0x020C] = 0x02;
+    }
+
+    virtual void TearDown()
+    {
+    }
+
+    State Capture()
+    {
+      return { cpu.PC, cpu.A, cpu.X, mem[0x0010] };
+    }
+
+    // Runs one instruction at a time, remembering the state at every cycle reached
+    std::map<u64, State> RunLive(Rewinder& Rewind, u64 Cycles)
+    {
+      std::map<u64, State> States;
+      while (Rewind.Cycle() < Cycles)
+      {
+        Rewind.Run(1);
+        States[Rewind.Cycle()] = Capture();
+      }
+      return States;
+    }
+};
+
+TEST_F(RewindTests, SeekRestoresTheStateOfEveryEarlierCycle)
+{
+  // Given
+  RewindConfig Config;
+  Config.KeyframeInterval = 1000;
+  Rewinder Rewind(cpu, mem, Config);
+  std::map<u64, State> States = RunLive(Rewind, 10000);
+  const u32 LiveReads = Port.Reads;
+  const u32 LiveWrites = Port.Writes;
+
+  // When, Then
+  for (auto Entry = States.begin(); Entry != States.end(); std::advance(Entry, 7))
+  {
+    ASSERT_TRUE(Rewind.Seek(Entry->first));
+    EXPECT_EQ(Rewind.Cycle(), Entry->first);
+    EXPECT_EQ(cpu.PC, Entry->second.PC);
+    EXPECT_EQ(cpu.A, Entry->second.A);
+    EXPECT_EQ(cpu.X, Entry->second.X);
+    EXPECT_EQ(mem[0x0010], Entry->second.Stored);
+    if (std::distance(Entry, States.end()) <= 7)
+    {
+      break;
+    }
+  }
+  EXPECT_EQ(Port.Reads, LiveReads); // Replays read the journal
+  EXPECT_EQ(Port.Writes, LiveWrites);
+}
+
+TEST_F(RewindTests, RunningAfterARewindReplaysThenGoesLive)
+{
+  // Given
+  Rewinder Rewind(cpu, mem);
+  Rewind.Run(5000);
+  const u64 Head = Rewind.Cycle();
+  const State AtHead = Capture();
+  const u32 LiveReads = Port.Reads;
+
+  // When
+  ASSERT_TRUE(Rewind.Rewind(3000));
+  Rewind.Run(s32(Head - Rewind.Cycle()));
+
+  // Then
+  EXPECT_EQ(Rewind.Cycle(), Head);
+  EXPECT_EQ(cpu.A, AtHead.A);
+  EXPECT_EQ(cpu.PC, AtHead.PC);
+  EXPECT_EQ(Port.Reads, LiveReads);
+
+  // When, past the head the device is read again
+  Rewind.Run(100);
+
+  // Then
+  EXPECT_GT(Port.Reads, LiveReads);
+}
+
+TEST_F(RewindTests, HostWritesAreReplayedAndWritingInThePastDropsTheFuture)
+{
+  // Given
+  Rewinder Rewind(cpu, mem);
+  Rewind.Run(2000);
+  Rewind.Write(0x0300, 0x42);
+  const u64 WriteCycle = Rewind.Cycle();
+  Rewind.Run(2000);
+
+  // When
+  ASSERT_TRUE(Rewind.Seek(WriteCycle + 1));
+  const Byte Replayed = mem[0x0300];
+  ASSERT_TRUE(Rewind.Seek(100));
+  const Byte Before = mem[0x0300];
+  Rewind.Write(0x0301, 0x43);
+
+  // Then
+  EXPECT_EQ(Replayed, 0x42);
+  EXPECT_EQ(Before, 0x00);
+  EXPECT_EQ(Rewind.HeadCycle(), Rewind.Cycle());
+  EXPECT_FALSE(Rewind.Seek(WriteCycle));
+}
+
+TEST_F(RewindTests, HistoryStaysBounded)
+{
+  // Given
+  RewindConfig Config;
+  Config.KeyframeInterval = 100;
+  Config.MaxKeyframes = 8;
+  Config.Window = 20000;
+  Rewinder Rewind(cpu, mem, Config);
+
+  // When
+  Rewind.Run(50000);
+
+  // Then
+  EXPECT_LE(Rewind.NumKeyframes(), 8u);
+  EXPECT_LE(Rewind.OldestCycle(), Rewind.Cycle() - 20000);
+  EXPECT_GE(Rewind.OldestCycle(), Rewind.Cycle() - 20000 - 20000 / 2);
+  EXPECT_LT(Rewind.JournalSize(), 2u * 20000 / 20 * 2);
+  EXPECT_FALSE(Rewind.Seek(Rewind.OldestCycle() - 1));
+  EXPECT_TRUE(Rewind.Rewind(20000));
+}
+
+TEST_F(RewindTests, ReplaysTakeTheInterruptsTheLiveRunTook)
+{
+  // Given: a device that raises IRQ when a multiple of 4 is written to it and releases it when $D101 is read
+  struct Alarm
+  {
+    CPU* cpu;
+    Byte Next = 1;
+
+    static Byte Read(void* Context, Word Address)
+    {
+      Alarm* Self = static_cast<Alarm*>(Context);
+      if (Address == 0xD101)
+      {
+        Self->cpu->SetIRQ(0x01, false);
+        return 0;
+      }
+      return Self->Next++;
+    }
+
+    static void Write(void* Context, Word, Byte Value)
+    {
+      if (Value % 4 == 0)
+      {
+        static_cast<Alarm*>(Context)->cpu->SetIRQ(0x01, true);
+      }
+    }
+  };
+  Alarm Device = { &cpu };
+  mem.MapIO(0xD1, 1, &Alarm::Read, &Alarm::Write, &Device);
+
+  // LDA $D100, STA $D100, JMP $0200; counts IRQs in $10 and NMIs in $11
+  const Byte Loop[] = { CPU::INS_LDA_ABS, 0x00, 0xD1, CPU::INS_STA_ABS, 0x00, 0xD1, CPU::INS_JMP_ABS, 0x00, 0x02 };
+  const Byte IRQ[] = { CPU::INS_LDA_ABS, 0x01, 0xD1, CPU::INS_LDA_ZP, 0x10, CPU::INS_CLC, CPU::INS_ADC_IM, 0x01,
+    CPU::INS_STA_ZP, 0x10, CPU::INS_RTI };
+  const Byte NMI[] = { CPU::INS_LDA_ZP, 0x11, CPU::INS_CLC, CPU::INS_ADC_IM, 0x01, CPU::INS_STA_ZP, 0x11, CPU::INS_RTI };
+  for (Word Index = 0; Index < sizeof(Loop); Index++)
+  {
+    mem[Word(0x0200 + Index)] = Loop[Index];
+  }
+  for (Word Index = 0; Index < sizeof(IRQ); Index++)
+  {
+    mem[Word(0x0300 + Index)] = IRQ[Index];
+  }
+  for (Word Index = 0; Index < sizeof(NMI); Index++)
+  {
+    mem[Word(0x0380 + Index)] = NMI[Index];
+  }
+  mem[0xFFFE] = 0x00;
+  mem[0xFFFF] = 0x03;
+  mem[0xFFFA] = 0x80;
+  mem[0xFFFB] = 0x03;
+
+  RewindConfig Config;
+  Config.KeyframeInterval = 1000;
+  Rewinder Rewind(cpu, mem, Config);
+  std::map<u64, State> States = RunLive(Rewind, 3000);
+  cpu.TriggerNMI(); // From the host, between runs
+  const std::map<u64, State> AfterNMI = RunLive(Rewind, 6000);
+  States.insert(AfterNMI.begin(), AfterNMI.end());
+  const Byte IRQsTaken = mem[0x0010];
+  ASSERT_GT(IRQsTaken, 10);
+  ASSERT_EQ(mem[0x0011], 1);
+
+  // When, Then: every replay matches the straight run
+  for (auto Entry = States.begin(); Entry != States.end(); std::advance(Entry, 7))
+  {
+    ASSERT_TRUE(Rewind.Seek(Entry->first));
+    EXPECT_EQ(cpu.PC, Entry->second.PC) << "Cycle " << Entry->first;
+    EXPECT_EQ(cpu.A, Entry->second.A) << "Cycle " << Entry->first;
+    EXPECT_EQ(mem[0x0010], Entry->second.Stored) << "Cycle " << Entry->first;
+    if (std::distance(Entry, States.end()) <= 7)
+    {
+      break;
+    }
+  }
+  ASSERT_TRUE(Rewind.Seek(Rewind.HeadCycle()));
+  EXPECT_EQ(mem[0x0010], IRQsTaken);
+  EXPECT_EQ(mem[0x0011], 1);
+}
+
+TEST_F(RewindTests, DestructorHandsTheDevicesBack)
+{
+  // Given
+  {
+    Rewinder Rewind(cpu, mem);
+    EXPECT_NE(mem.IOHandlers[0xD0].Context, &Port);
+  }
+
+  // Then
+  EXPECT_EQ(mem.IOHandlers[0xD0].Context, &Port);
+}
@@ -0,0 +1,152 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include "main_6502.hpp"
+
+using namespace m6502;
+
+class RunTests : public testing::Test
+{
+  public:
+    Mem mem;
+    CPU cpu;
+    RunControl Control;
+
+    virtual void SetUp()
+    {
+      cpu.Reset(mem);
+      cpu.PC = 0x0200;
+    }
+
+    virtual void TearDown()
+    {
+    }
+
+    // LDA #$11, LDX #$22, LDY #$33 at 0x0200, followed by Last
+    void LoadProgram(Byte Last)
+    {
+      mem[0x0200] = CPU::INS_LDA_IM;
+      mem[0x0201] = 0x11;
+      mem[0x0202] = CPU::INS_LDX_IM;
+      mem[0x0203] = 0x22;
+      mem[0x0204] = CPU::INS_LDY_IM;
+      mem[0x0205] = 0x33;
+      mem[0x0206] = Last;
+    }
+};
+
+TEST_F(RunTests, RunStopsWhenTheCyclesAreUsedUp)
+{
+  // Given
+  LoadProgram(CPU::INS_JAM);
+
+  // When
+  RunResult Result = cpu.Run(4, mem);
+
+  // Then
+  EXPECT_EQ(Result.Reason, StopReason::CyclesExhausted);
+  EXPECT_EQ(Result.CyclesUsed, 4);
+  EXPECT_EQ(Result.PC, 0x0204);
+}
+
+TEST_F(RunTests, IllegalOpcodeStopsTheRunOnTheOpcode)
+{
+  // Given
+  LoadProgram(0xFF);
+
+  // When
+  RunResult Result = cpu.Run(100, mem);
+
+  // Then
+  EXPECT_EQ(Result.Reason, StopReason::IllegalOpcode);
+  EXPECT_EQ(Result.CyclesUsed, 6);
+  EXPECT_EQ(Result.PC, 0x0206);
+  EXPECT_EQ(Result.Opcode, 0xFF);
+  EXPECT_EQ(cpu.Y, 0x33);
+}
+
+TEST_F(RunTests, JamHaltsAndLeavesPCOnTheJam)
+{
+  // Given
+  LoadProgram(CPU::INS_JAM);
+
+  // When
+  RunResult Result = cpu.Run(100, mem);
+  RunResult Again = cpu.Run(100, mem);
+
+  // Then
+  EXPECT_EQ(Result.Reason, StopReason::Halt);
+  EXPECT_EQ(Result.CyclesUsed, 6);
+  EXPECT_EQ(Result.PC, 0x0206);
+  EXPECT_EQ(Again.Reason, StopReason::Halt);
+  EXPECT_EQ(Again.CyclesUsed, 0);
+}
+
+TEST_F(RunTests, ExecuteReportsTheCyclesOfAStoppedRun)
+{
+  // Given
+  LoadProgram(0xFF);
+
+  // When
+  s32 CyclesUsed = cpu.Execute(100, mem);
+
+  // Then
+  EXPECT_EQ(CyclesUsed, 6);
+}
+
+TEST_F(RunTests, BreakpointStopsBeforeTheInstructionAndCanBeSteppedOff)
+{
+  // Given
+  LoadProgram(CPU::INS_JAM);
+  Control.SetBreakpoint(0x0202);
+
+  // When
+  RunResult Result = cpu.Run(100, mem, Control);
+  const Byte XAtBreakpoint = cpu.X;
+  RunResult Resumed = cpu.Run(100, mem, Control);
+
+  // Then
+  EXPECT_EQ(Result.Reason, StopReason::Breakpoint);
+  EXPECT_EQ(Result.PC, 0x0202);
+  EXPECT_EQ(Result.CyclesUsed, 2);
+  EXPECT_EQ(Result.Opcode, CPU::INS_LDX_IM);
+  EXPECT_EQ(XAtBreakpoint, 0x00);
+  EXPECT_EQ(Resumed.Reason, StopReason::Halt);
+  EXPECT_EQ(cpu.X, 0x22);
+}
+
+TEST_F(RunTests, HostRequestStopsTheRun)
+{
+  // Given
+  LoadProgram(CPU::INS_JAM);
+  Control.RequestStop();
+
+  // When
+  RunResult Result = cpu.Run(100, mem, Control);
+
+  // Then
+  EXPECT_EQ(Result.Reason, StopReason::HostRequest);
+  EXPECT_EQ(Result.CyclesUsed, 0);
+  EXPECT_EQ(Result.PC, 0x0200);
+}
+
+TEST_F(RunTests, HostRequestFromAnotherThreadStopsALongRun)
+{
+  // Given, LDA #$11 then JSR back to it forever
+  mem[0x0200] = CPU::INS_LDA_IM;
+  mem[0x0201] = 0x11;
+  mem[0x0202] = CPU::INS_JSR;
+  mem[0x0203] = 0x00;
+  mem[0x0204] = 0x02;
+
+  // When
+  std::thread Host([this] { Control.RequestStop(); });
+  RunResult Result;
+  do
+  {
+    Result = cpu.Run(1000, mem, Control);
+  } while (Result.Reason == StopReason::CyclesExhausted);
+  Host.join();
+
+  // Then
+  EXPECT_EQ(Result.Reason, StopReason::HostRequest);
+}
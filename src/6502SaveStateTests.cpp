@@ -0,0 +1,192 @@
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <string>
+#include "main_6502.hpp"
+#include "mappedfile_6502.hpp"
+#include "savestate_6502.hpp"
+
+using namespace m6502;
+
+class SaveStateTests : public testing::Test
+{
+  public:
+    Mem mem;
+    CPU cpu;
+    std::vector<Byte> Bytes;
+
+    virtual void SetUp()
+    {
+      cpu.Reset(mem);
+      cpu.PC = 0x1234;
+      cpu.SP = 0x0105;
+      cpu.A = 0x11;
+      cpu.X = 0x22;
+      cpu.Y = 0x33;
+      cpu.SetStatus(CPU::C_FLAG | CPU::N_FLAG | CPU::D_FLAG);
+      cpu.IRQLines = 0x05;
+      cpu.NMIPending = true;
+      mem[0x0010] = 0xAA;
+      mem[0x8000] = 0xBB;
+      mem[0xFFFF] = 0xCC;
+    }
+
+    virtual void TearDown()
+    {
+    }
+
+    void ExpectSameState(const CPU& Loaded, const Mem& LoadedMem)
+    {
+      EXPECT_EQ(Loaded.PC, cpu.PC);
+      EXPECT_EQ(Loaded.SP, cpu.SP);
+      EXPECT_EQ(Loaded.A, cpu.A);
+      EXPECT_EQ(Loaded.X, cpu.X);
+      EXPECT_EQ(Loaded.Y, cpu.Y);
+      EXPECT_EQ(Loaded.GetStatus(), cpu.GetStatus());
+      EXPECT_EQ(Loaded.IRQLines, cpu.IRQLines);
+      EXPECT_EQ(Loaded.NMILine, cpu.NMILine);
+      EXPECT_EQ(Loaded.NMIPending, cpu.NMIPending);
+      for (u32 Page = 0; Page < Mem::NUM_PAGES; Page++)
+      {
+        EXPECT_TRUE(LoadedMem.SamePage(mem, Page)) << "Page " << Page;
+      }
+    }
+};
+
+TEST_F(SaveStateTests, FullStateRoundTrips)
+{
+  // Given
+  SaveStateInfo Saved = SaveFull(cpu, mem, 12345, Bytes);
+  CPU Loaded;
+  Mem LoadedMem;
+  Loaded.Reset(LoadedMem);
+  LoadedMem[0x4000] = 0x99; // Not in the state, has to be cleared
+
+  // When
+  SaveStateInfo Info;
+  ASSERT_TRUE(LoadSaveState(Bytes.data(), Bytes.size(), Loaded, LoadedMem, 0, Info));
+
+  // Then
+  ExpectSameState(Loaded, LoadedMem);
+  EXPECT_EQ(Info.Id, Saved.Id);
+  EXPECT_EQ(Info.Cycle, 12345u);
+  EXPECT_FALSE(Info.Delta);
+}
+
+TEST_F(SaveStateTests, FullStateOnlyStoresNonZeroPages)
+{
+  // When
+  SaveStateInfo Saved = SaveFull(cpu, mem, 0, Bytes);
+
+  // Then
+  EXPECT_EQ(Saved.Pages, 3u);
+  EXPECT_LT(Bytes.size(), 4 * Mem::PAGE_SIZE);
+}
+
+TEST_F(SaveStateTests, DeltaStoresOnlyChangedPagesAndLoadsOnItsBase)
+{
+  // Given
+  std::vector<Byte> BaseBytes;
+  const Mem Base = mem;
+  SaveStateInfo BaseInfo = SaveFull(cpu, mem, 100, BaseBytes);
+  mem[0x8001] = 0xDD;
+  mem[0x3000] = 0xEE;
+  cpu.PC = 0x4321;
+  cpu.SetFlag(CPU::Z_FLAG, true);
+
+  // When
+  SaveStateInfo DeltaInfo = SaveDelta(cpu, mem, 200, Base, BaseInfo, Bytes);
+  CPU Loaded;
+  Mem LoadedMem;
+  SaveStateInfo Info;
+  ASSERT_TRUE(LoadSaveState(BaseBytes.data(), BaseBytes.size(), Loaded, LoadedMem, 0, Info));
+  ASSERT_TRUE(LoadSaveState(Bytes.data(), Bytes.size(), Loaded, LoadedMem, Info.Id, Info));
+
+  // Then
+  EXPECT_EQ(DeltaInfo.Pages, 2u);
+  EXPECT_TRUE(DeltaInfo.Delta);
+  EXPECT_EQ(DeltaInfo.BaseId, BaseInfo.Id);
+  EXPECT_EQ(Info.Cycle, 200u);
+  ExpectSameState(Loaded, LoadedMem);
+}
+
+TEST_F(SaveStateTests, DeltaIsRefusedOnTheWrongBase)
+{
+  // Given
+  const Mem Base = mem;
+  std::vector<Byte> BaseBytes;
+  SaveStateInfo BaseInfo = SaveFull(cpu, mem, 0, BaseBytes);
+  mem[0x8001] = 0xDD;
+  SaveDelta(cpu, mem, 0, Base, BaseInfo, Bytes);
+  CPU Loaded;
+  Mem LoadedMem;
+  Loaded.Reset(LoadedMem);
+
+  // When
+  SaveStateInfo Info;
+  bool Accepted = LoadSaveState(Bytes.data(), Bytes.size(), Loaded, LoadedMem, BaseInfo.Id + 1, Info);
+
+  // Then
+  EXPECT_FALSE(Accepted);
+  EXPECT_EQ(LoadedMem[0x8001], 0x00);
+}
+
+TEST_F(SaveStateTests, CorruptedStateIsRejected)
+{
+  // Given
+  SaveFull(cpu, mem, 0, Bytes);
+  Bytes.back() ^= 0x01;
+  CPU Loaded;
+  Mem LoadedMem;
+
+  // When
+  SaveStateInfo Info;
+  bool Accepted = LoadSaveState(Bytes.data(), Bytes.size(), Loaded, LoadedMem, 0, Info);
+
+  // Then
+  EXPECT_FALSE(Accepted);
+  EXPECT_FALSE(ReadSaveStateInfo(Bytes.data(), Bytes.size() - 1, Info));
+}
+
+TEST_F(SaveStateTests, DeltaRelabelledAsFullIsRejected)
+{
+  // Given
+  const Mem Base = mem;
+  std::vector<Byte> BaseBytes;
+  SaveStateInfo BaseInfo = SaveFull(cpu, mem, 0, BaseBytes);
+  mem[0x8001] = 0xDD;
+  SaveDelta(cpu, mem, 0, Base, BaseInfo, Bytes);
+  Bytes[5] = 0;
+  CPU Loaded;
+  Mem LoadedMem;
+
+  // When
+  SaveStateInfo Info;
+  bool Accepted = LoadSaveState(Bytes.data(), Bytes.size(), Loaded, LoadedMem, 0, Info);
+
+  // Then
+  EXPECT_FALSE(Accepted);
+  EXPECT_FALSE(ReadSaveStateInfo(Bytes.data(), Bytes.size(), Info));
+}
+
+TEST_F(SaveStateTests, StateLoadsFromAMappedFile)
+{
+  // Given
+  const std::string Path = testing::TempDir() + "m6502_savestate_test.m65s";
+  SaveFull(cpu, mem, 0, Bytes);
+  ASSERT_TRUE(WriteFile(Path.c_str(), Bytes));
+
+  // When
+  CPU Loaded;
+  Mem LoadedMem;
+  SaveStateInfo Info;
+  bool Accepted = false;
+  {
+    MappedFile File(Path.c_str());
+    Accepted = LoadSaveState(File.Data(), File.Size(), Loaded, LoadedMem, 0, Info);
+  }
+  remove(Path.c_str());
+
+  // Then
+  ASSERT_TRUE(Accepted);
+  ExpectSameState(Loaded, LoadedMem);
+}
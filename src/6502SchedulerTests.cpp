@@ -0,0 +1,186 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include "main_6502.hpp"
+#include "blockcache_6502.hpp"
+#include "scheduler_6502.hpp"
+
+using namespace m6502;
+
+class SchedulerTests : public testing::Test
+{
+  public:
+    Mem mem;
+    CPU cpu;
+    Scheduler Events;
+
+    // Records every dispatch, Tag tells the events apart
+    struct Device
+    {
+      u32 Tag = 0;
+      u64 Period = 0; // Reschedules itself when non zero
+      bool StopRun = false;
+      std::vector<u32>* Order = nullptr;
+      std::vector<u64> Stamps;
+      std::vector<u64> Dispatched; // Scheduler cycle at dispatch
+
+      static void Fire(void* Context, Scheduler& Events, u64 Cycle)
+      {
+        Device& Self = *static_cast<Device*>(Context);
+        Self.Stamps.push_back(Cycle);
+        Self.Dispatched.push_back(Events.Cycle());
+        if (Self.Order)
+        {
+          Self.Order->push_back(Self.Tag);
+        }
+        if (Self.Period)
+        {
+          Events.Schedule(Cycle + Self.Period, &Fire, Context);
+        }
+        if (Self.StopRun)
+        {
+          Events.Stop();
+        }
+      }
+    };
+
+    virtual void SetUp()
+    {
+      cpu.Reset(mem);
+      cpu.PC = 0x0200;
+      // Spins on JMP $0200, 3 cycles an instruction
+      mem[0x0200] = CPU::INS_JMP_ABS;
+      mem[0x0201] = 0x00;
+      mem[0x0202] = 0x02;
+    }
+
+    virtual void TearDown()
+    {
+    }
+};
+
+TEST_F(SchedulerTests, EventsAreDispatchedInCycleThenSchedulingOrder)
+{
+  // Given:
+  std::vector<u32> Order;
+  Device First, Second, Third, Fourth;
+  Device* Devices[] = { &First, &Second, &Third, &Fourth };
+  for (u32 Index = 0; Index < 4; Index++)
+  {
+    Devices[Index]->Tag = Index + 1;
+    Devices[Index]->Order = &Order;
+  }
+  Events.Schedule(30, &Device::Fire, &First);
+  Events.Schedule(10, &Device::Fire, &Second);
+  Events.Schedule(20, &Device::Fire, &Third);
+  Events.Schedule(10, &Device::Fire, &Fourth);
+
+  // When:
+  const RunResult Result = Events.Run(cpu, mem, 100);
+
+  // Then:
+  EXPECT_EQ(Result.Reason, StopReason::CyclesExhausted);
+  EXPECT_GE(Result.CyclesUsed, 100);
+  EXPECT_EQ(u64(Result.CyclesUsed), Events.Cycle());
+  EXPECT_EQ(Order, (std::vector<u32>{ 2, 4, 3, 1 }));
+  EXPECT_FALSE(Events.Pending());
+}
+
+TEST_F(SchedulerTests, CPURunsUpToTheDeadlineOnly)
+{
+  // Given:
+  Device Timer;
+  Events.Schedule(100, &Device::Fire, &Timer);
+
+  // When:
+  Events.Run(cpu, mem, 1000);
+
+  // Then: dispatched on the first instruction boundary at or after cycle 100
+  ASSERT_EQ(Timer.Stamps.size(), 1u);
+  EXPECT_EQ(Timer.Stamps[0], 100u);
+  EXPECT_EQ(Timer.Dispatched[0], 102u);
+}
+
+TEST_F(SchedulerTests, PeriodicEventsDoNotDrift)
+{
+  // Given: a period that isn't a multiple of the instruction length
+  Device Timer;
+  Timer.Period = 100;
+  Events.Schedule(100, &Device::Fire, &Timer);
+
+  // When:
+  Events.Run(cpu, mem, 1000);
+
+  // Then:
+  ASSERT_EQ(Timer.Stamps.size(), 10u);
+  for (u32 Index = 0; Index < 10; Index++)
+  {
+    EXPECT_EQ(Timer.Stamps[Index], 100u * (Index + 1));
+    EXPECT_GE(Timer.Dispatched[Index], Timer.Stamps[Index]);
+    EXPECT_LT(Timer.Dispatched[Index], Timer.Stamps[Index] + 3);
+  }
+  EXPECT_EQ(Events.NextDeadline(), 1100u);
+}
+
+TEST_F(SchedulerTests, CancelledEventsNeverFire)
+{
+  // Given:
+  Device Kept, Dropped;
+  Events.Schedule(50, &Device::Fire, &Kept);
+  const Scheduler::EventId Id = Events.Schedule(40, &Device::Fire, &Dropped);
+
+  // When:
+  EXPECT_TRUE(Events.Cancel(Id));
+  EXPECT_FALSE(Events.Cancel(Id));
+  Events.Run(cpu, mem, 100);
+
+  // Then:
+  EXPECT_TRUE(Dropped.Stamps.empty());
+  EXPECT_EQ(Kept.Stamps.size(), 1u);
+  // The slot is reused, the old Id doesn't cancel the new event
+  Events.ScheduleIn(10, &Device::Fire, &Dropped);
+  EXPECT_FALSE(Events.Cancel(Id));
+  Events.Run(cpu, mem, 20);
+  EXPECT_EQ(Dropped.Stamps.size(), 1u);
+}
+
+TEST_F(SchedulerTests, HandlerCanStopTheRun)
+{
+  // Given:
+  Device Stopper, Later;
+  Stopper.StopRun = true;
+  Events.Schedule(30, &Device::Fire, &Stopper);
+  Events.Schedule(60, &Device::Fire, &Later);
+
+  // When:
+  const RunResult Result = Events.Run(cpu, mem, 1000);
+
+  // Then:
+  EXPECT_EQ(Result.Reason, StopReason::HostRequest);
+  EXPECT_EQ(Result.CyclesUsed, 30);
+  EXPECT_TRUE(Later.Stamps.empty());
+
+  // The next run carries on from there
+  Events.Run(cpu, mem, 100);
+  EXPECT_EQ(Later.Stamps.size(), 1u);
+}
+
+TEST_F(SchedulerTests, IdleLoopsSkipStraightToTheNextDeadline)
+{
+  // Given:
+  BlockCache cache;
+  Device Raster;
+  Raster.Period = 1000000;
+  Events.Schedule(1000000, &Device::Fire, &Raster);
+
+  // When:
+  const RunResult Result = Events.Run(cpu, mem, cache, 5000000);
+
+  // Then:
+  EXPECT_EQ(Result.Reason, StopReason::CyclesExhausted);
+  ASSERT_EQ(Raster.Stamps.size(), 5u);
+  for (u32 Index = 0; Index < 5; Index++)
+  {
+    EXPECT_GE(Raster.Dispatched[Index], Raster.Stamps[Index]);
+    EXPECT_LT(Raster.Dispatched[Index], Raster.Stamps[Index] + 3);
+  }
+}
@@ -0,0 +1,156 @@
+#include <gtest/gtest.h>
+#include "main_6502.hpp"
+#include "stats_6502.hpp"
+
+using namespace m6502;
+
+class StatsTests : public testing::Test
+{
+  public:
+    Mem mem;
+    CPU cpu;
+    Stats Counters;
+
+    virtual void SetUp()
+    {
+      cpu.Reset(mem);
+      cpu.PC = 0x0200;
+    }
+
+    virtual void TearDown()
+    {
+    }
+};
+
+TEST_F(StatsTests, CountsExecutionsAndCyclesPerOpcode)
+{
+  // Given
+  mem[0x0200] = CPU::INS_LDA_IM;
+  mem[0x0201] = 0x11;
+  mem[0x0202] = CPU::INS_STA_ZP;
+  mem[0x0203] = 0x10;
+  mem[0x0204] = CPU::INS_LDA_IM;
+  mem[0x0205] = 0x22;
+
+  // When
+  s32 CyclesUsed = cpu.Execute(7, mem, Counters);
+
+  // Then
+  EXPECT_EQ(CyclesUsed, 7);
+  EXPECT_EQ(Counters.Executions[CPU::INS_LDA_IM], 2u);
+  EXPECT_EQ(Counters.Cycles[CPU::INS_LDA_IM], 4u);
+  EXPECT_EQ(Counters.Executions[CPU::INS_STA_ZP], 1u);
+  EXPECT_EQ(Counters.Cycles[CPU::INS_STA_ZP], 3u);
+  EXPECT_EQ(Counters.TotalCycles(), 7u);
+  EXPECT_EQ(Counters.CycleHistogram[2], 2u);
+  EXPECT_EQ(Counters.CycleHistogram[3], 1u);
+}
+
+TEST_F(StatsTests, CountsPageCrossingsAsExtraCycles)
+{
+  // Given
+  cpu.X = 0xFF;
+  cpu.Y = 0x01;
+  mem[0x0200] = CPU::INS_LDA_ABSX; // Crosses
+  mem[0x0201] = 0x02;
+  mem[0x0202] = 0x44;
+  mem[0x0203] = CPU::INS_LDA_ABSY; // Doesn't cross
+  mem[0x0204] = 0x02;
+  mem[0x0205] = 0x44;
+  mem[0x0206] = CPU::INS_STA_ABSX; // Stores never pay the penalty
+  mem[0x0207] = 0x02;
+  mem[0x0208] = 0x44;
+
+  // When
+  cpu.Execute(14, mem, Counters);
+
+  // Then
+  EXPECT_EQ(Counters.ExtraCycles[CPU::INS_LDA_ABSX], 1u);
+  EXPECT_EQ(Counters.ExtraCycles[CPU::INS_LDA_ABSY], 0u);
+  EXPECT_EQ(Counters.ExtraCycles[CPU::INS_STA_ABSX], 0u);
+  EXPECT_EQ(Counters.Cycles[CPU::INS_LDA_ABSX], 5u);
+}
+
+TEST_F(StatsTests, RecordsInstructionsPerRunAndSkipsStoppedInstructions)
+{
+  // Given
+  mem[0x0200] = CPU::INS_LDA_IM;
+  mem[0x0201] = 0x11;
+  mem[0x0202] = CPU::INS_LDX_IM;
+  mem[0x0203] = 0x22;
+  mem[0x0204] = CPU::INS_LDY_IM;
+  mem[0x0205] = 0x33;
+  mem[0x0206] = CPU::INS_JAM;
+
+  // When
+  cpu.Execute(100, mem, Counters);
+
+  // Then
+  EXPECT_EQ(Counters.Runs, 1u);
+  EXPECT_EQ(Counters.Instructions, 3u);
+  EXPECT_EQ(Counters.RunHistogram[2], 1u); // [2, 4)
+  EXPECT_EQ(Counters.Executions[CPU::INS_JAM], 0u);
+}
+
+TEST_F(StatsTests, ResetClearsEveryCounter)
+{
+  // Given
+  mem[0x0200] = CPU::INS_LDA_IM;
+  mem[0x0201] = 0x11;
+  cpu.Execute(2, mem, Counters);
+
+  // When
+  Counters.Reset();
+
+  // Then
+  EXPECT_EQ(Counters.Executions[CPU::INS_LDA_IM], 0u);
+  EXPECT_EQ(Counters.TotalCycles(), 0u);
+  EXPECT_EQ(Counters.Runs, 0u);
+  EXPECT_EQ(Counters.Instructions, 0u);
+}
+
+TEST_F(StatsTests, InstructionsThatLetAnInterruptInAreChargedTheirOwnCycles)
+{
+  // Given: RTI pops I = 0 while IRQ is held, the handler at $0400 halts
+  mem[0xFFFE] = 0x00;
+  mem[0xFFFF] = 0x04;
+  mem[0x0400] = CPU::INS_JAM;
+  mem[0x0200] = CPU::INS_RTI;
+  cpu.PushWord(0x0300, mem);
+  cpu.PushByte(0x00, mem);
+  cpu.SetFlag(CPU::I_FLAG, true);
+  cpu.SetIRQ(0x01, true);
+
+  // When
+  const s32 CyclesUsed = cpu.Execute(1000, mem, Counters);
+
+  // Then: the rest of the budget the interrupt parked isn't RTI's
+  EXPECT_EQ(CyclesUsed, 6 + CPU::INTERRUPT_CYCLES);
+  EXPECT_EQ(Counters.Executions[CPU::INS_RTI], 1u);
+  EXPECT_EQ(Counters.Cycles[CPU::INS_RTI], 6u);
+  EXPECT_EQ(Counters.ExtraCycles[CPU::INS_RTI], 0u);
+  EXPECT_EQ(Counters.TotalCycles(), 6u);
+}
+
+TEST_F(StatsTests, Counts65C02DecimalModeAsExtraCycles)
+{
+  // Given: SED, ADC #$01 without and ADC $02FF,X with a page crossing
+  VariantCPU<CMOS65C02> Cmos;
+  Cmos.Reset(mem);
+  Cmos.PC = 0x0200;
+  Cmos.X = 0x01;
+  mem[0x0200] = CPU::INS_SED;
+  mem[0x0201] = CPU::INS_ADC_IM;
+  mem[0x0202] = 0x01;
+  mem[0x0203] = CPU::INS_ADC_ABSX;
+  mem[0x0204] = 0xFF;
+  mem[0x0205] = 0x02;
+
+  // When
+  Cmos.Execute(2 + 3 + 6, mem, Counters);
+
+  // Then
+  EXPECT_EQ(Counters.ExtraCycles[CPU::INS_ADC_IM], 1u);
+  EXPECT_EQ(Counters.ExtraCycles[CPU::INS_ADC_ABSX], 2u);
+  EXPECT_EQ(Counters.TotalCycles(), 11u);
+}
@@ -0,0 +1,58 @@
+#include <gtest/gtest.h>
+#include "main_6502.hpp"
+
+using namespace m6502;
+
+class StatusTests : public testing::Test
+{
+  public:
+    Mem mem;
+    CPU cpu;
+
+    virtual void SetUp()
+    {
+      cpu.Reset(mem);
+    }
+
+    virtual void TearDown()
+    {
+    }
+};
+
+TEST_F(StatusTests, StatusRoundTripsEveryFlag)
+{
+  for (int Status = 0; Status < 256; Status++)
+  {
+    // When
+    cpu.SetStatus(Byte(Status));
+
+    // Then
+    EXPECT_EQ(cpu.GetStatus(), Byte(Status | CPU::U_FLAG));
+  }
+}
+
+TEST_F(StatusTests, NegativeAndZeroCanBeSetTogether)
+{
+  // When
+  cpu.SetFlag(CPU::Z_FLAG, true);
+  cpu.SetFlag(CPU::N_FLAG, true);
+
+  // Then
+  EXPECT_TRUE(cpu.GetFlag(CPU::Z_FLAG));
+  EXPECT_TRUE(cpu.GetFlag(CPU::N_FLAG));
+}
+
+TEST_F(StatusTests, LoadSetsNegativeAndZeroFromTheResultOnly)
+{
+  // Given
+  cpu.SetStatus(CPU::C_FLAG | CPU::V_FLAG | CPU::Z_FLAG);
+  cpu.PC = 0x0200;
+  mem[0x0200] = CPU::INS_LDA_IM;
+  mem[0x0201] = 0x80;
+
+  // When
+  cpu.Execute(2, mem);
+
+  // Then
+  EXPECT_EQ(cpu.GetStatus(), CPU::C_FLAG | CPU::V_FLAG | CPU::N_FLAG | CPU::U_FLAG);
+}
@@ -20,13 +20,13 @@ class StoreRegisterTests : public testing::Test
     
     void VerifyUnmodifiedFlagsFromStoreRegister(const CPU& CPUCopy)
     {
-      EXPECT_EQ(cpu.C, CPUCopy.C);
-      EXPECT_EQ(cpu.I, CPUCopy.I);
-      EXPECT_EQ(cpu.D, CPUCopy.D);
-      EXPECT_EQ(cpu.B, CPUCopy.B);
-      EXPECT_EQ(cpu.V, CPUCopy.V);
-      EXPECT_EQ(cpu.Z, CPUCopy.Z);
-      EXPECT_EQ(cpu.N, CPUCopy.N);
+      EXPECT_EQ(cpu.GetFlag(CPU::C_FLAG), CPUCopy.GetFlag(CPU::C_FLAG));
+      EXPECT_EQ(cpu.GetFlag(CPU::I_FLAG), CPUCopy.GetFlag(CPU::I_FLAG));
+      EXPECT_EQ(cpu.GetFlag(CPU::D_FLAG), CPUCopy.GetFlag(CPU::D_FLAG));
+      EXPECT_EQ(cpu.GetFlag(CPU::B_FLAG), CPUCopy.GetFlag(CPU::B_FLAG));
+      EXPECT_EQ(cpu.GetFlag(CPU::V_FLAG), CPUCopy.GetFlag(CPU::V_FLAG));
+      EXPECT_EQ(cpu.GetFlag(CPU::Z_FLAG), CPUCopy.GetFlag(CPU::Z_FLAG));
+      EXPECT_EQ(cpu.GetFlag(CPU::N_FLAG), CPUCopy.GetFlag(CPU::N_FLAG));
     }
 
     void StoreRegisterZeroPage(m6502::Byte OpCodeToTest, m6502::Byte m6502::CPU::*RegisterToTest);
@@ -78,8 +78,8 @@ void StoreRegisterTests::StoreRegisterAbsolute(m6502::Byte OpCodeToTest, m6502::
   // Given
   cpu.*RegisterToTest = 0x2F;
   mem[0xFFFC] = OpCodeToTest;
-  mem[0xFFFD] = 0x80;
-  mem[0xFFFE] = 0x00;
+  mem[0xFFFD] = 0x00;
+  mem[0xFFFE] = 0x80;
   mem[0x8000] = 0x00;
   constexpr u32 NUM_CYCLES = 4;
 
@@ -194,12 +194,12 @@ TEST_F(StoreRegisterTests, STYZeroPageCanStoreYRegisterIntoMemory)
 
 TEST_F(StoreRegisterTests, STAZeroPageXCanStoreARegisterIntoMemory)
 {
-  StoreRegisterZeroPage(CPU::INS_STA_ZPX, &CPU::A);
+  StoreRegisterZeroPageX(CPU::INS_STA_ZPX, &CPU::A);
 }
 
 TEST_F(StoreRegisterTests, STYZeroPageXCanStoreYRegisterIntoMemory)
 {
-  StoreRegisterZeroPage(CPU::INS_STY_ZPX, &CPU::Y);
+  StoreRegisterZeroPageX(CPU::INS_STY_ZPX, &CPU::Y);
 }
 
 TEST_F(StoreRegisterTests, STAAbsoluteCanStoreARegisterIntoMemory)
@@ -0,0 +1,354 @@
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "main_6502.hpp"
+#include "trace_6502.hpp"
+
+using namespace m6502;
+
+class TraceTests : public testing::Test
+{
+  public:
+    Mem mem;
+    CPU cpu;
+    std::string Path;
+
+    virtual void SetUp()
+    {
+      cpu.Reset(mem);
+      cpu.PC = 0x0200;
+      Path = testing::TempDir() + "m6502_trace_test.m65t";
+    }
+
+    virtual void TearDown()
+    {
+      remove(Path.c_str());
+    }
+
+    static void ExpectSameRecord(const TraceRecord& Actual, const TraceRecord& Expected)
+    {
+      EXPECT_EQ(Actual.Cycle, Expected.Cycle);
+      EXPECT_EQ(Actual.PC, Expected.PC);
+      EXPECT_EQ(Actual.SP, Expected.SP);
+      EXPECT_EQ(Actual.Opcode, Expected.Opcode);
+      EXPECT_EQ(Actual.Operand[0], Expected.Operand[0]);
+      EXPECT_EQ(Actual.Operand[1], Expected.Operand[1]);
+      EXPECT_EQ(Actual.A, Expected.A);
+      EXPECT_EQ(Actual.X, Expected.X);
+      EXPECT_EQ(Actual.Y, Expected.Y);
+      EXPECT_EQ(Actual.P, Expected.P);
+    }
+};
+
+TEST_F(TraceTests, EncodedRecordsDecodeToTheSameRecords)
+{
+  // Given, a jump, a page crossing and a register that changes
+  const TraceRecord Records[] = {
+    { 2, 0x0200, 0x0100, CPU::INS_LDA_IM, { 0x80, 0 }, 0x80, 0, 0, 0xA0 },
+    { 7, 0x0202, 0x0100, CPU::INS_LDA_ABSX, { 0xFF, 0x40 }, 0x12, 0, 0, 0x20 },
+    { 13, 0x0300, 0x0101, CPU::INS_JSR, { 0x00, 0x03 }, 0x12, 0, 0, 0x20 },
+    { 1000013, 0x0303, 0x0101, CPU::INS_STY_ZP, { 0x10, 0 }, 0x12, 0, 0, 0x20 },
+  };
+  TraceEncoder Encoder;
+  std::vector<Byte> Encoded;
+  for (const TraceRecord& Record : Records)
+  {
+    Encoder.Encode(Record, Encoded);
+  }
+
+  // When
+  TraceDecoder Decoder;
+  const Byte* Cursor = Encoded.data();
+  const Byte* End = Encoded.data() + Encoded.size();
+  std::vector<TraceRecord> Decoded;
+  TraceRecord Record;
+  while (Decoder.Decode(Cursor, End, Record))
+  {
+    Decoded.push_back(Record);
+  }
+
+  // Then
+  ASSERT_EQ(Decoded.size(), 4u);
+  for (size_t Index = 0; Index < Decoded.size(); Index++)
+  {
+    ExpectSameRecord(Decoded[Index], Records[Index]);
+  }
+  EXPECT_EQ(Cursor, End);
+}
+
+TEST_F(TraceTests, SequentialInstructionsEncodeCompactly)
+{
+  // Given
+  TraceEncoder Encoder;
+  std::vector<Byte> Encoded;
+  Encoder.Encode({ 2, 0x0000, 0, CPU::INS_LDA_IM, { 0x11, 0 }, 0x11, 0, 0, 0x20 }, Encoded);
+  const size_t First = Encoded.size();
+
+  // When, same registers, next PC and base cycles
+  Encoder.Encode({ 5, 0x0002, 0, CPU::INS_STA_ZP, { 0x10, 0 }, 0x11, 0, 0, 0x20 }, Encoded);
+
+  // Then, mask, opcode and operand
+  EXPECT_EQ(Encoded.size() - First, 3u);
+}
+
+TEST_F(TraceTests, RingReportsFullAndEmpty)
+{
+  // Given
+  TraceRing Ring(3); // Rounded up to 4
+  TraceRecord Record{};
+
+  // When, Then
+  EXPECT_FALSE(Ring.TryPop(Record));
+  for (u64 Cycle = 1; Cycle <= 4; Cycle++)
+  {
+    Record.Cycle = Cycle;
+    EXPECT_TRUE(Ring.TryPush(Record));
+  }
+  EXPECT_FALSE(Ring.TryPush(Record));
+  ASSERT_TRUE(Ring.TryPop(Record));
+  EXPECT_EQ(Record.Cycle, 1u);
+  EXPECT_TRUE(Ring.TryPush(Record));
+}
+
+TEST_F(TraceTests, TracedRunCanBeReadBack)
+{
+  // Given
+  mem[0x0200] = CPU::INS_LDA_IM;
+  mem[0x0201] = 0x80;
+  mem[0x0202] = CPU::INS_STA_ZP;
+  mem[0x0203] = 0x10;
+  mem[0x0204] = CPU::INS_JSR;
+  mem[0x0205] = 0x00;
+  mem[0x0206] = 0x03;
+  mem[0x0300] = CPU::INS_LDX_IM;
+  mem[0x0301] = 0x00;
+  mem[0x0302] = CPU::INS_JAM;
+
+  // When, a small ring so the writer has to keep up
+  {
+    Tracer Trace(Path.c_str(), 2);
+    ASSERT_TRUE(Trace.IsOpen());
+    RunResult Result = cpu.Run(100, mem, Trace);
+    EXPECT_EQ(Result.Reason, StopReason::Halt);
+    EXPECT_TRUE(Trace.Close());
+  }
+
+  // Then
+  TraceReader Reader(Path.c_str());
+  ASSERT_TRUE(Reader.IsOpen());
+  const Byte N = CPU::N_FLAG | CPU::U_FLAG;
+  const Byte Z = CPU::Z_FLAG | CPU::U_FLAG;
+  const TraceRecord Expected[] = {
+    { 2, 0x0200, 0x0100, CPU::INS_LDA_IM, { 0x80, 0 }, 0x80, 0, 0, N },
+    { 5, 0x0202, 0x0100, CPU::INS_STA_ZP, { 0x10, 0 }, 0x80, 0, 0, N },
+    { 11, 0x0204, 0x01FE, CPU::INS_JSR, { 0x00, 0x03 }, 0x80, 0, 0, N },
+    { 13, 0x0300, 0x01FE, CPU::INS_LDX_IM, { 0x00, 0 }, 0x80, 0, 0, Z },
+  };
+  TraceRecord Record;
+  for (const TraceRecord& Want : Expected)
+  {
+    ASSERT_TRUE(Reader.Next(Record));
+    ExpectSameRecord(Record, Want);
+  }
+  EXPECT_FALSE(Reader.Next(Record));
+}
+
+TEST_F(TraceTests, OperandsAreRecordedAsFetched)
+{
+  // Given: STA $0204 overwrites its own operand, then the code in an I/O page runs
+  struct Device
+  {
+    Byte Code[3] = { CPU::INS_LDA_IM, 0x42, CPU::INS_JAM };
+    u32 Reads = 0;
+
+    static Byte Read(void* Context, Word Address)
+    {
+      Device& Self = *static_cast<Device*>(Context);
+      Self.Reads++;
+      return Self.Code[Address % 3];
+    }
+
+    static void Write(void*, Word, Byte)
+    {
+    }
+  } Rom;
+  mem.MapIO(0xC0, 1, &Device::Read, &Device::Write, &Rom);
+  mem[0x0200] = CPU::INS_LDA_IM;
+  mem[0x0201] = 0x55;
+  mem[0x0202] = CPU::INS_STA_ABS;
+  mem[0x0203] = 0x04;
+  mem[0x0204] = 0x02;
+  mem[0x0205] = CPU::INS_JMP_ABS;
+  mem[0x0206] = 0x00;
+  mem[0x0207] = 0xC0;
+
+  // When
+  {
+    Tracer Trace(Path.c_str());
+    ASSERT_TRUE(Trace.IsOpen());
+    cpu.Run(100, mem, Trace);
+  }
+
+  // Then: only the CPU read the I/O page, once per byte
+  EXPECT_EQ(mem[0x0204], 0x55);
+  EXPECT_EQ(Rom.Reads, 3u);
+  TraceReader Reader(Path.c_str());
+  ASSERT_TRUE(Reader.IsOpen());
+  TraceRecord Record;
+  ASSERT_TRUE(Reader.Next(Record));
+  ASSERT_TRUE(Reader.Next(Record));
+  EXPECT_EQ(Record.Opcode, CPU::INS_STA_ABS);
+  EXPECT_EQ(Record.Operand[0], 0x04);
+  EXPECT_EQ(Record.Operand[1], 0x02);
+  ASSERT_TRUE(Reader.Next(Record));
+  ASSERT_TRUE(Reader.Next(Record));
+  EXPECT_EQ(Record.PC, 0xC000);
+  EXPECT_EQ(Record.Operand[0], 0x00); // Peeked from the RAM under the I/O page
+}
+
+TEST_F(TraceTests, IndexFindsExecutionsAndStatesAcrossChunks)
+{
+  // Given, a loop at 0x0200 that enters a routine at 0xC000 every 1000 records
+  const u32 NUM_RECORDS = 3 * TraceChunk::CHUNK_RECORDS + 100;
+  {
+    TraceWriter Writer;
+    ASSERT_TRUE(Writer.Open(Path.c_str()));
+    u64 Cycle = 0;
+    for (u32 Index = 0; Index < NUM_RECORDS; Index++)
+    {
+      Cycle += 2;
+      const Word PC = (Index % 1000 == 999) ? 0xC000 : Word(0x0200 + (Index % 1000) * 2);
+      Writer.Append({ Cycle, PC, 0x0100, CPU::INS_LDA_IM, { Byte(Index), 0 }, Byte(Index), 0, 0, 0x20 });
+    }
+  }
+
+  // When
+  TraceReader Reader(Path.c_str());
+
+  // Then
+  ASSERT_TRUE(Reader.IsOpen());
+  EXPECT_EQ(Reader.Chunks().size(), 4u);
+  EXPECT_EQ(Reader.Records(), NUM_RECORDS);
+  EXPECT_TRUE(Reader.Chunks()[0].MayHavePC(0xC000));
+  EXPECT_FALSE(Reader.Chunks()[0].MayHavePC(0x8000));
+
+  TraceRecord Record;
+  ASSERT_TRUE(Reader.FindExecution(0xC000, 0, Record));
+  EXPECT_EQ(Record.Cycle, 2000u);
+  ASSERT_TRUE(Reader.FindExecution(0xC000, 2 * 9000, Record));
+  EXPECT_EQ(Record.Cycle, 20000u); // Record 9999, in the third chunk
+  EXPECT_EQ(Record.A, Byte(9999));
+  EXPECT_FALSE(Reader.FindExecution(0x8000, 0, Record));
+
+  ASSERT_TRUE(Reader.StateAt(2 * 5000 + 1, Record)); // Between records 4999 and 5000
+  EXPECT_EQ(Record.Cycle, 10000u);
+  EXPECT_EQ(Record.A, Byte(4999));
+  EXPECT_EQ(Record.PC, 0xC000);
+  ASSERT_TRUE(Reader.StateAt(2 * TraceChunk::CHUNK_RECORDS, Record)); // Last record of the first chunk
+  EXPECT_EQ(Record.A, Byte(TraceChunk::CHUNK_RECORDS - 1));
+  EXPECT_FALSE(Reader.StateAt(1, Record));
+}
+
+TEST_F(TraceTests, ReaderRejectsTruncatedTraces)
+{
+  // Given, a trace that lost its index
+  {
+    TraceWriter Writer;
+    ASSERT_TRUE(Writer.Open(Path.c_str()));
+    Writer.Append({ 2, 0x0200, 0x0100, CPU::INS_LDA_IM, { 0x11, 0 }, 0x11, 0, 0, 0x20 });
+  }
+  FILE* File = fopen(Path.c_str(), "rb");
+  std::vector<char> Contents(4096);
+  Contents.resize(fread(Contents.data(), 1, Contents.size(), File));
+  fclose(File);
+  File = fopen(Path.c_str(), "wb");
+  fwrite(Contents.data(), 1, Contents.size() - 1, File);
+  fclose(File);
+
+  // When
+  TraceReader Reader(Path.c_str());
+
+  // Then
+  EXPECT_FALSE(Reader.IsOpen());
+}
+
+TEST_F(TraceTests, ReaderRejectsIndexOffsetsOutsideTheFile)
+{
+  // Given, a complete trace
+  {
+    TraceWriter Writer;
+    ASSERT_TRUE(Writer.Open(Path.c_str()));
+    Writer.Append({ 2, 0x0200, 0x0100, CPU::INS_LDA_IM, { 0x11, 0 }, 0x11, 0, 0, 0x20 });
+  }
+  {
+    TraceReader Reader(Path.c_str());
+    ASSERT_TRUE(Reader.IsOpen());
+  }
+  FILE* File = fopen(Path.c_str(), "rb");
+  std::vector<Byte> Contents(1 << 16);
+  Contents.resize(fread(Contents.data(), 1, Contents.size(), File));
+  fclose(File);
+
+  // An offset that only reaches the end of the index by wrapping around, and one past the end
+  const u64 IndexEnd = Contents.size() - (8 + 4 + sizeof(TRACE_INDEX_MAGIC));
+  const u64 ChunkCount = IndexEnd / TraceChunk::SERIALISED_SIZE + 1;
+  const u64 Offsets[] = { IndexEnd - ChunkCount * TraceChunk::SERIALISED_SIZE, IndexEnd + 1 };
+  for (const u64 Offset : Offsets)
+  {
+    std::vector<Byte> Corrupt = Contents;
+    for (int Index = 0; Index < 8; Index++)
+    {
+      Corrupt[IndexEnd + Index] = Byte(Offset >> (Index * 8));
+    }
+    for (int Index = 0; Index < 4; Index++)
+    {
+      Corrupt[IndexEnd + 8 + Index] = Byte(ChunkCount >> (Index * 8));
+    }
+    File = fopen(Path.c_str(), "wb");
+    fwrite(Corrupt.data(), 1, Corrupt.size(), File);
+    fclose(File);
+
+    // When
+    TraceReader Reader(Path.c_str());
+
+    // Then
+    EXPECT_FALSE(Reader.IsOpen());
+  }
+}
+
+TEST_F(TraceTests, ReaderRejectsFilesThatAreNotTraces)
+{
+  // Given
+  FILE* File = fopen(Path.c_str(), "wb");
+  fputs("not a trace", File);
+  fclose(File);
+
+  // When
+  TraceReader Reader(Path.c_str());
+
+  // Then
+  EXPECT_FALSE(Reader.IsOpen());
+}
+
+TEST_F(TraceTests, FailedWritesAreReported)
+{
+  // Given, a device that takes no bytes
+  TraceWriter Writer;
+  if (!Writer.Open("/dev/full"))
+  {
+    GTEST_SKIP() << "No /dev/full on this system";
+  }
+
+  // When
+  for (u32 Index = 0; Index < 2 * TraceChunk::CHUNK_RECORDS; Index++)
+  {
+    Writer.Append({ 2 * u64(Index), 0x0200, 0x0100, CPU::INS_LDA_IM, { Byte(Index), 0 }, Byte(Index), 0, 0, 0x20 });
+  }
+  const bool Closed = Writer.Close();
+
+  // Then
+  EXPECT_FALSE(Closed);
+  EXPECT_TRUE(Writer.Failed());
+  EXPECT_FALSE(Writer.Close());
+}
@@ -0,0 +1,142 @@
+#include <gtest/gtest.h>
+#include "main_6502.hpp"
+#include "instructions_6502.hpp"
+#include "stats_6502.hpp"
+
+using namespace m6502;
+
+class VariantTests : public testing::Test
+{
+  public:
+    Mem mem;
+    CPU6502 Nmos;
+    CPU65C02 Cmos;
+    CPU2A03 Ricoh;
+
+    virtual void SetUp()
+    {
+      Nmos.Reset(mem);
+      Cmos.Reset(mem);
+      Ricoh.Reset(mem);
+      Nmos.PC = Cmos.PC = Ricoh.PC = 0x0200;
+    }
+
+    virtual void TearDown()
+    {
+    }
+};
+
+TEST_F(VariantTests, OnlyTheCMOSPartFixesJumpIndirectAcrossAPage)
+{
+  // Given: JMP ($02FF), the target's high byte at $0300 and, wrapped, at $0200
+  mem[0x0200] = CPU::INS_JMP_IND;
+  mem[0x0201] = 0xFF;
+  mem[0x0202] = 0x02;
+  mem[0x02FF] = 0x34;
+  mem[0x0300] = 0x12;
+  CPU Plain = Nmos;
+
+  // When
+  const RunResult NmosResult = Nmos.Run(1, mem);
+  const RunResult CmosResult = Cmos.Run(1, mem);
+  const RunResult PlainResult = Plain.Run(1, mem);
+
+  // Then
+  EXPECT_EQ(NmosResult.PC, 0x6C34);
+  EXPECT_EQ(NmosResult.CyclesUsed, 5);
+  EXPECT_EQ(PlainResult.PC, 0x6C34);
+  EXPECT_EQ(CmosResult.PC, 0x1234);
+  EXPECT_EQ(CmosResult.CyclesUsed, 6);
+}
+
+TEST_F(VariantTests, CMOSInstructionsOnlyRunOnTheCMOSPart)
+{
+  // Given: LDA #$55, STA ($10), STZ $20, LDA ($10), JMP ($0400,X)
+  mem[0x0010] = 0x00;
+  mem[0x0011] = 0x03;
+  mem[0x0020] = 0x77;
+  mem[0x0200] = CPU::INS_LDA_IM;
+  mem[0x0201] = 0x55;
+  mem[0x0202] = CPU::INS_STA_ZPI;
+  mem[0x0203] = 0x10;
+  mem[0x0204] = CPU::INS_STZ_ZP;
+  mem[0x0205] = 0x20;
+  mem[0x0206] = CPU::INS_LDA_ZPI;
+  mem[0x0207] = 0x10;
+  mem[0x0208] = CPU::INS_JMP_ABSX;
+  mem[0x0209] = 0x00;
+  mem[0x020A] = 0x04;
+  mem[0x0400] = 0x00;
+  mem[0x0401] = 0x05;
+  mem[0x0500] = CPU::INS_JAM;
+  const Mem Program = mem;
+
+  // When
+  const RunResult CmosResult = Cmos.Run(100, mem);
+  Mem NmosMem = Program;
+  const RunResult NmosResult = Nmos.Run(100, NmosMem);
+
+  // Then: JAM is no instruction on the 65C02
+  EXPECT_EQ(CmosResult.Reason, StopReason::IllegalOpcode);
+  EXPECT_EQ(CmosResult.PC, 0x0500);
+  EXPECT_EQ(CmosResult.CyclesUsed, 2 + 5 + 3 + 5 + 6);
+  EXPECT_EQ(mem[0x0300], 0x55);
+  EXPECT_EQ(mem[0x0020], 0x00);
+  EXPECT_EQ(Cmos.A, 0x55);
+  EXPECT_EQ(NmosResult.Reason, StopReason::IllegalOpcode);
+  EXPECT_EQ(NmosResult.PC, 0x0202);
+  EXPECT_EQ(NmosResult.Opcode, CPU::INS_STA_ZPI);
+}
+
+TEST_F(VariantTests, NMOSPartsHaltOnJam)
+{
+  // Given
+  mem[0x0200] = CPU::INS_JAM;
+
+  // When
+  const RunResult NmosResult = Nmos.Run(10, mem);
+  const RunResult RicohResult = Ricoh.Run(10, mem);
+
+  // Then
+  EXPECT_EQ(NmosResult.Reason, StopReason::Halt);
+  EXPECT_EQ(RicohResult.Reason, StopReason::Halt);
+  EXPECT_EQ(RicohResult.PC, 0x0200);
+}
+
+TEST_F(VariantTests, OnlyTheCMOSPartClearsDecimalOnInterrupts)
+{
+  // Given: BRK into a JAM at 0x0400
+  mem[0x0200] = CPU::INS_BRK;
+  mem[0xFFFE] = 0x00;
+  mem[0xFFFF] = 0x04;
+  mem[0x0400] = CPU::INS_JAM;
+  Nmos.SetFlag(CPU::D_FLAG, true);
+  Cmos.SetFlag(CPU::D_FLAG, true);
+
+  // When
+  Nmos.Run(10, mem);
+  Cmos.Run(10, mem);
+
+  // Then
+  EXPECT_EQ(Nmos.PC, 0x0400);
+  EXPECT_TRUE(Nmos.GetFlag(CPU::D_FLAG));
+  EXPECT_EQ(Cmos.PC, 0x0400);
+  EXPECT_FALSE(Cmos.GetFlag(CPU::D_FLAG));
+}
+
+TEST_F(VariantTests, VariantsRunWithInstrumentation)
+{
+  // Given
+  mem[0x0200] = CPU::INS_STZ_ABS;
+  mem[0x0201] = 0x00;
+  mem[0x0202] = 0x03;
+  Stats Counters;
+
+  // When
+  Cmos.Execute(4, mem, Counters);
+
+  // Then
+  EXPECT_EQ(Counters.Executions[CPU::INS_STZ_ABS], 1u);
+  EXPECT_EQ(VariantOpcodeTable<CMOS65C02>[CPU::INS_JMP_IND].Cycles, 6);
+  EXPECT_EQ(VariantOpcodeTable<Ricoh2A03>[CPU::INS_JMP_IND].Cycles, 5);
+}
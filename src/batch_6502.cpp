@@ -0,0 +1,418 @@
+#include <batch_6502.hpp>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define M6502_BATCH_SSE2 1
+#else
+#define M6502_BATCH_SSE2 0
+#endif
+
+// AVX2 is compiled per function and picked at run time, GCC and Clang only
+#if M6502_BATCH_SSE2 && (defined(__GNUC__) || defined(__clang__))
+#define M6502_BATCH_AVX2 1
+#else
+#define M6502_BATCH_AVX2 0
+#endif
+
+namespace
+{
+    using namespace m6502;
+
+    void CommitLoadScalar(Byte* Register, Byte* Z, Byte* N, const Byte* Values, const Byte* Mask, u32 Begin, u32 Count)
+    {
+        for (u32 i = Begin; i < Count; i++)
+        {
+            if (Mask[i])
+            {
+                Register[i] = Values[i];
+                Z[i] = (Values[i] == 0);
+                N[i] = (Values[i] & 0b10000000) > 0;
+            }
+        }
+    }
+
+#if M6502_BATCH_SSE2
+    u32 CommitLoadSSE2(Byte* Register, Byte* Z, Byte* N, const Byte* Values, const Byte* Mask, u32 Count)
+    {
+        const __m128i One = _mm_set1_epi8(1);
+        const __m128i Zero = _mm_setzero_si128();
+        auto Blend = [](__m128i Select, __m128i New, __m128i Old)
+        {
+            return _mm_or_si128(_mm_and_si128(Select, New), _mm_andnot_si128(Select, Old));
+        };
+
+        u32 i = 0;
+        for (; i + 16 <= Count; i += 16)
+        {
+            const __m128i Select = _mm_loadu_si128((const __m128i*)(Mask + i));
+            const __m128i Value = _mm_loadu_si128((const __m128i*)(Values + i));
+            // Bit 7 of each byte shifted down, the bits coming from the next byte are masked off
+            const __m128i NewN = _mm_and_si128(_mm_srli_epi16(Value, 7), One);
+            const __m128i NewZ = _mm_and_si128(_mm_cmpeq_epi8(Value, Zero), One);
+
+            __m128i* Reg = (__m128i*)(Register + i);
+            __m128i* ZFlag = (__m128i*)(Z + i);
+            __m128i* NFlag = (__m128i*)(N + i);
+            _mm_storeu_si128(Reg, Blend(Select, Value, _mm_loadu_si128(Reg)));
+            _mm_storeu_si128(ZFlag, Blend(Select, NewZ, _mm_loadu_si128(ZFlag)));
+            _mm_storeu_si128(NFlag, Blend(Select, NewN, _mm_loadu_si128(NFlag)));
+        }
+        return i;
+    }
+#endif
+
+#if M6502_BATCH_AVX2
+    __attribute__((target("avx2")))
+    u32 CommitLoadAVX2(Byte* Register, Byte* Z, Byte* N, const Byte* Values, const Byte* Mask, u32 Count)
+    {
+        const __m256i One = _mm256_set1_epi8(1);
+        const __m256i Zero = _mm256_setzero_si256();
+
+        u32 i = 0;
+        for (; i + 32 <= Count; i += 32)
+        {
+            const __m256i Select = _mm256_loadu_si256((const __m256i*)(Mask + i));
+            const __m256i Value = _mm256_loadu_si256((const __m256i*)(Values + i));
+            const __m256i NewN = _mm256_and_si256(_mm256_srli_epi16(Value, 7), One);
+            const __m256i NewZ = _mm256_and_si256(_mm256_cmpeq_epi8(Value, Zero), One);
+
+            __m256i* Reg = (__m256i*)(Register + i);
+            __m256i* ZFlag = (__m256i*)(Z + i);
+            __m256i* NFlag = (__m256i*)(N + i);
+            _mm256_storeu_si256(Reg, _mm256_blendv_epi8(_mm256_loadu_si256(Reg), Value, Select));
+            _mm256_storeu_si256(ZFlag, _mm256_blendv_epi8(_mm256_loadu_si256(ZFlag), NewZ, Select));
+            _mm256_storeu_si256(NFlag, _mm256_blendv_epi8(_mm256_loadu_si256(NFlag), NewN, Select));
+        }
+        return i;
+    }
+
+    bool DetectAVX2()
+    {
+        __builtin_cpu_init(); // May run before the CPU model is initialised
+        return __builtin_cpu_supports("avx2");
+    }
+
+    const bool HasAVX2 = DetectAVX2();
+#endif
+
+    void CommitArithmeticScalar(Byte* A, Byte* C, Byte* Z, Byte* V, Byte* N, const Byte* Values, const Byte* Mask,
+        bool Subtract, u32 Begin, u32 Count)
+    {
+        for (u32 i = Begin; i < Count; i++)
+        {
+            if (Mask[i])
+            {
+                const ArithmeticResult Result = Subtract ? BinarySubtract(A[i], Values[i], C[i]) : BinaryAdd(A[i], Values[i], C[i]);
+                A[i] = Result.Result;
+                C[i] = (Result.Flags & CPU::C_FLAG) != 0;
+                Z[i] = (Result.Flags & CPU::Z_FLAG) != 0;
+                V[i] = (Result.Flags & CPU::V_FLAG) != 0;
+                N[i] = (Result.Flags & CPU::N_FLAG) != 0;
+            }
+        }
+    }
+
+#if M6502_BATCH_SSE2
+    u32 CommitArithmeticSSE2(Byte* A, Byte* C, Byte* Z, Byte* V, Byte* N, const Byte* Values, const Byte* Mask,
+        bool Subtract, u32 Count)
+    {
+        const __m128i One = _mm_set1_epi8(1);
+        const __m128i Zero = _mm_setzero_si128();
+        const __m128i Invert = _mm_set1_epi8(Subtract ? char(0xFF) : 0);
+        auto Blend = [](__m128i Select, __m128i New, __m128i Old)
+        {
+            return _mm_or_si128(_mm_and_si128(Select, New), _mm_andnot_si128(Select, Old));
+        };
+        // 1 where the wrapping sum differs from the saturating one, which is where it carried
+        auto CarryOut = [One](__m128i Lhs, __m128i Rhs, __m128i Sum)
+        {
+            return _mm_andnot_si128(_mm_cmpeq_epi8(_mm_adds_epu8(Lhs, Rhs), Sum), One);
+        };
+
+        u32 i = 0;
+        for (; i + 16 <= Count; i += 16)
+        {
+            const __m128i Select = _mm_loadu_si128((const __m128i*)(Mask + i));
+            const __m128i OldA = _mm_loadu_si128((const __m128i*)(A + i));
+            const __m128i OldC = _mm_loadu_si128((const __m128i*)(C + i));
+            const __m128i Operand = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(Values + i)), Invert);
+            const __m128i Partial = _mm_add_epi8(OldA, Operand);
+            const __m128i Result = _mm_add_epi8(Partial, OldC);
+            const __m128i NewC = _mm_or_si128(CarryOut(OldA, Operand, Partial), CarryOut(Partial, OldC, Result));
+            // Both inputs of the same sign and the result of the other
+            const __m128i Overflow = _mm_andnot_si128(_mm_xor_si128(OldA, Operand), _mm_xor_si128(OldA, Result));
+            const __m128i NewV = _mm_and_si128(_mm_srli_epi16(Overflow, 7), One);
+            const __m128i NewZ = _mm_and_si128(_mm_cmpeq_epi8(Result, Zero), One);
+            const __m128i NewN = _mm_and_si128(_mm_srli_epi16(Result, 7), One);
+
+            __m128i* VFlag = (__m128i*)(V + i);
+            __m128i* ZFlag = (__m128i*)(Z + i);
+            __m128i* NFlag = (__m128i*)(N + i);
+            _mm_storeu_si128((__m128i*)(A + i), Blend(Select, Result, OldA));
+            _mm_storeu_si128((__m128i*)(C + i), Blend(Select, NewC, OldC));
+            _mm_storeu_si128(VFlag, Blend(Select, NewV, _mm_loadu_si128(VFlag)));
+            _mm_storeu_si128(ZFlag, Blend(Select, NewZ, _mm_loadu_si128(ZFlag)));
+            _mm_storeu_si128(NFlag, Blend(Select, NewN, _mm_loadu_si128(NFlag)));
+        }
+        return i;
+    }
+#endif
+}
+
+void m6502::CommitLoad(Byte* Register, Byte* Z, Byte* N, const Byte* Values, const Byte* Mask, u32 Count)
+{
+    u32 Done = 0;
+#if M6502_BATCH_AVX2
+    if (HasAVX2)
+    {
+        Done = CommitLoadAVX2(Register, Z, N, Values, Mask, Count);
+    }
+#endif
+#if M6502_BATCH_SSE2
+    Done += CommitLoadSSE2(Register + Done, Z + Done, N + Done, Values + Done, Mask + Done, Count - Done);
+#endif
+    CommitLoadScalar(Register, Z, N, Values, Mask, Done, Count);
+}
+
+void m6502::CommitArithmetic(Byte* A, Byte* C, Byte* Z, Byte* V, Byte* N, const Byte* Values, const Byte* Mask, bool Subtract, u32 Count)
+{
+    u32 Done = 0;
+#if M6502_BATCH_SSE2
+    Done = CommitArithmeticSSE2(A, C, Z, V, N, Values, Mask, Subtract, Count);
+#endif
+    CommitArithmeticScalar(A, C, Z, V, N, Values, Mask, Subtract, Done, Count);
+}
+
+void m6502::HaltLanes(CPUBatch& batch, Byte, const std::vector<u32>& Lanes)
+{
+    for (u32 Lane : Lanes)
+    {
+        batch.Halted[Lane] = 1;
+    }
+}
+
+void m6502::LockstepLanes(CPUBatch& batch, Byte Opcode, Word)
+{
+    BatchTable[Opcode](batch, Opcode, batch.ActiveLanes());
+}
+
+m6502::CPUBatch::CPUBatch(u32 NumLanes)
+    : PC(NumLanes), SP(NumLanes),
+      A(NumLanes), X(NumLanes), Y(NumLanes),
+      C(NumLanes), Z(NumLanes), I(NumLanes), D(NumLanes), B(NumLanes), V(NumLanes), N(NumLanes),
+      Cycles(NumLanes), Halted(NumLanes), Memory(NumLanes),
+      Values(NumLanes), Mask(NumLanes), Active(NumLanes)
+{
+}
+
+void m6502::CPUBatch::SetLane(u32 Lane, const CPU& cpu, Mem& memory)
+{
+    PC[Lane] = cpu.PC;
+    SP[Lane] = cpu.SP;
+    A[Lane] = cpu.A;
+    X[Lane] = cpu.X;
+    Y[Lane] = cpu.Y;
+    C[Lane] = cpu.GetFlag(CPU::C_FLAG);
+    Z[Lane] = cpu.GetFlag(CPU::Z_FLAG);
+    I[Lane] = cpu.GetFlag(CPU::I_FLAG);
+    D[Lane] = cpu.GetFlag(CPU::D_FLAG);
+    B[Lane] = cpu.GetFlag(CPU::B_FLAG);
+    V[Lane] = cpu.GetFlag(CPU::V_FLAG);
+    N[Lane] = cpu.GetFlag(CPU::N_FLAG);
+    Memory[Lane] = &memory;
+}
+
+void m6502::CPUBatch::GetLane(u32 Lane, CPU& cpu) const
+{
+    cpu.PC = PC[Lane];
+    cpu.SP = SP[Lane];
+    cpu.A = A[Lane];
+    cpu.X = X[Lane];
+    cpu.Y = Y[Lane];
+    cpu.SetStatus(Byte((C[Lane] ? CPU::C_FLAG : 0) | (Z[Lane] ? CPU::Z_FLAG : 0) |
+        (I[Lane] ? CPU::I_FLAG : 0) | (D[Lane] ? CPU::D_FLAG : 0) | (B[Lane] ? CPU::B_FLAG : 0) |
+        (V[Lane] ? CPU::V_FLAG : 0) | (N[Lane] ? CPU::N_FLAG : 0)));
+}
+
+void m6502::CPUBatch::Advance(Byte Bytes, Byte BaseCycles)
+{
+    const Byte* Running = Active.data();
+    Word* Next = PC.data();
+    s32* Left = Cycles.data();
+    for (u32 Lane = 0; Lane < Lanes(); Lane++)
+    {
+        Next[Lane] = Word(Next[Lane] + (Running[Lane] ? Bytes : 0));
+        Left[Lane] -= Running[Lane] ? BaseCycles : 0;
+    }
+}
+
+const std::vector<m6502::u32>& m6502::CPUBatch::ActiveLanes()
+{
+    LaneList.clear();
+    for (u32 Lane = 0; Lane < Lanes(); Lane++)
+    {
+        if (Active[Lane])
+        {
+            LaneList.push_back(Lane);
+        }
+    }
+    return LaneList;
+}
+
+const std::vector<m6502::u32>& m6502::CPUBatch::SplitLanes(const std::vector<Byte>& Select)
+{
+    LaneList.clear();
+    for (u32 Lane = 0; Lane < Lanes(); Lane++)
+    {
+        if (Active[Lane] && Select[Lane])
+        {
+            Active[Lane] = 0;
+            LaneList.push_back(Lane);
+        }
+    }
+    return LaneList;
+}
+
+namespace
+{
+    // True when Count bytes at Address are the same in both, false for bytes not in host memory
+    bool SameBytes(const Mem& Lhs, const Mem& Rhs, Word Address, Byte Count)
+    {
+        for (Byte i = 0; i < Count; i++)
+        {
+            const Word At = Word(Address + i);
+            const Byte* LhsPage = Lhs.ReadPages[At / Mem::PAGE_SIZE];
+            const Byte* RhsPage = Rhs.ReadPages[At / Mem::PAGE_SIZE];
+            if (LhsPage == nullptr || RhsPage == nullptr || LhsPage[At % Mem::PAGE_SIZE] != RhsPage[At % Mem::PAGE_SIZE])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+bool m6502::CPUBatch::Step()
+{
+    const Byte* Stopped = Halted.data();
+    const s32* Left = Cycles.data();
+    Byte* Running = Active.data();
+    Byte Any = 0;
+    for (u32 Lane = 0; Lane < Lanes(); Lane++)
+    {
+        Running[Lane] = ((Stopped[Lane] == 0) & (Left[Lane] > 0)) ? 0xFF : 0x00;
+        Any |= Running[Lane];
+    }
+    if (!Any)
+    {
+        return false;
+    }
+
+    if (!StepLockstep())
+    {
+        StepDivergent();
+    }
+    return true;
+}
+
+bool m6502::CPUBatch::StepLockstep()
+{
+    Leader = 0;
+    while (!Active[Leader])
+    {
+        Leader++;
+    }
+
+    const Word LockPC = PC[Leader];
+    Byte Diverged = 0;
+    for (u32 Lane = 0; Lane < Lanes(); Lane++)
+    {
+        Diverged |= Active[Lane] & Byte(PC[Lane] != LockPC);
+    }
+    if (Diverged)
+    {
+        return false;
+    }
+
+    const Mem& Code = *Memory[Leader];
+    const Byte* CodePage = Code.ReadPages[LockPC / Mem::PAGE_SIZE];
+    if (CodePage == nullptr)
+    {
+        return false; // Reading code from I/O has side effects, fetch it once per lane
+    }
+    const Byte Opcode = CodePage[LockPC % Mem::PAGE_SIZE];
+    const Instruction& Ins = OpcodeTable[Opcode];
+
+    /*
+    * Every lane's code is checked on every step, a lane's bytes change
+    * whenever it writes to its page. Lanes forked from one machine share
+    * the leader's page until they write to it, so most lanes cost a pointer
+    * compare: a shared page can't be written without being copied first.
+    * The others compare the instruction's bytes.
+    * */
+    const u32 CodePageIndex = LockPC / Mem::PAGE_SIZE;
+    const bool OnePage = (LockPC % Mem::PAGE_SIZE) + Ins.Bytes <= Mem::PAGE_SIZE;
+    if (!OnePage && !SameBytes(Code, Code, LockPC, Ins.Bytes))
+    {
+        return false;
+    }
+    for (u32 Lane = Leader + 1; Lane < Lanes(); Lane++)
+    {
+        if (!Active[Lane])
+        {
+            continue;
+        }
+        const Mem& memory = *Memory[Lane];
+        if (OnePage && memory.ReadPages[CodePageIndex] == CodePage)
+        {
+            continue;
+        }
+        if (!SameBytes(Code, memory, LockPC, Ins.Bytes))
+        {
+            return false;
+        }
+    }
+
+    const Word Operand = Ins.DecodeOperand ? Ins.DecodeOperand(Code, Word(LockPC + 1)) : 0;
+    LockstepTable[Opcode](*this, Opcode, Operand);
+    return true;
+}
+
+void m6502::CPUBatch::StepDivergent()
+{
+    Present.clear();
+    for (u32 Lane = 0; Lane < Lanes(); Lane++)
+    {
+        if (!Active[Lane])
+        {
+            continue;
+        }
+
+        const Mem& memory = *Memory[Lane];
+        const Byte Opcode = memory[PC[Lane]];
+        if (OpcodeLanes[Opcode].empty())
+        {
+            Present.push_back(Opcode);
+        }
+        OpcodeLanes[Opcode].push_back(Lane);
+    }
+
+    for (Byte Opcode : Present)
+    {
+        BatchTable[Opcode](*this, Opcode, OpcodeLanes[Opcode]);
+        OpcodeLanes[Opcode].clear();
+    }
+}
+
+void m6502::CPUBatch::Execute(s32 NumCycles)
+{
+    CyclesRequested = NumCycles;
+    for (s32& LaneCycles : Cycles)
+    {
+        LaneCycles = NumCycles;
+    }
+
+    while (Step())
+    {
+    }
+}
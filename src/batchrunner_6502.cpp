@@ -0,0 +1,219 @@
+#include <batchrunner_6502.hpp>
+#include <limits.h>
+#include <string.h>
+#include <thread>
+
+namespace
+{
+    constexpr m6502::u64 PackRange(m6502::u32 Begin, m6502::u32 End)
+    {
+        return m6502::u64(Begin) | (m6502::u64(End) << 32);
+    }
+
+    constexpr m6502::u32 RangeBegin(m6502::u64 Range)
+    {
+        return m6502::u32(Range);
+    }
+
+    constexpr m6502::u32 RangeEnd(m6502::u64 Range)
+    {
+        return m6502::u32(Range >> 32);
+    }
+
+    // Multiply/xor hash of one page
+    m6502::u64 HashPage(const m6502::Byte* Bytes)
+    {
+        m6502::u64 Value = 0xCBF29CE484222325ull;
+        for (m6502::u32 Index = 0; Index < m6502::Mem::PAGE_SIZE; Index += 8)
+        {
+            m6502::u64 Word;
+            memcpy(&Word, Bytes + Index, 8);
+            Value = (Value ^ Word) * 0x100000001B3ull;
+            Value ^= Value >> 29;
+        }
+        return Value;
+    }
+}
+
+m6502::u64 m6502::MemoryDigest(const Mem& memory)
+{
+    // Most pages of a small program are never written, hash the shared zero page once
+    static const u64 ZeroPageHash = HashPage(Mem::ZeroPage.Bytes);
+
+    u64 Digest = 0;
+    for (u32 Page = 0; Page < Mem::NUM_PAGES; Page++)
+    {
+        const Mem::Page* RAM = memory.RAM[Page];
+        const u64 PageHash = RAM == &Mem::ZeroPage ? ZeroPageHash : HashPage(RAM->Bytes);
+        Digest = (Digest ^ PageHash) * 0x9E3779B97F4A7C15ull;
+        Digest ^= Digest >> 31;
+    }
+    return Digest;
+}
+
+m6502::BatchRunner::BatchRunner(u32 NumWorkers)
+{
+    if (NumWorkers == 0)
+    {
+        NumWorkers = std::thread::hardware_concurrency();
+    }
+    if (NumWorkers == 0)
+    {
+        NumWorkers = 1;
+    }
+
+    WorkerStates.reserve(NumWorkers);
+    for (u32 Index = 0; Index < NumWorkers; Index++)
+    {
+        WorkerStates.push_back(std::make_unique<Worker>());
+    }
+}
+
+m6502::BatchRunner::~BatchRunner() = default;
+
+std::vector<m6502::u64> m6502::BatchRunner::JobsPerWorker() const
+{
+    std::vector<u64> Counts;
+    for (const std::unique_ptr<Worker>& State : WorkerStates)
+    {
+        Counts.push_back(State->JobsRun);
+    }
+    return Counts;
+}
+
+m6502::BatchJobResult m6502::BatchRunner::RunJob(const BatchJob& Job, Machine& machine)
+{
+    CPU& cpu = machine.cpu;
+    Mem& memory = machine.mem;
+    if (Job.Program != nullptr)
+    {
+        Job.Program->LoadRAM(memory);
+    }
+    else
+    {
+        memory.WriteBlock(Job.LoadAddress, Job.Image, Job.Size);
+    }
+    cpu.PC = Job.StartPC;
+
+    // Run takes 32 bit budgets, longer ones run in pieces
+    RunResult Result = { StopReason::CyclesExhausted, 0, cpu.PC, 0 };
+    s64 CyclesUsed = 0;
+    while (CyclesUsed < Job.Cycles)
+    {
+        const s64 Left = Job.Cycles - CyclesUsed;
+        Result = cpu.Run(s32(Left < INT_MAX ? Left : INT_MAX), memory);
+        CyclesUsed += Result.CyclesUsed;
+        if (Result.Reason != StopReason::CyclesExhausted)
+        {
+            break;
+        }
+    }
+
+    BatchJobResult Final;
+    Final.Reason = Result.Reason;
+    Final.Opcode = Result.Opcode;
+    Final.PC = cpu.PC;
+    Final.SP = cpu.SP;
+    Final.A = cpu.A;
+    Final.X = cpu.X;
+    Final.Y = cpu.Y;
+    Final.Status = cpu.GetStatus();
+    Final.CyclesUsed = CyclesUsed;
+    Final.MemoryDigest = MemoryDigest(memory);
+    return Final;
+}
+
+void m6502::BatchRunner::Run(const std::vector<BatchJob>& Jobs, std::vector<BatchJobResult>& Results)
+{
+    Results.resize(Jobs.size());
+
+    // Even contiguous ranges, stealing evens out programs of different lengths
+    const u32 NumJobs = u32(Jobs.size());
+    const u32 NumWorkers = Workers();
+    for (u32 Index = 0; Index < NumWorkers; Index++)
+    {
+        const u32 Begin = u32(u64(NumJobs) * Index / NumWorkers);
+        const u32 End = u32(u64(NumJobs) * (Index + 1) / NumWorkers);
+        WorkerStates[Index]->Range.store(PackRange(Begin, End), std::memory_order_relaxed);
+        WorkerStates[Index]->JobsRun = 0;
+    }
+
+    // The calling thread is worker 0
+    std::vector<std::thread> Threads;
+    Threads.reserve(NumWorkers - 1);
+    for (u32 Index = 1; Index < NumWorkers; Index++)
+    {
+        Threads.emplace_back([this, Index, &Jobs, &Results] { WorkerLoop(Index, Jobs, Results); });
+    }
+    WorkerLoop(0, Jobs, Results);
+    for (std::thread& Thread : Threads)
+    {
+        Thread.join();
+    }
+}
+
+void m6502::BatchRunner::WorkerLoop(u32 Index, const std::vector<BatchJob>& Jobs, std::vector<BatchJobResult>& Results)
+{
+    Worker& Self = *WorkerStates[Index];
+    u32 Job = 0;
+    do
+    {
+        while (TakeJob(Self, Job))
+        {
+            Machine* machine = Self.Pool.Acquire();
+            Results[Job] = RunJob(Jobs[Job], *machine);
+            Self.Pool.Release(machine);
+            Self.JobsRun++;
+        }
+    } while (Steal(Index));
+}
+
+bool m6502::BatchRunner::TakeJob(Worker& Self, u32& Job)
+{
+    u64 Range = Self.Range.load(std::memory_order_relaxed);
+    while (RangeBegin(Range) < RangeEnd(Range))
+    {
+        const u64 Taken = PackRange(RangeBegin(Range) + 1, RangeEnd(Range));
+        if (Self.Range.compare_exchange_weak(Range, Taken, std::memory_order_relaxed))
+        {
+            Job = RangeBegin(Range);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool m6502::BatchRunner::Steal(u32 Thief)
+{
+    // Every job index sits in exactly one range, so a range never goes back to an old value
+    while (true)
+    {
+        Worker* Victim = nullptr;
+        u64 VictimRange = 0;
+        u32 Largest = 0;
+        for (u32 Index = 0; Index < Workers(); Index++)
+        {
+            const u64 Range = WorkerStates[Index]->Range.load(std::memory_order_relaxed);
+            const u32 Remaining = RangeEnd(Range) - RangeBegin(Range);
+            if (Index != Thief && RangeBegin(Range) < RangeEnd(Range) && Remaining > Largest)
+            {
+                Victim = WorkerStates[Index].get();
+                VictimRange = Range;
+                Largest = Remaining;
+            }
+        }
+        if (Victim == nullptr)
+        {
+            return false;
+        }
+
+        // The victim keeps the front half, which it is working through
+        const u32 Middle = RangeBegin(VictimRange) + Largest / 2;
+        if (Victim->Range.compare_exchange_strong(VictimRange, PackRange(RangeBegin(VictimRange), Middle),
+            std::memory_order_relaxed))
+        {
+            WorkerStates[Thief]->Range.store(PackRange(Middle, RangeEnd(VictimRange)), std::memory_order_relaxed);
+            return true;
+        }
+    }
+}
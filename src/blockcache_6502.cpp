@@ -0,0 +1,223 @@
+#include <blockcache_6502.hpp>
+#include <fusion_6502.hpp>
+
+m6502::BlockCache::BlockCache(bool Fusion)
+    : Blocks(Mem::MAX_MEM)
+    , Fusion(Fusion)
+{
+    Flush();
+}
+
+void m6502::BlockCache::Flush()
+{
+    for (std::unique_ptr<Block>& Entry : Blocks)
+    {
+        Entry.reset();
+    }
+    for (std::vector<Word>& Starts : PageBlocks)
+    {
+        Starts.clear();
+    }
+    for (u64& Bits : CodePages)
+    {
+        Bits = 0;
+    }
+}
+
+void m6502::BlockCache::SetFusion(bool Enabled)
+{
+    if (Enabled != Fusion)
+    {
+        Fusion = Enabled;
+        Flush();
+    }
+}
+
+void m6502::BlockCache::Invalidate(Mem& memory)
+{
+    for (u32 Page = 0; Page < Mem::NUM_PAGES; Page++)
+    {
+        const u64 Bit = 1ull << (Page % 64);
+        if (!(CodePages[Page / 64] & Bit) || !(memory.CodeWrites[Page / 64] & Bit))
+        {
+            continue;
+        }
+
+        // A block spanning two pages may already be gone, or replaced by a
+        // new one at the same PC. Dropping it again is harmless.
+        for (Word StartPC : PageBlocks[Page])
+        {
+            Blocks[StartPC].reset();
+        }
+        PageBlocks[Page].clear();
+        CodePages[Page / 64] &= ~Bit;
+    }
+    for (u64& Bits : memory.CodeWrites)
+    {
+        Bits = 0;
+    }
+}
+
+const m6502::Block& m6502::BlockCache::Lookup(Word PC, Mem& memory)
+{
+    if (CodeModified(memory))
+    {
+        Invalidate(memory);
+    }
+
+    if (const Block* Cached = Blocks[PC].get())
+    {
+        return *Cached;
+    }
+    return Decode(PC, memory);
+}
+
+const m6502::Block& m6502::BlockCache::Decode(Word PC, const Mem& memory)
+{
+    std::unique_ptr<Block> NewBlock = std::make_unique<Block>();
+    NewBlock->StartPC = PC;
+    NewBlock->Cycles = 0;
+    bool WritesMemory = false;
+
+    Word Address = PC;
+    for (u32 i = 0; i < MAX_BLOCK_OPS; i++)
+    {
+        const Instruction& Ins = OpcodeTable[memory[Address]];
+        if (Ins.ExecuteDecoded == nullptr)
+        {
+            break; // Illegal opcode, left to the interpreter
+        }
+
+        const Byte Opcode = memory[Address];
+        const DecodedOp Op = { Ins.ExecuteDecoded, Ins.DecodeOperand(memory, Word(Address + 1)), 0,
+            Opcode, Ins.Bytes, Ins.Cycles, Ins.WritesMemory };
+
+        NewBlock->Cycles += Op.Cycles;
+        NewBlock->Ops.push_back(Op);
+        WritesMemory |= Op.WritesMemory;
+
+        const u32 FirstPage = Address / Mem::PAGE_SIZE;
+        const u32 LastPage = Word(Address + Op.Bytes - 1) / Mem::PAGE_SIZE;
+        for (u32 Page : { FirstPage, LastPage })
+        {
+            std::vector<Word>& Starts = PageBlocks[Page];
+            if (Starts.empty() || Starts.back() != PC)
+            {
+                Starts.push_back(PC);
+            }
+            CodePages[Page / 64] |= 1ull << (Page % 64);
+        }
+
+        Address += Op.Bytes;
+        if (Ins.EndsBlock)
+        {
+            break;
+        }
+    }
+
+    std::vector<DecodedOp>& Ops = NewBlock->Ops;
+    NewBlock->IdleCandidate = !WritesMemory && !Ops.empty() &&
+        Ops.back().Opcode == CPU::INS_JMP_ABS && Ops.back().Operand == PC;
+    if (Fusion)
+    {
+        Fuse(Ops);
+    }
+
+    Blocks[PC] = std::move(NewBlock);
+    return *Blocks[PC];
+}
+
+void m6502::BlockCache::Fuse(std::vector<DecodedOp>& Ops)
+{
+    // Pairs are taken greedily from the start of the block
+    size_t Out = 0;
+    for (size_t In = 0; In < Ops.size(); In++, Out++)
+    {
+        DecodedOp Op = Ops[In];
+        if (In + 1 < Ops.size())
+        {
+            const DecodedOp& Next = Ops[In + 1];
+            if (const DecodedHandler Fused = FindFusedPair<NMOS6502>(Op.Opcode, Next.Opcode))
+            {
+                Op.Execute = Fused;
+                Op.NextOperand = Next.Operand;
+                Op.Bytes += Next.Bytes;
+                Op.Cycles += Next.Cycles;
+                Op.WritesMemory |= Next.WritesMemory;
+                In++;
+            }
+        }
+        Ops[Out] = Op;
+    }
+    Ops.resize(Out);
+}
+
+namespace
+{
+    using namespace m6502;
+
+    // Runs the block's ops, stopping where the interpreter would or once the block rewrote itself
+    void RunBlock(CPU& cpu, s32& Cycles, Mem& memory, BlockCache& cache, const Block& Current) noexcept
+    {
+        for (const DecodedOp& Op : Current.Ops)
+        {
+            Op.Execute(cpu, Cycles, memory, Op);
+
+            // The block may have just rewritten itself, decode it again
+            if (Op.WritesMemory && cache.CodeModified(memory))
+            {
+                return;
+            }
+            // Same stopping rule as the interpreter, also catches a parked budget
+            if (Cycles <= 0)
+            {
+                return;
+            }
+        }
+    }
+}
+
+m6502::RunResult m6502::CPU::Run(s32 Cycles, Mem& memory, BlockCache& cache) noexcept
+{
+    const s32 CyclesRequested = Cycles;
+    StartRun(Cycles, memory);
+    do
+    {
+        while(Cycles > 0)
+        {
+            const Block& Current = cache.Lookup(PC, memory);
+            if (Current.Ops.empty())
+            {
+                const Instruction& Ins = OpcodeTable[FetchByte(memory)];
+                Cycles -= Ins.Cycles;
+                Ins.Execute(*this, Cycles, memory);
+                continue;
+            }
+
+            if (!Current.IdleCandidate)
+            {
+                RunBlock(*this, Cycles, memory, cache, Current);
+                continue;
+            }
+
+            const s32 CyclesBefore = Cycles;
+            const u64 IOBefore = memory.IOAccesses;
+            const CPU Before = *this;
+            RunBlock(*this, Cycles, memory, cache, Current);
+
+            // An idle pass that changed nothing repeats exactly, skip all but the last one
+            if (Cycles > 0 && PC == Current.StartPC && memory.IOAccesses == IOBefore && SameState(Before))
+            {
+                const s32 PassCycles = CyclesBefore - Cycles;
+                Cycles -= (Cycles - 1) / PassCycles * PassCycles;
+            }
+        }
+    } while (ResumeRun(Cycles, memory));
+
+    return FinishRun(CyclesRequested, Cycles);
+}
+
+m6502::s32 m6502::CPU::Execute(s32 Cycles, Mem& memory, BlockCache& cache)
+{
+    return Run(Cycles, memory, cache).CyclesUsed;
+}
@@ -0,0 +1,27 @@
+#include <decimal_6502.hpp>
+
+namespace
+{
+    using Operation = m6502::ArithmeticResult (*)(bool CMOS, m6502::Byte A, m6502::Byte Operand, m6502::Byte Carry);
+
+    template <Operation Reference, bool CMOS>
+    std::array<m6502::ArithmeticResult, m6502::DECIMAL_TABLE_SIZE> MakeDecimalTable()
+    {
+        std::array<m6502::ArithmeticResult, m6502::DECIMAL_TABLE_SIZE> Table;
+        for (m6502::u32 Index = 0; Index < m6502::DECIMAL_TABLE_SIZE; Index++)
+        {
+            Table[Index] = Reference(CMOS, m6502::Byte(Index >> 8), m6502::Byte(Index), m6502::Byte(Index >> 16));
+        }
+        return Table;
+    }
+}
+
+// Filled once at static initialisation
+const std::array<m6502::ArithmeticResult, m6502::DECIMAL_TABLE_SIZE> m6502::NMOSDecimalAdd =
+    MakeDecimalTable<&DecimalAdd, false>();
+const std::array<m6502::ArithmeticResult, m6502::DECIMAL_TABLE_SIZE> m6502::NMOSDecimalSubtract =
+    MakeDecimalTable<&DecimalSubtract, false>();
+const std::array<m6502::ArithmeticResult, m6502::DECIMAL_TABLE_SIZE> m6502::CMOSDecimalAdd =
+    MakeDecimalTable<&DecimalAdd, true>();
+const std::array<m6502::ArithmeticResult, m6502::DECIMAL_TABLE_SIZE> m6502::CMOSDecimalSubtract =
+    MakeDecimalTable<&DecimalSubtract, true>();
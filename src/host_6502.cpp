@@ -0,0 +1,203 @@
+#include <host_6502.hpp>
+
+m6502::EmulationThread::EmulationThread(const Config& Settings)
+    : Video(Settings.VideoCapacity, Settings.VideoPolicy)
+    , Audio(Settings.AudioCapacity, Settings.AudioPolicy)
+    , SliceCycles(Settings.SliceCycles > 0 ? Settings.SliceCycles : 1)
+    , RealTime(Settings.RealTime)
+    , Input(Settings.InputCapacity)
+    , Pace(Settings.Pacing)
+{
+    Video.Owner = this;
+    Audio.Owner = this;
+}
+
+m6502::EmulationThread::~EmulationThread()
+{
+    Stop();
+}
+
+void m6502::EmulationThread::MapVideo(Byte FirstPage, u32 NumPages)
+{
+    MapOutput(Video, FirstPage, NumPages);
+}
+
+void m6502::EmulationThread::MapAudio(Byte FirstPage, u32 NumPages)
+{
+    MapOutput(Audio, FirstPage, NumPages);
+}
+
+void m6502::EmulationThread::MapOutput(HostOutput& Output, Byte FirstPage, u32 NumPages)
+{
+    mem.MapIO(FirstPage, NumPages, &ReadOutput, &WriteOutput, &Output);
+}
+
+void m6502::EmulationThread::Start()
+{
+    if (IsRunning())
+    {
+        return;
+    }
+    Stopping.store(false, std::memory_order_relaxed);
+    ProgramStopped.store(StopReason::CyclesExhausted, std::memory_order_relaxed);
+    PublishedCycle.store(0, std::memory_order_relaxed);
+    Now = 0;
+    Pending.clear();
+    PendingHead = 0;
+    Thread = std::thread(&EmulationThread::Loop, this);
+}
+
+void m6502::EmulationThread::Stop()
+{
+    if (!IsRunning())
+    {
+        return;
+    }
+    {
+        // Under the lock so an Idle wait can't miss it
+        std::lock_guard<std::mutex> Lock(WakeLock);
+        Stopping.store(true, std::memory_order_relaxed);
+    }
+    Wake.notify_all();
+    Thread.join();
+}
+
+m6502::Byte m6502::EmulationThread::ReadOutput(void*, Word)
+{
+    return 0; // Outputs are write only
+}
+
+void m6502::EmulationThread::WriteOutput(void* Context, Word Address, Byte Value)
+{
+    HostOutput& Output = *static_cast<HostOutput*>(Context);
+    EmulationThread& Self = *Output.Owner;
+    // The slice's budget is left after the writing instruction's base cycles, or parked by a stop
+    const CPU& cpu = Self.cpu;
+    u64 Cycle = Self.Now;
+    if (cpu.Budget != nullptr)
+    {
+        Cycle += u64(Self.SliceRequested - (cpu.CyclesParked ? cpu.StopCycles : *cpu.Budget));
+    }
+    Self.Emit(Output, { Cycle, Address, Value });
+}
+
+void m6502::EmulationThread::Emit(HostOutput& Output, const HostEvent& Event)
+{
+    // Events held back by Stretch go out first
+    if (Output.Overflow.empty() && Output.Ring.TryPush(Event))
+    {
+        return;
+    }
+
+    switch (Output.Policy)
+    {
+    case Backpressure::Drop:
+        Output.DroppedEvents.fetch_add(1, std::memory_order_relaxed);
+        break;
+    case Backpressure::Block:
+    {
+        u32 Rounds = 0;
+        while (!Output.Ring.TryPush(Event) && !Stopping.load(std::memory_order_relaxed))
+        {
+            Idle(Rounds);
+        }
+    } break;
+    case Backpressure::Stretch:
+        Output.Overflow.push_back(Event);
+        if (cpu.Budget != nullptr)
+        {
+            cpu.RequestStop(StopReason::HostRequest, 0, *cpu.Budget);
+        }
+        break;
+    }
+}
+
+bool m6502::EmulationThread::FlushOverflow(HostOutput& Output)
+{
+    size_t Sent = 0;
+    while (Sent < Output.Overflow.size() && Output.Ring.TryPush(Output.Overflow[Sent]))
+    {
+        Sent++;
+    }
+    Output.Overflow.erase(Output.Overflow.begin(), Output.Overflow.begin() + Sent);
+    return Output.Overflow.empty();
+}
+
+m6502::u64 m6502::EmulationThread::ApplyInput()
+{
+    HostEvent Event;
+    while (Input.TryPop(Event))
+    {
+        Pending.push_back(Event);
+    }
+
+    while (PendingHead < Pending.size() && Pending[PendingHead].Cycle <= Now)
+    {
+        mem.WriteByte(Pending[PendingHead].Address, Pending[PendingHead].Value);
+        PendingHead++;
+    }
+    if (PendingHead == Pending.size())
+    {
+        Pending.clear();
+        PendingHead = 0;
+        return ~0ull;
+    }
+    return Pending[PendingHead].Cycle;
+}
+
+void m6502::EmulationThread::Idle(u32& Rounds)
+{
+    // A few yields catch a consumer that is about to make room, then back off up to 1ms
+    constexpr u32 YIELD_ROUNDS = 16;
+    constexpr u32 MAX_SHIFT = 5;
+    if (Rounds < YIELD_ROUNDS)
+    {
+        Rounds++;
+        std::this_thread::yield();
+        return;
+    }
+    const u32 Shift = Rounds - YIELD_ROUNDS < MAX_SHIFT ? Rounds - YIELD_ROUNDS : MAX_SHIFT;
+    Rounds++;
+    std::unique_lock<std::mutex> Lock(WakeLock);
+    Wake.wait_for(Lock, std::chrono::microseconds(32u << Shift),
+        [this] { return Stopping.load(std::memory_order_relaxed); });
+}
+
+void m6502::EmulationThread::Loop()
+{
+    Pace.Start();
+    u32 IdleRounds = 0;
+    while (!Stopping.load(std::memory_order_relaxed))
+    {
+        const u64 NextInput = ApplyInput();
+
+        // Stretched, or nothing left to run: wait without spinning the core flat out
+        const bool VideoFlushed = FlushOverflow(Video);
+        const bool AudioFlushed = FlushOverflow(Audio);
+        if (!VideoFlushed || !AudioFlushed || ProgramStopped.load(std::memory_order_relaxed) != StopReason::CyclesExhausted)
+        {
+            Idle(IdleRounds);
+            continue;
+        }
+        IdleRounds = 0;
+
+        // Stop at the next input event so it lands on its cycle
+        SliceRequested = RealTime ? Pace.NextSlice() : SliceCycles;
+        if (NextInput - Now < u64(SliceRequested))
+        {
+            SliceRequested = s32(NextInput - Now);
+        }
+
+        const RunResult Result = cpu.Run(SliceRequested, mem);
+        Now += u64(Result.CyclesUsed);
+        PublishedCycle.store(Now, std::memory_order_release);
+        if (Result.Reason != StopReason::CyclesExhausted && Result.Reason != StopReason::HostRequest)
+        {
+            ProgramStopped.store(Result.Reason, std::memory_order_release);
+        }
+        if (RealTime)
+        {
+            Pace.SliceDone(Result.CyclesUsed);
+        }
+    }
+}
@@ -0,0 +1,159 @@
+#include <loader_6502.hpp>
+#include <string.h>
+
+bool m6502::ProgramImage::Open(const char* Path, ImageFormat Format, Word LoadAddress)
+{
+    Close();
+    if (!File.Open(Path))
+    {
+        return false;
+    }
+    if (!Parse(File.Data(), File.Size(), Format, LoadAddress))
+    {
+        File.Close();
+        return false;
+    }
+    return true;
+}
+
+bool m6502::ProgramImage::Parse(const Byte* Data, u64 Size, ImageFormat Format, Word LoadAddress)
+{
+    SegmentList.clear();
+    Tails.clear();
+    EntryPoint = 0;
+
+    bool Valid = false;
+    switch (Format)
+    {
+    case ImageFormat::Raw:
+    {
+        const u64 MaxSize = Mem::MAX_MEM - LoadAddress;
+        SegmentList.push_back({ LoadAddress, u32(Size < MaxSize ? Size : MaxSize), Data });
+        Valid = Size > 0;
+    } break;
+    case ImageFormat::PRG:
+    {
+        if (Size > 2)
+        {
+            const Word Address = Word(Data[0] | (Data[1] << 8));
+            const u64 MaxSize = Mem::MAX_MEM - Address;
+            SegmentList.push_back({ Address, u32(Size - 2 < MaxSize ? Size - 2 : MaxSize), Data + 2 });
+            Valid = true;
+        }
+    } break;
+    case ImageFormat::Segments:
+    {
+        Valid = ParseSegments(Data, Size);
+    } break;
+    }
+    if (!Valid)
+    {
+        SegmentList.clear();
+        return false;
+    }
+
+    if (Format != ImageFormat::Segments || EntryPoint == 0)
+    {
+        EntryPoint = SegmentList.front().LoadAddress;
+    }
+
+    Tails.assign(SegmentList.size() * Mem::PAGE_SIZE, 0);
+    for (size_t Index = 0; Index < SegmentList.size(); Index++)
+    {
+        const ImageSegment& Segment = SegmentList[Index];
+        const u32 TailSize = Segment.Size % Mem::PAGE_SIZE;
+        memcpy(&Tails[Index * Mem::PAGE_SIZE], Segment.Data + Segment.Size - TailSize, TailSize);
+    }
+    return true;
+}
+
+bool m6502::ProgramImage::ParseSegments(const Byte* Data, u64 Size)
+{
+    auto ReadWord = [Data](u64 Offset) { return Word(Data[Offset] | (Data[Offset + 1] << 8)); };
+
+    if (Size < 2 || ReadWord(0) != 0xFFFF)
+    {
+        return false;
+    }
+    u64 Offset = 2;
+    while (Offset < Size)
+    {
+        if (Offset + 4 > Size)
+        {
+            return false;
+        }
+        Word First = ReadWord(Offset);
+        if (First == 0xFFFF)
+        {
+            Offset += 2;
+            continue;
+        }
+        const Word Last = ReadWord(Offset + 2);
+        const u32 Length = u32(Last) - First + 1;
+        Offset += 4;
+        if (Last < First || Offset + Length > Size)
+        {
+            return false;
+        }
+        SegmentList.push_back({ First, Length, Data + Offset });
+        if (First <= RUNAD && Last >= RUNAD + 1)
+        {
+            EntryPoint = ReadWord(Offset + (RUNAD - First));
+        }
+        Offset += Length;
+    }
+    return !SegmentList.empty();
+}
+
+void m6502::ProgramImage::Close()
+{
+    SegmentList.clear();
+    Tails.clear();
+    EntryPoint = 0;
+    File.Close();
+}
+
+m6502::u64 m6502::ProgramImage::Size() const
+{
+    u64 Total = 0;
+    for (const ImageSegment& Segment : SegmentList)
+    {
+        Total += Segment.Size;
+    }
+    return Total;
+}
+
+void m6502::ProgramImage::LoadRAM(Mem& memory) const
+{
+    for (const ImageSegment& Segment : SegmentList)
+    {
+        memory.WriteBlock(Segment.LoadAddress, Segment.Data, Segment.Size);
+    }
+}
+
+bool m6502::ProgramImage::MapROM(Mem& memory) const
+{
+    for (const ImageSegment& Segment : SegmentList)
+    {
+        if (Segment.LoadAddress % Mem::PAGE_SIZE != 0)
+        {
+            return false;
+        }
+    }
+
+    for (size_t Index = 0; Index < SegmentList.size(); Index++)
+    {
+        const ImageSegment& Segment = SegmentList[Index];
+        const Byte FirstPage = Byte(Segment.LoadAddress / Mem::PAGE_SIZE);
+        const u32 FullPages = Segment.Size / Mem::PAGE_SIZE;
+        if (FullPages > 0)
+        {
+            memory.MapROM(FirstPage, FullPages, Segment.Data);
+        }
+        if (Segment.Size % Mem::PAGE_SIZE != 0 && FirstPage + FullPages < Mem::NUM_PAGES)
+        {
+            memory.MapROM(Byte(FirstPage + FullPages), 1, &Tails[Index * Mem::PAGE_SIZE]);
+        }
+    }
+    return true;
+}
@@ -1,220 +1,426 @@
+#include <string.h>
 #include <main_6502.hpp>
+#include <instructions_6502.hpp>
+#include <stats_6502.hpp>
+#include <trace_6502.hpp>
 
-void m6502::CPU::Reset(Mem& memory)
+m6502::Mem::Page m6502::Mem::ZeroPage;
+
+m6502::Mem::Mem()
 {
-    PC = 0xFFFC;
-    SP = 0x0100;
-    C = Z = I = D = B = V = N = 0;
-    A = X = Y = 0;
-    memory.Initialise();
+    for (u32 Page = 0; Page < NUM_PAGES; Page++)
+    {
+        RAM[Page] = &ZeroPage;
+        Kinds[Page] = PageKind::RAM;
+        IOHandlers[Page] = { nullptr, nullptr, nullptr };
+        UpdatePointers(Page);
+    }
+    for (u64& Bits : DirtyPages)
+    {
+        Bits = ~0ull;
+    }
+    for (u64& Bits : CodeWrites)
+    {
+        Bits = ~0ull;
+    }
+    for (u64& Bits : WrittenPages)
+    {
+        Bits = 0;
+    }
+}
+
+m6502::Mem::Mem(const Mem& Other)
+{
+    for (Page*& Entry : RAM)
+    {
+        Entry = &ZeroPage;
+    }
+    *this = Other;
 }
 
-m6502::Byte m6502::CPU::FetchByte(s32& Cycles, const Mem& memory)
+m6502::Mem& m6502::Mem::operator=(const Mem& Other)
 {
-    Byte Data = memory[PC];
-    PC++;
-    Cycles--;
+    if (this == &Other)
+    {
+        return *this;
+    }
 
-    return Data;
+    // Share every page, both sides copy on their next write to it
+    for (u32 Page = 0; Page < NUM_PAGES; Page++)
+    {
+        Mem::Page* Shared = Other.RAM[Page];
+        if (Shared != &ZeroPage)
+        {
+            Shared->RefCount.fetch_add(1, std::memory_order_relaxed);
+        }
+        Release(Page);
+        RAM[Page] = Shared;
+        Kinds[Page] = Other.Kinds[Page];
+        IOHandlers[Page] = Other.IOHandlers[Page];
+        ReadPages[Page] = Other.ReadPages[Page]; // Shared page or ROM image, readable as is
+        WritePages[Page] = nullptr;
+        Other.WritePages[Page] = nullptr;
+    }
+    memcpy(DirtyPages, Other.DirtyPages, sizeof(DirtyPages));
+    memcpy(WrittenPages, Other.WrittenPages, sizeof(WrittenPages));
+    for (u64& Bits : CodeWrites)
+    {
+        Bits = ~0ull; // Any page may hold different code now
+    }
+    return *this;
 }
 
-m6502::Word m6502::CPU::FetchWord(s32& Cycles, const Mem& memory)
+m6502::Mem::~Mem()
 {
-	/*
-	* If the platform is big endian,
-	* it has to be implemented here, e.g.:
-	* IF (PLATFORM_BIG_ENDIAN)
-	*  SwapBytesInWord(Data);
-	* */
-    Word Data = memory[PC];
-    PC++;
+    for (u32 Page = 0; Page < NUM_PAGES; Page++)
+    {
+        Release(Page);
+    }
+}
+
+void m6502::Mem::Initialise()
+{
+    for (u32 Page = 0; Page < NUM_PAGES; Page++)
+    {
+        const u64 Bit = 1ull << (Page % 64);
+        if (!(WrittenPages[Page / 64] & Bit))
+        {
+            continue;
+        }
+
+        // Owned pages are cleared in place so the next run does not allocate
+        Mem::Page* Current = RAM[Page];
+        if (Current != &ZeroPage && Current->RefCount.load(std::memory_order_acquire) == 1)
+        {
+            memset(Current->Bytes, 0, PAGE_SIZE);
+        }
+        else
+        {
+            Release(Page);
+            RAM[Page] = &ZeroPage;
+        }
 
-    Data |= (memory[PC] << 8 );
-    PC++;
-    Cycles -= 2;
+        // Revokes the write pointer so the next write sets the bit again
+        WrittenPages[Page / 64] &= ~Bit;
+        UpdatePointers(Page);
+        MarkDirty(Page * PAGE_SIZE);
+    }
+}
 
-    return Data;
+void m6502::Mem::Release(u32 Page)
+{
+    Mem::Page* Current = RAM[Page];
+    if (Current != &ZeroPage && Current->RefCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        delete Current;
+    }
 }
 
-m6502::Byte m6502::CPU::ReadByte(s32& Cycles, Word Address, const Mem& memory)
+void m6502::Mem::UpdatePointers(u32 Page)
 {
-    Byte Data = memory[Address];
-    Cycles--;
-    return Data;
+    // Write pointers are only handed out by OwnPage
+    WritePages[Page] = nullptr;
+    switch (Kinds[Page])
+    {
+        case PageKind::RAM:
+        {
+            ReadPages[Page] = RAM[Page]->Bytes;
+        } break;
+        case PageKind::ROM:
+        {
+            // ReadPages keeps pointing at the ROM image
+        } break;
+        case PageKind::IO:
+        {
+            ReadPages[Page] = nullptr;
+        } break;
+    }
 }
 
-m6502::Word m6502::CPU::ReadWord(s32& Cycles, Word Address, const Mem& memory)
+m6502::Byte* m6502::Mem::OwnPage(u32 Page)
 {
-    Word Data = memory[Address];
-    Data |= (memory[Address + 1] << 8);
-    Cycles -= 2;
-    return Data;
+    Mem::Page* Current = RAM[Page];
+    if (Current == &ZeroPage || Current->RefCount.load(std::memory_order_acquire) != 1)
+    {
+        Mem::Page* Copy = new Mem::Page;
+        memcpy(Copy->Bytes, Current->Bytes, PAGE_SIZE);
+        Release(Page);
+        RAM[Page] = Copy;
+    }
+    UpdatePointers(Page);
+
+    Byte* Bytes = RAM[Page]->Bytes;
+    if (Kinds[Page] != PageKind::IO)
+    {
+        WritePages[Page] = Bytes;
+    }
+    WrittenPages[Page / 64] |= 1ull << (Page % 64);
+    return Bytes;
 }
 
-void m6502::CPU::LoadRegisterSetStatus(Byte Register)
+void m6502::Mem::WriteSlow(Word Address, Byte Value)
 {
-    Z = (Register == 0);
-    N = (Register & 0b10000000) > 0; // If 7th bit of A set
+    const u32 Page = Address / PAGE_SIZE;
+    if (Kinds[Page] == PageKind::IO)
+    {
+        const IOHandler& Handler = IOHandlers[Page];
+        IOAccesses++;
+        Handler.Write(Handler.Context, Address, Value);
+        return;
+    }
+    OwnPage(Page)[Address % PAGE_SIZE] = Value;
 }
 
-m6502::Word m6502::CPU::AddrZeroPage(s32& Cycles, const Mem& memory)
+m6502::u32 m6502::Mem::SharedPages() const
 {
-    Byte ZeroPageAddress = FetchByte(Cycles, memory);
-    return ZeroPageAddress;
+    u32 Shared = 0;
+    for (const Page* Entry : RAM)
+    {
+        if (Entry != &ZeroPage && Entry->RefCount.load(std::memory_order_relaxed) > 1)
+        {
+            Shared++;
+        }
+    }
+    return Shared;
 }
 
-m6502::s32 m6502::CPU::Execute(s32 Cycles, Mem& memory)
+void m6502::Mem::SetPage(u32 Page, const Byte* Bytes)
 {
-    /* Loads a register with the value from the memory address*/
-    auto LoadRegister = [&Cycles, &memory, this](Word Address, Byte& Register)
+    if (Bytes != nullptr)
     {
-        Register = ReadByte(Cycles, Address, memory);
-        LoadRegisterSetStatus(Register);
-    };
+        memcpy(OwnPage(Page), Bytes, PAGE_SIZE);
+    }
+    else
+    {
+        Release(Page);
+        RAM[Page] = &ZeroPage;
+        WrittenPages[Page / 64] &= ~(1ull << (Page % 64));
+        UpdatePointers(Page);
+    }
+    MarkDirty(Page * PAGE_SIZE);
+}
 
-    const s32 CyclesRequested = Cycles;
-    while(Cycles > 0)
+void m6502::Mem::WriteBlock(Word Address, const Byte* Bytes, u32 Size)
+{
+    u32 Next = Address;
+    while (Size > 0)
     {
-        Byte Ins = FetchByte(Cycles, memory);
-        switch(Ins)
+        const u32 Page = (Next / PAGE_SIZE) % NUM_PAGES;
+        const u32 Offset = Next % PAGE_SIZE;
+        const u32 Count = Size < PAGE_SIZE - Offset ? Size : PAGE_SIZE - Offset;
+        if (Kinds[Page] == PageKind::IO)
         {
-            // If fetched instruction matches, fetch data from memory and set flags per docs.
-            case INS_LDA_IM:
-            {
-                A = FetchByte(Cycles, memory);
-                LoadRegisterSetStatus(A);
-            } break;
-            case INS_LDA_ZP:
-            {
-                Byte Address = AddrZeroPage(Cycles, memory);
-                LoadRegister(Address, A);
-            } break;
-            case INS_LDA_ZPX:
-            {
-                Byte Address = AddrZeroPage(Cycles, memory);
-                Address += X;
-                Cycles--;
-                LoadRegister(Address, A);
-            } break;
-            case INS_LDA_ABS:
-            {
-                Word AbsAddr = FetchWord(Cycles, memory);
-                LoadRegister(AbsAddr, A);
-            } break;
-            case INS_LDA_ABSX:
-            {
-                Word AbsAddr = FetchWord(Cycles, memory);
-                LoadRegister(AbsAddr + X, A);
-                if ((AbsAddr + X) - AbsAddr >= 0xFF)
-                {
-                    Cycles--;
-                }
-            } break;
-            case INS_LDA_ABSY:
-            {
-                Word AbsAddr = FetchWord(Cycles, memory);
-                LoadRegister(AbsAddr + Y, A);
-                if ((AbsAddr + Y) - AbsAddr >= 0xFF)
-                {
-                    Cycles--;
-                }
-            } break;
-            case INS_LDA_INDX:
-            {
-                Byte ZPageAddr = FetchByte(Cycles, memory);
-                ZPageAddr += X;
-                Cycles--; // X register takes 1 more cycle than Y for design reasons
-                Word EffectiveAddr = ReadWord(Cycles, ZPageAddr, memory); 
-                A = ReadByte(Cycles, EffectiveAddr, memory);
-            } break;
-            case INS_LDA_INDY:
-            {
-                Byte ZPageAddr = FetchByte(Cycles, memory);
-                Word EffectiveAddr = ReadWord(Cycles, ZPageAddr, memory);
-                A = ReadByte(Cycles, EffectiveAddr + Y, memory);
-                if ((EffectiveAddr + Y) - EffectiveAddr >= 0xFF)
-                {
-                    Cycles--;
-                }
-            } break;
-            case INS_JSR:
-            {
-                Word SubAddr = FetchWord(Cycles, memory);
-                memory.WriteWord(Cycles, PC - 1, SP);
-                SP++;
-                PC = SubAddr;
-                Cycles--;
-            } break;
-            case INS_LDX_IM:
-            {
-                X = FetchByte(Cycles, memory);
-                LoadRegisterSetStatus(X);
-            } break;
-            case INS_LDX_ZP:
-            {
-                Byte Address = AddrZeroPage(Cycles, memory);
-                LoadRegister(Address, X);
-            } break;
-            case INS_LDX_ZPY:
+            for (u32 i = 0; i < Count; i++)
             {
-                Byte Address = AddrZeroPage(Cycles, memory);
-                Address += Y;
-                Cycles--;
-                LoadRegister(Address, X);
-            } break;
-            case INS_LDX_ABS:
-            {
-                Word AbsAddr = FetchWord(Cycles, memory);
-                LoadRegister(AbsAddr, X);
-            } break;
-            case INS_LDX_ABSY:
-            {
-                Word AbsAddr = FetchWord(Cycles, memory);
-                LoadRegister(AbsAddr + Y, X);
-                if ((AbsAddr + Y) - AbsAddr >= 0xFF)
-                {
-                    Cycles--;
-                }
-            } break;
-            case INS_LDY_IM:
-            {
-                Y = FetchByte(Cycles, memory);
-                LoadRegisterSetStatus(Y);
-            } break;
-            case INS_LDY_ZP:
-            {
-                Byte Address = AddrZeroPage(Cycles, memory);
-                LoadRegister(Address, Y);
-            } break;
-            case INS_LDY_ZPX:
-            {
-                Byte Address = AddrZeroPage(Cycles, memory);
-                Address += X;
-                Cycles--;
-                LoadRegister(Address, Y);
-            } break;
-            case INS_LDY_ABS:
-            {
-                Word AbsAddr = FetchWord(Cycles, memory);
-                LoadRegister(AbsAddr, Y);
-            } break;
-            case INS_LDY_ABSX:
+                WriteByte(Word(Page * PAGE_SIZE + Offset + i), Bytes[i]);
+            }
+        }
+        else
+        {
+            memcpy(OwnPage(Page) + Offset, Bytes, Count);
+            MarkDirty(Page * PAGE_SIZE);
+        }
+        Bytes += Count;
+        Next = Page * PAGE_SIZE + Offset + Count;
+        Size -= Count;
+    }
+}
+
+bool m6502::Mem::SamePage(const Mem& Other, u32 Page) const
+{
+    return RAM[Page] == Other.RAM[Page] || memcmp(RAM[Page]->Bytes, Other.RAM[Page]->Bytes, PAGE_SIZE) == 0;
+}
+
+void m6502::Mem::MapRAM(Byte FirstPage, u32 NumPages)
+{
+    for (u32 Page = FirstPage; Page < FirstPage + NumPages && Page < NUM_PAGES; Page++)
+    {
+        Kinds[Page] = PageKind::RAM;
+        IOHandlers[Page] = { nullptr, nullptr, nullptr };
+        UpdatePointers(Page);
+        MarkDirty(Page * PAGE_SIZE);
+    }
+}
+
+void m6502::Mem::MapROM(Byte FirstPage, u32 NumPages, const Byte* Rom)
+{
+    for (u32 Page = FirstPage; Page < FirstPage + NumPages && Page < NUM_PAGES; Page++)
+    {
+        Kinds[Page] = PageKind::ROM;
+        IOHandlers[Page] = { nullptr, nullptr, nullptr };
+        ReadPages[Page] = Rom + (Page - FirstPage) * PAGE_SIZE;
+        UpdatePointers(Page); // Writes land in the RAM underneath, see WriteSlow
+        MarkDirty(Page * PAGE_SIZE);
+    }
+}
+
+void m6502::Mem::MapIO(Byte FirstPage, u32 NumPages, ReadHandler Read, WriteHandler Write, void* Context)
+{
+    for (u32 Page = FirstPage; Page < FirstPage + NumPages && Page < NUM_PAGES; Page++)
+    {
+        Kinds[Page] = PageKind::IO;
+        IOHandlers[Page] = { Read, Write, Context };
+        UpdatePointers(Page);
+        MarkDirty(Page * PAGE_SIZE);
+    }
+}
+
+void m6502::CPU::Reset(Mem& memory)
+{
+    PC = RESET_VECTOR;
+    SP = 0x0100;
+    SetStatus(0);
+    NMIPending = false;
+    A = X = Y = 0;
+    memory.Initialise();
+}
+
+void m6502::JumpToSubroutine::Execute(CPU& cpu, s32&, Mem& memory, Word SubAddr) noexcept
+{
+    // The return address is the last byte of the JSR, RTS adds one
+    cpu.PushWord(Word(cpu.PC - 1), memory);
+    cpu.PC = SubAddr;
+}
+
+void m6502::IllegalOpcode(CPU& cpu, s32& Cycles, Mem& memory) noexcept
+{
+    cpu.PC--;
+    cpu.RequestStop(StopReason::IllegalOpcode, cpu.ReadByte(cpu.PC, memory), Cycles);
+}
+
+m6502::RunResult m6502::CPU::Run(s32 Cycles, Mem& memory) noexcept
+{
+    NoStats None;
+    return Run(Cycles, memory, None);
+}
+
+template <typename Variant>
+m6502::RunResult m6502::VariantCPU<Variant>::Run(s32 Cycles, Mem& memory) noexcept
+{
+    NoStats None;
+    return Run(Cycles, memory, None);
+}
+
+template struct m6502::VariantCPU<m6502::NMOS6502>;
+template struct m6502::VariantCPU<m6502::CMOS65C02>;
+template struct m6502::VariantCPU<m6502::Ricoh2A03>;
+
+template <typename Variant, typename Policy>
+m6502::RunResult m6502::CPU::RunVariant(s32 Cycles, Mem& memory, Policy& Instrumentation) noexcept
+{
+    const s32 CyclesRequested = Cycles;
+    Instrumentation.BeginRun(VariantOpcodeTable<Variant>);
+    StartRun<Variant>(Cycles, memory);
+#if M6502_USE_THREADED_DISPATCH
+    /*
+    * Threaded code: every handler ends in its own indirect jump to the
+    * next opcode, so the branch predictor sees one branch per handler
+    * instead of the single shared one in the portable loop.
+    * */
+#define M6502_LABEL_ADDRESS(Opcode, Cycles, ...) &&Op_##Opcode,
+    static void* const Labels[] = { &&Op_Illegal, M6502_OPCODES(M6502_LABEL_ADDRESS)
+        M6502_NMOS_OPCODES(M6502_LABEL_ADDRESS) M6502_CMOS_OPCODES(M6502_LABEL_ADDRESS) };
+#undef M6502_LABEL_ADDRESS
+
+#define M6502_DISPATCH() \
+    if (Cycles <= 0) goto Done; \
+    InstructionPC = PC; \
+    Opcode = FetchByte(memory); \
+    goto *Labels[VariantOpcodeSlots<Variant>[Opcode]]
+
+    Word InstructionPC;
+    Byte Opcode;
+    s32 CyclesBefore;
+    M6502_DISPATCH();
+
+#define M6502_LABEL_BODY(Opcode, BaseCycles, ...) \
+    Op_##Opcode: \
+    Instrumentation.Fetched(memory, InstructionPC, CPU::Opcode); \
+    CyclesBefore = Cycles; \
+    Cycles -= BaseCycles; \
+    Interpret<__VA_ARGS__>(*this, Cycles, memory); \
+    Instrumentation.Executed(*this, memory, InstructionPC, CPU::Opcode, CyclesBefore - UnparkedCycles(Cycles)); \
+    M6502_DISPATCH();
+    M6502_OPCODES(M6502_LABEL_BODY)
+    M6502_NMOS_OPCODES(M6502_LABEL_BODY)
+    M6502_CMOS_OPCODES(M6502_LABEL_BODY)
+#undef M6502_LABEL_BODY
+
+Op_Illegal:
+    IllegalOpcode(*this, Cycles, memory);
+    M6502_DISPATCH();
+
+Done:
+    if (ResumeRun<Variant>(Cycles, memory))
+    {
+        M6502_DISPATCH();
+    }
+#undef M6502_DISPATCH
+#else
+    do
+    {
+        while(Cycles > 0)
+        {
+            // Charge the base cycles up front, the handler adds any penalties
+            const Word InstructionPC = PC;
+            const Byte Opcode = FetchByte(memory);
+            const Instruction& Ins = VariantOpcodeTable<Variant>[Opcode];
+            Instrumentation.Fetched(memory, InstructionPC, Opcode);
+            const s32 CyclesBefore = Cycles;
+            Cycles -= Ins.Cycles;
+            Ins.Execute(*this, Cycles, memory);
+            Instrumentation.Executed(*this, memory, InstructionPC, Opcode, CyclesBefore - UnparkedCycles(Cycles));
+        }
+    } while (ResumeRun<Variant>(Cycles, memory));
+#endif
+
+    Instrumentation.EndRun();
+    return FinishRun(CyclesRequested, Cycles);
+}
+
+#define M6502_INSTANTIATE_RUN(Variant) \
+    template m6502::RunResult m6502::CPU::RunVariant<m6502::Variant>(s32, Mem&, NoStats&) noexcept; \
+    template m6502::RunResult m6502::CPU::RunVariant<m6502::Variant>(s32, Mem&, Stats&) noexcept; \
+    template m6502::RunResult m6502::CPU::RunVariant<m6502::Variant>(s32, Mem&, Tracer&) noexcept;
+M6502_INSTANTIATE_RUN(NMOS6502)
+M6502_INSTANTIATE_RUN(CMOS65C02)
+M6502_INSTANTIATE_RUN(Ricoh2A03)
+#undef M6502_INSTANTIATE_RUN
+
+m6502::RunResult m6502::CPU::Run(s32 Cycles, Mem& memory, RunControl& Control) noexcept
+{
+    const s32 CyclesRequested = Cycles;
+    StartRun(Cycles, memory);
+    // A run that starts on a breakpoint steps off it instead of stopping again
+    bool First = true;
+    do
+    {
+        while(Cycles > 0)
+        {
+            // A plain load per instruction, the read-modify-write only once a stop is seen
+            if (Control.StopRequested.load(std::memory_order_relaxed))
             {
-                Word AbsAddr = FetchWord(Cycles, memory);
-                LoadRegister(AbsAddr + X, Y);
-                if ((AbsAddr + X) - AbsAddr >= 0xFF)
-                {
-                    Cycles--;
-                }
-            } break;
-            default:
+                Control.StopRequested.store(false, std::memory_order_relaxed);
+                RequestStop(StopReason::HostRequest, 0, Cycles);
+                break;
+            }
+            if (!First && Control.HasBreakpoint(PC))
             {
-                printf("Instruction not handled %d\n", Ins);
-                throw -1;
-            } break;
+                RequestStop(StopReason::Breakpoint, ReadByte(PC, memory), Cycles);
+                break;
+            }
+            First = false;
+
+            const Instruction& Ins = OpcodeTable[FetchByte(memory)];
+            Cycles -= Ins.Cycles;
+            Ins.Execute(*this, Cycles, memory);
         }
-    }
+    } while (ResumeRun(Cycles, memory));
 
-    const s32 ActualCyclesUsed = CyclesRequested - Cycles;
-    return ActualCyclesUsed;
-}
\ No newline at end of file
+    return FinishRun(CyclesRequested, Cycles);
+}
+
+m6502::s32 m6502::CPU::Execute(s32 Cycles, Mem& memory)
+{
+    return Run(Cycles, memory).CyclesUsed;
+}
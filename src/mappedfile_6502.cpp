@@ -0,0 +1,67 @@
+#include <mappedfile_6502.hpp>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool m6502::MappedFile::Open(const char* Path)
+{
+    Close();
+#if defined(_WIN32)
+    FILE* In = fopen(Path, "rb");
+    if (In == nullptr)
+    {
+        return false;
+    }
+    fseek(In, 0, SEEK_END);
+    const long FileLength = ftell(In);
+    fseek(In, 0, SEEK_SET);
+    Byte* Copy = FileLength > 0 ? new Byte[FileLength] : nullptr;
+    if (Copy != nullptr && fread(Copy, 1, size_t(FileLength), In) == size_t(FileLength))
+    {
+        Bytes = Copy;
+        Length = u64(FileLength);
+    }
+    else
+    {
+        delete[] Copy;
+    }
+    fclose(In);
+#else
+    const int File = open(Path, O_RDONLY);
+    if (File < 0)
+    {
+        return false;
+    }
+    struct stat Info;
+    if (fstat(File, &Info) == 0 && Info.st_size > 0)
+    {
+        void* Mapping = mmap(nullptr, size_t(Info.st_size), PROT_READ, MAP_PRIVATE, File, 0);
+        if (Mapping != MAP_FAILED)
+        {
+            Bytes = static_cast<const Byte*>(Mapping);
+            Length = u64(Info.st_size);
+        }
+    }
+    close(File);
+#endif
+    return Bytes != nullptr;
+}
+
+void m6502::MappedFile::Close()
+{
+    if (Bytes == nullptr)
+    {
+        return;
+    }
+#if defined(_WIN32)
+    delete[] Bytes;
+#else
+    munmap(const_cast<Byte*>(Bytes), size_t(Length));
+#endif
+    Bytes = nullptr;
+    Length = 0;
+}
@@ -0,0 +1,154 @@
+#include <pacer_6502.hpp>
+#include <thread>
+
+m6502::PacerTime m6502::PacerTime::System()
+{
+    return {
+        [](void*) { return Clock::now(); },
+        [](void*, Clock::duration Duration) { std::this_thread::sleep_for(Duration); },
+        [](void*) { std::this_thread::yield(); },
+        nullptr };
+}
+
+m6502::Pacer::Pacer(const PacerConfig& Settings, const PacerTime& Time)
+    : Config(Settings), Time(Time)
+{
+    if (Config.ClockHz == 0)
+    {
+        Config.ClockHz = PAL_CLOCK_HZ;
+    }
+    if (Config.FrameCycles == 0)
+    {
+        Config.FrameCycles = PAL_FRAME_CYCLES;
+    }
+    const u64 Cycles = u64(Config.ClockHz) * Config.SliceMicroseconds / 1000000;
+    SliceCycles = s32(Cycles < 1 ? 1 : (Cycles > Config.FrameCycles ? Config.FrameCycles : Cycles));
+    Start();
+}
+
+void m6502::Pacer::Start()
+{
+    Epoch = Now();
+    Started = Epoch;
+    Cycles = 0;
+    CatchingUp = false;
+    Slices = 0;
+    Overruns = 0;
+    WorstOverrunNs = 0;
+    Resyncs = 0;
+    Waits = 0;
+    JitterMaxNs = 0;
+    for (u64& Count : JitterHistogram)
+    {
+        Count = 0;
+    }
+    Asleep = Clock::duration{ 0 };
+}
+
+m6502::Pacer::Clock::time_point m6502::Pacer::Deadline(u64 Cycle) const
+{
+    // Split so Cycle * 1e9 can't overflow
+    const u64 Seconds = Cycle / Config.ClockHz;
+    const u64 Nanoseconds = (Cycle % Config.ClockHz) * 1000000000ull / Config.ClockHz;
+    return Epoch + std::chrono::seconds(Seconds) + std::chrono::nanoseconds(Nanoseconds);
+}
+
+m6502::s32 m6502::Pacer::NextSlice() const
+{
+    const u64 ToFrameEnd = Config.FrameCycles - Cycles % Config.FrameCycles;
+    if (CatchingUp || ToFrameEnd < u64(SliceCycles))
+    {
+        return s32(ToFrameEnd);
+    }
+    return SliceCycles;
+}
+
+void m6502::Pacer::SliceDone(s32 CyclesUsed)
+{
+    Cycles += u64(CyclesUsed > 0 ? CyclesUsed : 0);
+    Slices++;
+
+    const Clock::time_point Due = Deadline(Cycles);
+    const Clock::time_point Done = Now();
+    if (Done <= Due)
+    {
+        CatchingUp = false;
+        Wait(Due);
+        return;
+    }
+
+    const u64 LateNs = u64(std::chrono::duration_cast<std::chrono::nanoseconds>(Done - Due).count());
+    Overruns++;
+    WorstOverrunNs = LateNs > WorstOverrunNs ? LateNs : WorstOverrunNs;
+    if (LateNs > u64(Config.MaxLagMicroseconds) * 1000)
+    {
+        // Too far behind to catch up, carry on from here
+        Epoch += Done - Due;
+        Resyncs++;
+        CatchingUp = false;
+        return;
+    }
+    CatchingUp = LateNs > u64(Config.SliceMicroseconds) * 1000;
+}
+
+void m6502::Pacer::Wait(Clock::time_point Until)
+{
+    const Clock::duration Spin = std::chrono::microseconds(Config.SpinMicroseconds);
+    const Clock::time_point Before = Now();
+    if (Until - Before > Spin)
+    {
+        Time.SleepFor(Time.Context, Until - Before - Spin);
+        Asleep += Now() - Before;
+    }
+
+    Clock::time_point Woken = Now();
+    while (Woken < Until)
+    {
+        Time.Yield(Time.Context);
+        Woken = Now();
+    }
+
+    const u64 LateNs = u64(std::chrono::duration_cast<std::chrono::nanoseconds>(Woken - Until).count());
+    const u64 Bucket = LateNs / 1000;
+    JitterHistogram[Bucket < JITTER_BUCKETS ? Bucket : JITTER_BUCKETS - 1]++;
+    JitterMaxNs = LateNs > JitterMaxNs ? LateNs : JitterMaxNs;
+    Waits++;
+}
+
+m6502::u64 m6502::Pacer::JitterPercentile(u32 Percent) const
+{
+    if (Waits == 0)
+    {
+        return 0;
+    }
+    // Upper edge of the bucket holding the percentile
+    const u64 Rank = (Waits * Percent + 99) / 100;
+    u64 Seen = 0;
+    for (u32 Bucket = 0; Bucket < JITTER_BUCKETS; Bucket++)
+    {
+        Seen += JitterHistogram[Bucket];
+        if (Seen >= Rank)
+        {
+            return Bucket + 1 < JITTER_BUCKETS ? (Bucket + 1) * 1000ull : JitterMaxNs;
+        }
+    }
+    return JitterMaxNs;
+}
+
+m6502::PacerMetrics m6502::Pacer::Metrics() const
+{
+    PacerMetrics Result;
+    Result.Slices = Slices;
+    Result.Frames = Cycles / Config.FrameCycles;
+    Result.Overruns = Overruns;
+    Result.WorstOverrunNs = WorstOverrunNs;
+    Result.Resyncs = Resyncs;
+    Result.JitterP50Ns = JitterPercentile(50);
+    Result.JitterP90Ns = JitterPercentile(90);
+    Result.JitterP99Ns = JitterPercentile(99);
+    Result.JitterMaxNs = JitterMaxNs;
+    const double Wall = std::chrono::duration<double>(Now() - Started).count();
+    const double Slept = std::chrono::duration<double>(Asleep).count();
+    Result.HostShare = Wall > 0 ? (Wall - Slept) / Wall : 0;
+    return Result;
+}
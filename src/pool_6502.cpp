@@ -0,0 +1,35 @@
+#include <pool_6502.hpp>
+
+m6502::MachinePool::MachinePool(u32 InitialSize)
+{
+    Machines.reserve(InitialSize);
+    Free.reserve(InitialSize);
+    for (u32 i = 0; i < InitialSize; i++)
+    {
+        Machines.push_back(std::make_unique<Machine>());
+        Free.push_back(Machines.back().get());
+    }
+}
+
+m6502::Machine* m6502::MachinePool::Acquire()
+{
+    Machine* Acquired = nullptr;
+    if (Free.empty())
+    {
+        Machines.push_back(std::make_unique<Machine>());
+        Acquired = Machines.back().get();
+    }
+    else
+    {
+        Acquired = Free.back();
+        Free.pop_back();
+    }
+
+    Acquired->cpu.Reset(Acquired->mem);
+    return Acquired;
+}
+
+void m6502::MachinePool::Release(Machine* machine)
+{
+    Free.push_back(machine);
+}
@@ -0,0 +1,250 @@
+#include <algorithm>
+#include <rewind_6502.hpp>
+
+m6502::Rewinder::Rewinder(CPU& cpu, Mem& memory, const RewindConfig& Config)
+    : cpu(cpu), memory(memory), Config(Config), Lines(LinesOf(cpu))
+{
+    if (this->Config.KeyframeInterval == 0)
+    {
+        this->Config.KeyframeInterval = 1;
+    }
+    for (u32 Page = 0; Page < Mem::NUM_PAGES; Page++)
+    {
+        Devices[Page] = memory.IOHandlers[Page];
+        if (memory.Kinds[Page] == Mem::PageKind::IO)
+        {
+            memory.IOHandlers[Page] = { &ReadIO, &WriteIO, this };
+        }
+    }
+    TakeKeyframe();
+}
+
+m6502::Rewinder::~Rewinder()
+{
+    for (u32 Page = 0; Page < Mem::NUM_PAGES; Page++)
+    {
+        if (memory.IOHandlers[Page].Context == this)
+        {
+            memory.IOHandlers[Page] = Devices[Page];
+        }
+    }
+}
+
+m6502::Byte m6502::Rewinder::ReadIO(void* Context, Word Address)
+{
+    Rewinder& Self = *static_cast<Rewinder*>(Context);
+    if (Self.Replaying())
+    {
+        const IOEntry& Entry = Self.IOJournal[Self.IOPos++ - Self.IOBase];
+        if (Entry.Interrupt)
+        {
+            Self.SetLines(Entry.Lines);
+        }
+        return Entry.Value;
+    }
+    const Mem::IOHandler& Device = Self.Devices[Address / Mem::PAGE_SIZE];
+    const InterruptLines Before = LinesOf(Self.cpu);
+    const Byte Value = Device.Read(Device.Context, Address);
+    const InterruptLines After = LinesOf(Self.cpu);
+    Self.IOJournal.push_back({ Address, Value, false, !(After == Before), After });
+    Self.IOPos++;
+    return Value;
+}
+
+void m6502::Rewinder::WriteIO(void* Context, Word Address, Byte Value)
+{
+    Rewinder& Self = *static_cast<Rewinder*>(Context);
+    if (Self.Replaying())
+    {
+        // The device already saw it, only what it did to the lines is repeated
+        const IOEntry& Entry = Self.IOJournal[Self.IOPos++ - Self.IOBase];
+        if (Entry.Interrupt)
+        {
+            Self.SetLines(Entry.Lines);
+        }
+        return;
+    }
+    const Mem::IOHandler& Device = Self.Devices[Address / Mem::PAGE_SIZE];
+    const InterruptLines Before = LinesOf(Self.cpu);
+    Device.Write(Device.Context, Address, Value);
+    const InterruptLines After = LinesOf(Self.cpu);
+    Self.IOJournal.push_back({ Address, Value, true, !(After == Before), After });
+    Self.IOPos++;
+}
+
+m6502::RunResult m6502::Rewinder::Run(s32 Cycles)
+{
+    return Advance(Now + u64(Cycles > 0 ? Cycles : 0));
+}
+
+void m6502::Rewinder::Write(Word Address, Byte Value)
+{
+    if (Now < Head)
+    {
+        DropFuture();
+    }
+    HostJournal.push_back({ Now, Address, Value, false, Lines });
+    HostPos++;
+    memory.WriteByte(Address, Value);
+}
+
+void m6502::Rewinder::SetLines(const InterruptLines& Set)
+{
+    cpu.IRQLines = Set.IRQLines;
+    cpu.NMILine = Set.NMILine;
+    cpu.NMIPending = Set.NMIPending;
+    cpu.PollInterrupts();
+}
+
+bool m6502::Rewinder::Seek(u64 Target)
+{
+    if (Target < OldestCycle() || Target > Head)
+    {
+        return false;
+    }
+
+    // Last keyframe at or before Target
+    auto Nearest = std::upper_bound(Keyframes.begin(), Keyframes.end(), Target,
+        [](u64 Cycle, const std::unique_ptr<Keyframe>& Frame) { return Cycle < Frame->Cycle; });
+    const Keyframe& Frame = **(Nearest - 1);
+    cpu = Frame.cpu;
+    memory = Frame.memory;
+    for (u32 Page = 0; Page < Mem::NUM_PAGES; Page++)
+    {
+        memory.MarkDirty(Page * Mem::PAGE_SIZE); // Code may have changed under a block cache
+    }
+    Lines = LinesOf(cpu);
+    Now = Frame.Cycle;
+    IOPos = Frame.IOPos;
+    HostPos = Frame.HostPos;
+
+    Advance(Target);
+    return true;
+}
+
+m6502::RunResult m6502::Rewinder::Advance(u64 Target)
+{
+    const u64 Interval = Config.KeyframeInterval;
+    const u64 Start = Now;
+    RunResult Result = { StopReason::CyclesExhausted, 0, cpu.PC, 0 };
+    for (;;)
+    {
+        // Host writes and line changes made at this cycle, only pending while replaying
+        while (HostPos < HostBase + HostJournal.size() && HostJournal[HostPos - HostBase].Cycle <= Now)
+        {
+            const HostEntry& Entry = HostJournal[HostPos++ - HostBase];
+            if (Entry.Interrupt)
+            {
+                SetLines(Entry.Lines);
+                Lines = Entry.Lines;
+            }
+            else
+            {
+                memory.WriteByte(Entry.Address, Entry.Value);
+            }
+        }
+
+        // Lines the host changed since the last run, like a host write
+        if (!(LinesOf(cpu) == Lines))
+        {
+            if (Now < Head)
+            {
+                DropFuture();
+            }
+            Lines = LinesOf(cpu);
+            HostJournal.push_back({ Now, 0, 0, true, Lines });
+            HostPos++;
+        }
+        if (Now >= Target)
+        {
+            break;
+        }
+
+        // Stop on keyframe boundaries and where the next host write has to go in
+        u64 End = std::min(Target, (Now / Interval + 1) * Interval);
+        if (HostPos < HostBase + HostJournal.size())
+        {
+            End = std::min(End, HostJournal[HostPos - HostBase].Cycle);
+        }
+
+        const RunResult Step = cpu.Run(s32(End - Now), memory);
+        Lines = LinesOf(cpu); // Interrupts taken change them too
+        Now += u64(Step.CyclesUsed);
+        Head = std::max(Head, Now);
+        if (Now / Interval > Keyframes.back()->Cycle / Interval)
+        {
+            TakeKeyframe();
+        }
+        if (Step.Reason != StopReason::CyclesExhausted)
+        {
+            Result = Step;
+            break;
+        }
+    }
+    Result.CyclesUsed = s32(Now - Start);
+    Result.PC = cpu.PC;
+    return Result;
+}
+
+void m6502::Rewinder::TakeKeyframe()
+{
+    std::unique_ptr<Keyframe> Frame = std::make_unique<Keyframe>();
+    Frame->Cycle = Now;
+    Frame->IOPos = IOPos;
+    Frame->HostPos = HostPos;
+    Frame->cpu = cpu;
+    Frame->memory = memory;
+    Keyframes.push_back(std::move(Frame));
+    Thin();
+}
+
+void m6502::Rewinder::DropFuture()
+{
+    while (Keyframes.size() > 1 && Keyframes.back()->Cycle > Now)
+    {
+        Keyframes.pop_back();
+    }
+    IOJournal.resize(IOPos - IOBase);
+    HostJournal.resize(HostPos - HostBase);
+    Head = Now;
+}
+
+void m6502::Rewinder::Thin()
+{
+    // Keep one keyframe at or before the start of the window
+    const u64 WindowStart = Now > Config.Window ? Now - Config.Window : 0;
+    while (Keyframes.size() > 1 && Keyframes[1]->Cycle <= WindowStart)
+    {
+        Keyframes.erase(Keyframes.begin());
+    }
+
+    // Drop the older keyframe that leaves the smallest gap, older gaps grow first
+    while (Keyframes.size() > std::max<u32>(Config.MaxKeyframes, 3))
+    {
+        size_t Drop = 1;
+        u64 SmallestGap = ~0ull;
+        for (size_t Index = 1; Index <= Keyframes.size() / 2; Index++)
+        {
+            const u64 Gap = Keyframes[Index + 1]->Cycle - Keyframes[Index - 1]->Cycle;
+            if (Gap < SmallestGap)
+            {
+                SmallestGap = Gap;
+                Drop = Index;
+            }
+        }
+        Keyframes.erase(Keyframes.begin() + Drop);
+    }
+
+    // The journals only have to reach back to the oldest keyframe
+    const Keyframe& Oldest = *Keyframes.front();
+    while (IOBase < Oldest.IOPos)
+    {
+        IOJournal.pop_front();
+        IOBase++;
+    }
+    while (HostBase < Oldest.HostPos)
+    {
+        HostJournal.pop_front();
+        HostBase++;
+    }
+}
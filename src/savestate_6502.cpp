@@ -0,0 +1,196 @@
+#include <string.h>
+#include <savestate_6502.hpp>
+
+namespace
+{
+    constexpr m6502::u64 ID_OFFSET = 8;
+    constexpr m6502::u64 KIND_BYTES = 8; // Magic, version, kind and reserved, hashed with the rest
+    constexpr m6502::u64 HASHED_OFFSET = 16; // BaseId onwards
+    constexpr m6502::u64 BITMAP_OFFSET = 42;
+    constexpr m6502::u64 BITMAP_BYTES = m6502::Mem::NUM_PAGES / 8;
+    constexpr m6502::u64 HEADER_SIZE = BITMAP_OFFSET + BITMAP_BYTES;
+
+    void PutInt(m6502::Byte* Out, m6502::u64 Value, int Bytes)
+    {
+        for (int Index = 0; Index < Bytes; Index++)
+        {
+            Out[Index] = m6502::Byte(Value >> (Index * 8));
+        }
+    }
+
+    m6502::u64 GetInt(const m6502::Byte* In, int Bytes)
+    {
+        m6502::u64 Value = 0;
+        for (int Index = 0; Index < Bytes; Index++)
+        {
+            Value |= m6502::u64(In[Index]) << (Index * 8);
+        }
+        return Value;
+    }
+
+    // 64 bits at a time multiply/xor hash, only used to tell states apart
+    m6502::u64 Hash(const m6502::Byte* Bytes, m6502::u64 Size, m6502::u64 Value = 0xCBF29CE484222325ull)
+    {
+        m6502::u64 Index = 0;
+        for (; Index + 8 <= Size; Index += 8)
+        {
+            m6502::u64 Word;
+            memcpy(&Word, Bytes + Index, 8);
+            Value = (Value ^ Word) * 0x100000001B3ull;
+            Value ^= Value >> 29;
+        }
+        for (; Index < Size; Index++)
+        {
+            Value = (Value ^ Bytes[Index]) * 0x100000001B3ull;
+        }
+        return Value != 0 ? Value : 1; // 0 means no state
+    }
+
+    // Everything but the Id itself, so a delta can't pass for a full state
+    m6502::u64 StateId(const m6502::Byte* State, m6502::u64 Size)
+    {
+        return Hash(State + HASHED_OFFSET, Size - HASHED_OFFSET, Hash(State, KIND_BYTES));
+    }
+
+    m6502::SaveStateInfo Save(const m6502::CPU& cpu, const m6502::Mem& memory, m6502::u64 Cycle,
+        const m6502::Mem* Base, m6502::u64 BaseId, std::vector<m6502::Byte>& Out)
+    {
+        using namespace m6502;
+
+        Byte Bitmap[BITMAP_BYTES] = {};
+        u32 Pages = 0;
+        for (u32 Page = 0; Page < Mem::NUM_PAGES; Page++)
+        {
+            const bool Store = Base ? !memory.SamePage(*Base, Page) : memory.RAM[Page] != &Mem::ZeroPage;
+            if (Store)
+            {
+                Bitmap[Page / 8] |= Byte(1 << (Page % 8));
+                Pages++;
+            }
+        }
+
+        const u64 Start = Out.size();
+        Out.resize(Start + HEADER_SIZE + u64(Pages) * Mem::PAGE_SIZE);
+        Byte* State = Out.data() + Start;
+        memcpy(State, SAVESTATE_MAGIC, sizeof(SAVESTATE_MAGIC));
+        State[4] = SAVESTATE_VERSION;
+        State[5] = Base ? 1 : 0;
+        State[6] = State[7] = 0;
+        PutInt(State + 16, BaseId, 8);
+        PutInt(State + 24, Cycle, 8);
+        PutInt(State + 32, cpu.PC, 2);
+        PutInt(State + 34, cpu.SP, 2);
+        State[36] = cpu.A;
+        State[37] = cpu.X;
+        State[38] = cpu.Y;
+        State[39] = cpu.GetStatus();
+        State[40] = cpu.IRQLines;
+        State[41] = Byte((cpu.NMILine ? 1 : 0) | (cpu.NMIPending ? 2 : 0));
+        memcpy(State + BITMAP_OFFSET, Bitmap, BITMAP_BYTES);
+
+        Byte* PageData = State + HEADER_SIZE;
+        for (u32 Page = 0; Page < Mem::NUM_PAGES; Page++)
+        {
+            if (Bitmap[Page / 8] & (1 << (Page % 8)))
+            {
+                memcpy(PageData, memory.RAM[Page]->Bytes, Mem::PAGE_SIZE);
+                PageData += Mem::PAGE_SIZE;
+            }
+        }
+
+        const u64 Size = Out.size() - Start;
+        const u64 Id = StateId(State, Size);
+        PutInt(State + ID_OFFSET, Id, 8);
+        return { Id, BaseId, Cycle, Base != nullptr, Pages };
+    }
+
+    bool HasPage(const m6502::Byte* State, m6502::u32 Page)
+    {
+        return State[BITMAP_OFFSET + Page / 8] & (1 << (Page % 8));
+    }
+}
+
+m6502::SaveStateInfo m6502::SaveFull(const CPU& cpu, const Mem& memory, u64 Cycle, std::vector<Byte>& Out)
+{
+    return Save(cpu, memory, Cycle, nullptr, 0, Out);
+}
+
+m6502::SaveStateInfo m6502::SaveDelta(const CPU& cpu, const Mem& memory, u64 Cycle,
+    const Mem& Base, const SaveStateInfo& BaseInfo, std::vector<Byte>& Out)
+{
+    return Save(cpu, memory, Cycle, &Base, BaseInfo.Id, Out);
+}
+
+bool m6502::ReadSaveStateInfo(const Byte* Data, u64 Size, SaveStateInfo& Info)
+{
+    if (Data == nullptr || Size < HEADER_SIZE || memcmp(Data, SAVESTATE_MAGIC, sizeof(SAVESTATE_MAGIC)) != 0 ||
+        Data[4] != SAVESTATE_VERSION || Data[5] > 1)
+    {
+        return false;
+    }
+
+    u32 Pages = 0;
+    for (u32 Page = 0; Page < Mem::NUM_PAGES; Page++)
+    {
+        Pages += HasPage(Data, Page) ? 1 : 0;
+    }
+    const u64 StateSize = HEADER_SIZE + u64(Pages) * Mem::PAGE_SIZE;
+    if (Size < StateSize)
+    {
+        return false;
+    }
+
+    const u64 Id = GetInt(Data + ID_OFFSET, 8);
+    if (Id != StateId(Data, StateSize))
+    {
+        return false;
+    }
+    Info = { Id, GetInt(Data + 16, 8), GetInt(Data + 24, 8), Data[5] == 1, Pages };
+    return true;
+}
+
+bool m6502::LoadSaveState(const Byte* Data, u64 Size, CPU& cpu, Mem& memory, u64 LoadedId, SaveStateInfo& Info)
+{
+    SaveStateInfo State;
+    if (!ReadSaveStateInfo(Data, Size, State) || (State.Delta && State.BaseId != LoadedId))
+    {
+        return false;
+    }
+
+    const Byte* PageData = Data + HEADER_SIZE;
+    for (u32 Page = 0; Page < Mem::NUM_PAGES; Page++)
+    {
+        if (HasPage(Data, Page))
+        {
+            memory.SetPage(Page, PageData);
+            PageData += Mem::PAGE_SIZE;
+        }
+        else if (!State.Delta)
+        {
+            memory.SetPage(Page, nullptr);
+        }
+    }
+
+    cpu.PC = Word(GetInt(Data + 32, 2));
+    cpu.SP = Word(GetInt(Data + 34, 2));
+    cpu.A = Data[36];
+    cpu.X = Data[37];
+    cpu.Y = Data[38];
+    cpu.SetStatus(Data[39]);
+    cpu.IRQLines = Data[40];
+    cpu.NMILine = (Data[41] & 1) != 0;
+    cpu.NMIPending = (Data[41] & 2) != 0;
+    Info = State;
+    return true;
+}
+
+bool m6502::WriteFile(const char* Path, const std::vector<Byte>& Bytes)
+{
+    FILE* Out = fopen(Path, "wb");
+    if (Out == nullptr)
+    {
+        return false;
+    }
+    const bool Written = fwrite(Bytes.data(), 1, Bytes.size(), Out) == Bytes.size();
+    return fclose(Out) == 0 && Written;
+}
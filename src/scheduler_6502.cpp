@@ -0,0 +1,124 @@
+#include <algorithm>
+#include <blockcache_6502.hpp>
+#include <scheduler_6502.hpp>
+
+m6502::Scheduler::EventId m6502::Scheduler::Schedule(u64 Cycle, EventHandler Handler, void* Context)
+{
+    u32 Slot;
+    if (!FreeSlots.empty())
+    {
+        Slot = FreeSlots.back();
+        FreeSlots.pop_back();
+    }
+    else
+    {
+        Slot = u32(Generations.size());
+        Generations.push_back(1);
+    }
+    Heap.push_back({ Cycle, NextSequence++, Handler, Context, Slot, Generations[Slot] });
+    std::push_heap(Heap.begin(), Heap.end(), Later);
+    return (u64(Generations[Slot]) << 32) | Slot;
+}
+
+bool m6502::Scheduler::Cancel(EventId Id)
+{
+    const u32 Slot = u32(Id);
+    if (Slot >= Generations.size() || Generations[Slot] != u32(Id >> 32))
+    {
+        return false;
+    }
+    // The heap entry stays until it reaches the top, then it's dropped as stale
+    FreeSlot(Slot);
+    Cancelled++;
+    if (Cancelled > Heap.size() / 2)
+    {
+        Heap.erase(std::remove_if(Heap.begin(), Heap.end(),
+            [this](const Event& Entry) { return Generations[Entry.Slot] != Entry.Generation; }), Heap.end());
+        std::make_heap(Heap.begin(), Heap.end(), Later);
+        Cancelled = 0;
+    }
+    return true;
+}
+
+void m6502::Scheduler::FreeSlot(u32 Slot)
+{
+    // Generation 0 is never handed out, so no Id is 0
+    if (++Generations[Slot] == 0)
+    {
+        Generations[Slot] = 1;
+    }
+    FreeSlots.push_back(Slot);
+}
+
+void m6502::Scheduler::DropCancelled()
+{
+    while (!Heap.empty() && Generations[Heap.front().Slot] != Heap.front().Generation)
+    {
+        std::pop_heap(Heap.begin(), Heap.end(), Later);
+        Heap.pop_back();
+        Cancelled--;
+    }
+}
+
+m6502::u64 m6502::Scheduler::NextDeadline()
+{
+    DropCancelled();
+    return Heap.empty() ? ~0ull : Heap.front().Cycle;
+}
+
+void m6502::Scheduler::DispatchDue()
+{
+    while (!StopRequested && NextDeadline() <= Now)
+    {
+        std::pop_heap(Heap.begin(), Heap.end(), Later);
+        const Event Due = Heap.back();
+        Heap.pop_back();
+        FreeSlot(Due.Slot);
+        Due.Handler(Due.Context, *this, Due.Cycle);
+    }
+}
+
+template <typename Executor>
+m6502::RunResult m6502::Scheduler::RunUntil(CPU& cpu, s32 Cycles, Executor Execute)
+{
+    const u64 Start = Now;
+    const u64 Target = Now + u64(Cycles > 0 ? Cycles : 0);
+    RunResult Result = { StopReason::CyclesExhausted, 0, cpu.PC, 0 };
+    StopRequested = false;
+    for (;;)
+    {
+        DispatchDue();
+        if (StopRequested)
+        {
+            Result.Reason = StopReason::HostRequest;
+            break;
+        }
+        if (Now >= Target)
+        {
+            break;
+        }
+
+        // The CPU only ever runs up to the next deadline, devices are never polled
+        const u64 End = std::min(Target, NextDeadline());
+        const RunResult Step = Execute(s32(End - Now));
+        Now += u64(Step.CyclesUsed);
+        if (Step.Reason != StopReason::CyclesExhausted)
+        {
+            Result = Step;
+            break;
+        }
+    }
+    Result.CyclesUsed = s32(Now - Start);
+    Result.PC = cpu.PC;
+    return Result;
+}
+
+m6502::RunResult m6502::Scheduler::Run(CPU& cpu, Mem& memory, s32 Cycles)
+{
+    return RunUntil(cpu, Cycles, [&](s32 Budget) { return cpu.Run(Budget, memory); });
+}
+
+m6502::RunResult m6502::Scheduler::Run(CPU& cpu, Mem& memory, BlockCache& cache, s32 Cycles)
+{
+    return RunUntil(cpu, Cycles, [&](s32 Budget) { return cpu.Run(Budget, memory, cache); });
+}
@@ -0,0 +1,452 @@
+#include <algorithm>
+#include <string.h>
+#include <trace_6502.hpp>
+
+namespace
+{
+    enum TraceField : m6502::Byte
+    {
+        FIELD_PC = 0x01,
+        FIELD_A = 0x02,
+        FIELD_X = 0x04,
+        FIELD_Y = 0x08,
+        FIELD_P = 0x10,
+        FIELD_SP = 0x20,
+        FIELD_CYCLES = 0x40
+    };
+
+    // PC of the instruction following Record when it doesn't branch
+    m6502::Word NextPC(const m6502::TraceRecord& Record)
+    {
+        return m6502::Word(Record.PC + m6502::TraceOpcodes[Record.Opcode].Bytes);
+    }
+
+    void PutInt(std::vector<m6502::Byte>& Out, m6502::u64 Value, int Bytes)
+    {
+        for (int Index = 0; Index < Bytes; Index++)
+        {
+            Out.push_back(m6502::Byte(Value >> (Index * 8)));
+        }
+    }
+
+    m6502::u64 GetInt(const m6502::Byte* In, int Bytes)
+    {
+        m6502::u64 Value = 0;
+        for (int Index = 0; Index < Bytes; Index++)
+        {
+            Value |= m6502::u64(In[Index]) << (Index * 8);
+        }
+        return Value;
+    }
+
+    // Cycles used by the instruction in Record, Previous is the record before it
+    m6502::u64 CyclesUsed(const m6502::TraceRecord& Record, const m6502::TraceRecord& Previous)
+    {
+        return Record.Cycle - Previous.Cycle;
+    }
+}
+
+void m6502::TraceEncoder::Encode(const TraceRecord& Record, std::vector<Byte>& Out)
+{
+    const u64 Cycles = CyclesUsed(Record, Previous);
+    Byte Fields = 0;
+    Fields |= Record.PC != NextPC(Previous) ? FIELD_PC : 0;
+    Fields |= Record.A != Previous.A ? FIELD_A : 0;
+    Fields |= Record.X != Previous.X ? FIELD_X : 0;
+    Fields |= Record.Y != Previous.Y ? FIELD_Y : 0;
+    Fields |= Record.P != Previous.P ? FIELD_P : 0;
+    Fields |= Record.SP != Previous.SP ? FIELD_SP : 0;
+    Fields |= Cycles != TraceOpcodes[Record.Opcode].Cycles ? FIELD_CYCLES : 0;
+
+    Out.push_back(Fields);
+    Out.push_back(Record.Opcode);
+    for (Byte Index = 0; Index + 1 < TraceOpcodes[Record.Opcode].Bytes; Index++)
+    {
+        Out.push_back(Record.Operand[Index]);
+    }
+    if (Fields & FIELD_PC)
+    {
+        Out.push_back(Byte(Record.PC));
+        Out.push_back(Byte(Record.PC >> 8));
+    }
+    if (Fields & FIELD_A) Out.push_back(Record.A);
+    if (Fields & FIELD_X) Out.push_back(Record.X);
+    if (Fields & FIELD_Y) Out.push_back(Record.Y);
+    if (Fields & FIELD_P) Out.push_back(Record.P);
+    if (Fields & FIELD_SP)
+    {
+        Out.push_back(Byte(Record.SP));
+        Out.push_back(Byte(Record.SP >> 8));
+    }
+    if (Fields & FIELD_CYCLES)
+    {
+        // Varint, 7 bits per byte, high bit set on all but the last
+        u64 Value = Cycles;
+        while (Value >= 0x80)
+        {
+            Out.push_back(Byte(Value | 0x80));
+            Value >>= 7;
+        }
+        Out.push_back(Byte(Value));
+    }
+
+    Previous = Record;
+}
+
+bool m6502::TraceDecoder::Decode(const Byte*& Cursor, const Byte* End, TraceRecord& Record)
+{
+    const Byte* In = Cursor;
+    auto Take = [&In, End](Byte& Value)
+    {
+        if (In == End)
+        {
+            return false;
+        }
+        Value = *In++;
+        return true;
+    };
+    auto TakeWord = [&Take](Word& Value)
+    {
+        Byte Low, High;
+        if (!Take(Low) || !Take(High))
+        {
+            return false;
+        }
+        Value = Word(Low | (High << 8));
+        return true;
+    };
+
+    Byte Fields;
+    TraceRecord Decoded = Previous;
+    Decoded.Operand[0] = Decoded.Operand[1] = 0;
+    if (!Take(Fields) || !Take(Decoded.Opcode))
+    {
+        return false;
+    }
+    for (Byte Index = 0; Index + 1 < TraceOpcodes[Decoded.Opcode].Bytes; Index++)
+    {
+        if (!Take(Decoded.Operand[Index]))
+        {
+            return false;
+        }
+    }
+
+    Decoded.PC = NextPC(Previous);
+    if ((Fields & FIELD_PC) && !TakeWord(Decoded.PC)) return false;
+    if ((Fields & FIELD_A) && !Take(Decoded.A)) return false;
+    if ((Fields & FIELD_X) && !Take(Decoded.X)) return false;
+    if ((Fields & FIELD_Y) && !Take(Decoded.Y)) return false;
+    if ((Fields & FIELD_P) && !Take(Decoded.P)) return false;
+    if ((Fields & FIELD_SP) && !TakeWord(Decoded.SP)) return false;
+
+    u64 Cycles = TraceOpcodes[Decoded.Opcode].Cycles;
+    if (Fields & FIELD_CYCLES)
+    {
+        Cycles = 0;
+        Byte Part;
+        u32 Shift = 0;
+        do
+        {
+            if (Shift > 63 || !Take(Part))
+            {
+                return false;
+            }
+            Cycles |= u64(Part & 0x7F) << Shift;
+            Shift += 7;
+        } while (Part & 0x80);
+    }
+    Decoded.Cycle = Previous.Cycle + Cycles;
+
+    Record = Decoded;
+    Previous = Decoded;
+    Cursor = In;
+    return true;
+}
+
+m6502::TraceWriter::~TraceWriter()
+{
+    Close();
+}
+
+bool m6502::TraceWriter::Open(const char* Path)
+{
+    Close();
+    File = fopen(Path, "wb");
+    if (File == nullptr)
+    {
+        return false;
+    }
+    WriteError = false;
+    Write(TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    Write(&TRACE_VERSION, 1);
+    Offset = sizeof(TRACE_MAGIC) + 1;
+    Index.clear();
+    Buffer.clear();
+    Current = TraceChunk{};
+    Encoder.Restart();
+    return true;
+}
+
+void m6502::TraceWriter::Append(const TraceRecord& Record)
+{
+    if (Current.Records == 0)
+    {
+        Current.FirstCycle = Record.Cycle;
+    }
+    Encoder.Encode(Record, Buffer);
+    Current.LastCycle = Record.Cycle;
+    Current.AddPC(Record.PC);
+    if (++Current.Records == TraceChunk::CHUNK_RECORDS)
+    {
+        WriteChunk();
+    }
+}
+
+void m6502::TraceWriter::Write(const void* Data, u64 Size)
+{
+    if (fwrite(Data, 1, size_t(Size), File) != Size)
+    {
+        WriteError = true;
+    }
+}
+
+void m6502::TraceWriter::WriteChunk()
+{
+    Current.Offset = Offset;
+    Current.Size = u32(Buffer.size());
+    Write(Buffer.data(), Buffer.size());
+    Offset += Buffer.size();
+    Index.push_back(Current);
+
+    Buffer.clear();
+    Current = TraceChunk{};
+    // Every chunk decodes on its own
+    Encoder.Restart();
+}
+
+bool m6502::TraceWriter::Close()
+{
+    if (File == nullptr)
+    {
+        return !WriteError;
+    }
+    if (Current.Records > 0)
+    {
+        WriteChunk();
+    }
+
+    std::vector<Byte> Footer;
+    for (const TraceChunk& Chunk : Index)
+    {
+        PutInt(Footer, Chunk.Offset, 8);
+        PutInt(Footer, Chunk.Size, 4);
+        PutInt(Footer, Chunk.Records, 4);
+        PutInt(Footer, Chunk.FirstCycle, 8);
+        PutInt(Footer, Chunk.LastCycle, 8);
+        for (u64 Bits : Chunk.PCBitmap)
+        {
+            PutInt(Footer, Bits, 8);
+        }
+    }
+    PutInt(Footer, Offset, 8);
+    PutInt(Footer, Index.size(), 4);
+    Footer.insert(Footer.end(), TRACE_INDEX_MAGIC, TRACE_INDEX_MAGIC + sizeof(TRACE_INDEX_MAGIC));
+    Write(Footer.data(), Footer.size());
+
+    // Buffered writes only fail here when the last of them reaches the file
+    if (fflush(File) != 0)
+    {
+        WriteError = true;
+    }
+    if (fclose(File) != 0)
+    {
+        WriteError = true;
+    }
+    File = nullptr;
+    return !WriteError;
+}
+
+m6502::Tracer::Tracer(const char* Path, u32 RingCapacity)
+    : Ring(RingCapacity)
+{
+    if (Output.Open(Path))
+    {
+        Running = true;
+        Writer = std::thread(&Tracer::Write, this);
+    }
+}
+
+m6502::Tracer::~Tracer()
+{
+    Close();
+}
+
+bool m6502::Tracer::Close()
+{
+    if (!Running)
+    {
+        return !Output.Failed();
+    }
+    Stopping.store(true, std::memory_order_release);
+    Writer.join();
+    Running = false;
+    return Output.Close();
+}
+
+void m6502::Tracer::Write()
+{
+    TraceRecord Record;
+    for (;;)
+    {
+        // Read the flag first so records pushed before Close are all drained
+        const bool Last = Stopping.load(std::memory_order_acquire);
+        while (Ring.TryPop(Record))
+        {
+            Output.Append(Record);
+        }
+        if (Last)
+        {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+}
+
+m6502::TraceReader::TraceReader(const char* Path)
+    : File(Path)
+{
+    Data = File.Data();
+    Size = File.Size();
+    if (Data != nullptr && !ReadIndex())
+    {
+        File.Close();
+        Data = nullptr;
+        Size = 0;
+        Index.clear();
+    }
+}
+
+bool m6502::TraceReader::ReadIndex()
+{
+    const u64 HeaderSize = sizeof(TRACE_MAGIC) + 1;
+    const u64 TrailerSize = 8 + 4 + sizeof(TRACE_INDEX_MAGIC);
+    if (Size < HeaderSize + TrailerSize || memcmp(Data, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0 ||
+        Data[sizeof(TRACE_MAGIC)] != TRACE_VERSION ||
+        memcmp(Data + Size - sizeof(TRACE_INDEX_MAGIC), TRACE_INDEX_MAGIC, sizeof(TRACE_INDEX_MAGIC)) != 0)
+    {
+        return false;
+    }
+
+    // Offsets come from the file, checked against what is left so no sum can wrap
+    const Byte* Trailer = Data + Size - TrailerSize;
+    const u64 IndexOffset = GetInt(Trailer, 8);
+    const u64 ChunkCount = GetInt(Trailer + 8, 4);
+    const u64 IndexEnd = Size - TrailerSize;
+    if (IndexOffset < HeaderSize || IndexOffset > IndexEnd ||
+        ChunkCount != (IndexEnd - IndexOffset) / TraceChunk::SERIALISED_SIZE ||
+        (IndexEnd - IndexOffset) % TraceChunk::SERIALISED_SIZE != 0)
+    {
+        return false;
+    }
+
+    const Byte* In = Data + IndexOffset;
+    Index.resize(ChunkCount);
+    for (TraceChunk& Chunk : Index)
+    {
+        Chunk.Offset = GetInt(In, 8);
+        Chunk.Size = u32(GetInt(In + 8, 4));
+        Chunk.Records = u32(GetInt(In + 12, 4));
+        Chunk.FirstCycle = GetInt(In + 16, 8);
+        Chunk.LastCycle = GetInt(In + 24, 8);
+        In += 32;
+        for (u64& Bits : Chunk.PCBitmap)
+        {
+            Bits = GetInt(In, 8);
+            In += 8;
+        }
+        if (Chunk.Offset < HeaderSize || Chunk.Offset > IndexOffset || Chunk.Size > IndexOffset - Chunk.Offset)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+m6502::u64 m6502::TraceReader::Records() const
+{
+    u64 Total = 0;
+    for (const TraceChunk& Chunk : Index)
+    {
+        Total += Chunk.Records;
+    }
+    return Total;
+}
+
+bool m6502::TraceReader::Next(TraceRecord& Record)
+{
+    while (Data != nullptr)
+    {
+        if (Cursor != nullptr && Decoder.Decode(Cursor, ChunkEnd, Record))
+        {
+            return true;
+        }
+        if (NextChunk == Index.size())
+        {
+            return false;
+        }
+        Cursor = ChunkData(Index[NextChunk]);
+        ChunkEnd = Cursor + Index[NextChunk].Size;
+        Decoder.Restart();
+        NextChunk++;
+    }
+    return false;
+}
+
+bool m6502::TraceReader::FindExecution(Word PC, u64 AfterCycle, TraceRecord& Record) const
+{
+    // First chunk that ends after AfterCycle, the index is in cycle order
+    auto Chunk = std::upper_bound(Index.begin(), Index.end(), AfterCycle,
+        [](u64 Cycle, const TraceChunk& Entry) { return Cycle < Entry.LastCycle; });
+    for (; Chunk != Index.end(); ++Chunk)
+    {
+        if (!Chunk->MayHavePC(PC))
+        {
+            continue;
+        }
+        TraceDecoder ChunkDecoder;
+        const Byte* In = ChunkData(*Chunk);
+        const Byte* End = In + Chunk->Size;
+        TraceRecord Candidate;
+        while (ChunkDecoder.Decode(In, End, Candidate))
+        {
+            if (Candidate.PC == PC && Candidate.Cycle > AfterCycle)
+            {
+                Record = Candidate;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool m6502::TraceReader::StateAt(u64 Cycle, TraceRecord& Record) const
+{
+    // Last chunk that starts at or before Cycle
+    auto Chunk = std::upper_bound(Index.begin(), Index.end(), Cycle,
+        [](u64 Target, const TraceChunk& Entry) { return Target < Entry.FirstCycle; });
+    if (Chunk == Index.begin())
+    {
+        return false;
+    }
+    --Chunk;
+
+    TraceDecoder ChunkDecoder;
+    const Byte* In = ChunkData(*Chunk);
+    const Byte* End = In + Chunk->Size;
+    TraceRecord Candidate;
+    while (ChunkDecoder.Decode(In, End, Candidate) && Candidate.Cycle <= Cycle)
+    {
+        Record = Candidate;
+    }
+    return true;
+}
@@ -0,0 +1,256 @@
+#include <chrono>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "batchrunner_6502.hpp"
+#include "loader_6502.hpp"
+#include "mappedfile_6502.hpp"
+
+/*
+* Batch runner front end.
+*
+* Runs every program image on a BatchRunner and writes the final state of
+* each one as JSON. Images are raw binaries loaded at --load, or PRG and
+* multi-segment images with --format (loader_6502.hpp), started at --start
+* or the image's entry point. A --list file names one image per line,
+* optionally followed by that image's cycle budget.
+*
+* Usage: M6502BatchRun [--threads N] [--cycles N] [--format raw|prg|segments]
+*                      [--load ADDR] [--start ADDR] [--list file] [--out file.json] [image...]
+* Addresses are hexadecimal. Throughput is reported on stderr.
+* */
+using namespace m6502;
+
+namespace
+{
+    struct Program
+    {
+        std::string Path;
+        s64 Cycles;
+        std::vector<Byte> Data; // The image file, Image points into it
+        std::unique_ptr<ProgramImage> Image;
+    };
+
+    const char* ReasonName(StopReason Reason)
+    {
+        switch (Reason)
+        {
+        case StopReason::CyclesExhausted: return "cycles_exhausted";
+        case StopReason::IllegalOpcode: return "illegal_opcode";
+        case StopReason::Breakpoint: return "breakpoint";
+        case StopReason::Halt: return "halt";
+        case StopReason::HostRequest: return "host_request";
+        }
+        return "unknown";
+    }
+
+    bool ParseFormat(const char* Name, ImageFormat& Format)
+    {
+        if (strcmp(Name, "raw") == 0)
+        {
+            Format = ImageFormat::Raw;
+        }
+        else if (strcmp(Name, "prg") == 0)
+        {
+            Format = ImageFormat::PRG;
+        }
+        else if (strcmp(Name, "segments") == 0)
+        {
+            Format = ImageFormat::Segments;
+        }
+        else
+        {
+            return false;
+        }
+        return true;
+    }
+
+    // Reads "path [cycles]" lines, blank lines and lines starting with # are skipped
+    bool ReadList(const char* ListPath, s64 DefaultCycles, std::vector<Program>& Programs)
+    {
+        FILE* In = fopen(ListPath, "r");
+        if (In == nullptr)
+        {
+            return false;
+        }
+        char Line[4096];
+        while (fgets(Line, sizeof(Line), In))
+        {
+            char Path[4096];
+            long long Cycles = DefaultCycles;
+            if (Line[0] == '#' || sscanf(Line, "%4095s %lld", Path, &Cycles) < 1)
+            {
+                continue;
+            }
+            Programs.push_back({ Path, s64(Cycles), {}, nullptr });
+        }
+        fclose(In);
+        return true;
+    }
+
+    // Copies the file out of a mapping closed straight away: keeping thousands of
+    // images mapped until the batch runs would hit the per-process map limit
+    bool LoadImage(Program& Prog, ImageFormat Format, Word LoadAddress)
+    {
+        {
+            MappedFile File;
+            if (!File.Open(Prog.Path.c_str()))
+            {
+                return false;
+            }
+            Prog.Data.assign(File.Data(), File.Data() + File.Size());
+        }
+        Prog.Image = std::make_unique<ProgramImage>();
+        return Prog.Image->Parse(Prog.Data.data(), Prog.Data.size(), Format, LoadAddress);
+    }
+
+    // Quotes, backslashes and control characters escaped, other bytes as they are
+    void WriteJSONString(FILE* Out, const std::string& Text)
+    {
+        fputc('"', Out);
+        for (const char Char : Text)
+        {
+            if (Char == '"' || Char == '\\')
+            {
+                fputc('\\', Out);
+                fputc(Char, Out);
+            }
+            else if (Byte(Char) < 0x20)
+            {
+                fprintf(Out, "\\u%04x", unsigned(Byte(Char)));
+            }
+            else
+            {
+                fputc(Char, Out);
+            }
+        }
+        fputc('"', Out);
+    }
+
+    void WriteJSON(FILE* Out, const std::vector<Program>& Programs, const std::vector<BatchJobResult>& Results,
+        u32 Threads, double Seconds)
+    {
+        // Zero rather than inf or NaN (not valid JSON) for an empty batch or a clock that didn't tick
+        const double ProgramsPerSecond = Seconds > 0 ? double(Results.size()) / Seconds : 0;
+        fprintf(Out, "{\n  \"threads\": %u,\n  \"seconds\": %.6f,\n  \"programs_per_second\": %.1f,\n  \"results\": [\n",
+            Threads, Seconds, ProgramsPerSecond);
+        for (size_t Index = 0; Index < Results.size(); Index++)
+        {
+            const BatchJobResult& Res = Results[Index];
+            fprintf(Out, "    { \"image\": ");
+            WriteJSONString(Out, Programs[Index].Path);
+            fprintf(Out,
+                ", \"reason\": \"%s\", \"cycles\": %lld, \"pc\": %u, \"sp\": %u, "
+                "\"a\": %u, \"x\": %u, \"y\": %u, \"p\": %u, \"memory_digest\": \"%016llx\" }%s\n",
+                ReasonName(Res.Reason), (long long)Res.CyclesUsed, Res.PC, Res.SP,
+                Res.A, Res.X, Res.Y, Res.Status, (unsigned long long)Res.MemoryDigest,
+                Index + 1 < Results.size() ? "," : "");
+        }
+        fprintf(Out, "  ]\n}\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    u32 Threads = 0;
+    s64 Cycles = 1000000;
+    Word LoadAddress = 0x0200;
+    Word StartPC = 0x0200;
+    bool StartGiven = false;
+    ImageFormat Format = ImageFormat::Raw;
+    const char* OutPath = nullptr;
+    std::vector<const char*> Lists;
+    std::vector<const char*> Images;
+    for (int Arg = 1; Arg < argc; Arg++)
+    {
+        const bool HasValue = Arg + 1 < argc;
+        if (strcmp(argv[Arg], "--threads") == 0 && HasValue)
+        {
+            Threads = u32(atoi(argv[++Arg]));
+        }
+        else if (strcmp(argv[Arg], "--cycles") == 0 && HasValue)
+        {
+            Cycles = atoll(argv[++Arg]);
+        }
+        else if (strcmp(argv[Arg], "--format") == 0 && HasValue && ParseFormat(argv[Arg + 1], Format))
+        {
+            Arg++;
+        }
+        else if (strcmp(argv[Arg], "--load") == 0 && HasValue)
+        {
+            LoadAddress = Word(strtoul(argv[++Arg], nullptr, 16));
+        }
+        else if (strcmp(argv[Arg], "--start") == 0 && HasValue)
+        {
+            StartPC = Word(strtoul(argv[++Arg], nullptr, 16));
+            StartGiven = true;
+        }
+        else if (strcmp(argv[Arg], "--list") == 0 && HasValue)
+        {
+            Lists.push_back(argv[++Arg]);
+        }
+        else if (strcmp(argv[Arg], "--out") == 0 && HasValue)
+        {
+            OutPath = argv[++Arg];
+        }
+        else if (argv[Arg][0] != '-')
+        {
+            Images.push_back(argv[Arg]);
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [--threads N] [--cycles N] [--format raw|prg|segments] [--load ADDR] "
+                "[--start ADDR] [--list file] [--out file.json] [image...]\n", argv[0]);
+            return 1;
+        }
+    }
+    std::vector<Program> Programs;
+    for (const char* ListPath : Lists)
+    {
+        if (!ReadList(ListPath, Cycles, Programs))
+        {
+            fprintf(stderr, "Can't read %s\n", ListPath);
+            return 1;
+        }
+    }
+    for (const char* ImagePath : Images)
+    {
+        Programs.push_back({ ImagePath, Cycles, {}, nullptr });
+    }
+
+    std::vector<BatchJob> Jobs;
+    Jobs.reserve(Programs.size());
+    for (Program& Prog : Programs)
+    {
+        if (!LoadImage(Prog, Format, LoadAddress))
+        {
+            fprintf(stderr, "Can't load %s\n", Prog.Path.c_str());
+            return 1;
+        }
+        const Word Start = StartGiven ? StartPC : Prog.Image->Entry();
+        Jobs.push_back({ nullptr, 0, LoadAddress, Start, Prog.Cycles, Prog.Image.get() });
+    }
+
+    BatchRunner Runner(Threads);
+    std::vector<BatchJobResult> Results;
+    const auto Start = std::chrono::steady_clock::now();
+    Runner.Run(Jobs, Results);
+    const double Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+    fprintf(stderr, "%zu programs on %u threads in %.3f s\n", Results.size(), Runner.Workers(), Seconds);
+
+    FILE* Out = OutPath ? fopen(OutPath, "w") : stdout;
+    if (Out == nullptr)
+    {
+        fprintf(stderr, "Can't open %s\n", OutPath);
+        return 1;
+    }
+    WriteJSON(Out, Programs, Results, Runner.Workers(), Seconds);
+    if (Out != stdout)
+    {
+        fclose(Out);
+    }
+    return 0;
+}